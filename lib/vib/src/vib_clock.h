@@ -0,0 +1,124 @@
+// vib_clock.h
+// Wall clock (epoch) to monotonic clock correlation.
+//
+// A Pair is one bracketed reading: monotonic before, wall clock, monotonic
+// after. The wall reading happened somewhere in [before, after], so taking
+// the midpoint leaves at most width / 2 of error. sample() keeps the
+// narrowest of a few tries, which drops readings cut by an interrupt.
+//
+// Model anchors on one pair and maps a monotonic time to the epoch as
+//
+//   epoch(m) = anchor.epoch + (m - anchor.mono) * (1 + skew)
+//
+// with skew measured between the anchor and the latest pair once they are
+// kMinSpanUs apart (before that it is 0, with kPriorSkewPpm as its bound).
+// err_at() is the bound of that mapping: the anchor's half-width plus the
+// skew bound times the distance from the anchor. A pair the model misses by
+// more than its bound plus kStepUs means the wall clock was stepped (an NTP
+// update): the model re-anchors there and counts the step.
+//
+// Times are in us. Everything is integer except skew.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+namespace vib {
+namespace clk {
+
+struct Pair {
+  int64_t mono_us = 0;    // midpoint of the bracket
+  int64_t epoch_us = 0;
+  uint32_t width_us = 0;  // after - before
+};
+
+// mono(), wall(): callables returning int64_t us
+template <typename Mono, typename Wall>
+inline Pair sample(Mono mono, Wall wall, int tries) {
+  Pair best;
+  best.width_us = 0xFFFFFFFFu;
+  for (int i = 0; i < tries; i++) {
+    const int64_t a = mono();
+    const int64_t e = wall();
+    const int64_t b = mono();
+    const uint32_t w = (uint32_t)(b - a);
+    if (w < best.width_us) {
+      best.mono_us = a + (b - a) / 2;
+      best.epoch_us = e;
+      best.width_us = w;
+    }
+  }
+  return best;
+}
+
+class Model {
+public:
+  static constexpr int64_t kMinSpanUs = 1000000;
+  static constexpr uint32_t kStepUs = 1000;
+  static constexpr double kPriorSkewPpm = 100.0;
+
+  void reset() { *this = Model(); }
+
+  bool valid() const { return valid_; }
+
+  // Returns false if p shows a step (and re-anchors on it)
+  bool update(const Pair& p) {
+    if (!valid_) {
+      anchor(p);
+      return true;
+    }
+    last_resid_us_ = p.epoch_us - epoch_at(p.mono_us);
+    const int64_t tol = (int64_t)err_at(p.mono_us) + p.width_us / 2 + kStepUs;
+    if (last_resid_us_ > tol || last_resid_us_ < -tol) {
+      steps_++;
+      anchor(p);
+      return false;
+    }
+    const int64_t span = p.mono_us - anchor_.mono_us;
+    if (span >= kMinSpanUs) {
+      skew_ = (double)((p.epoch_us - anchor_.epoch_us) - span) / (double)span;
+      skew_err_ = ((double)anchor_.width_us + (double)p.width_us) * 0.5 / (double)span;
+      span_us_ = span;
+    }
+    return true;
+  }
+
+  int64_t epoch_at(int64_t mono_us) const {
+    const int64_t d = mono_us - anchor_.mono_us;
+    return anchor_.epoch_us + d + (int64_t)llround((double)d * skew_);
+  }
+
+  uint32_t err_at(int64_t mono_us) const {
+    const int64_t d = mono_us - anchor_.mono_us;
+    const double e = (double)anchor_.width_us * 0.5 + fabs((double)d) * skew_err_;
+    return e < 4294967295.0 ? (uint32_t)ceil(e) : 0xFFFFFFFFu;
+  }
+
+  double skew_ppm() const { return skew_ * 1e6; }
+  int64_t span_us() const { return span_us_; }
+  uint32_t steps() const { return steps_; }
+  int64_t last_resid_us() const { return last_resid_us_; }
+  const Pair& anchor_pair() const { return anchor_; }
+
+private:
+  void anchor(const Pair& p) {
+    anchor_ = p;
+    valid_ = true;
+    skew_ = 0.0;
+    skew_err_ = kPriorSkewPpm * 1e-6;
+    span_us_ = 0;
+  }
+
+  Pair anchor_;
+  bool valid_ = false;
+  double skew_ = 0.0;
+  double skew_err_ = kPriorSkewPpm * 1e-6;
+  int64_t span_us_ = 0;
+  uint32_t steps_ = 0;
+  int64_t last_resid_us_ = 0;
+};
+
+} // namespace clk
+} // namespace vib
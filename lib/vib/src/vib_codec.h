@@ -0,0 +1,189 @@
+// vib_codec.h
+// Axis blob codecs (encode on device, decode on host).
+//
+//   raw16  "i16le_mg"   int16 little-endian, mg                      2 B/sample
+//   raw12  "i12p_so"    12-bit two's complement in units of So mg,
+//                       two samples packed in 3 bytes                1.5 B/sample
+//   delta  "dzv_so"     first sample then first differences, in
+//                       units of So mg, zigzag + LEB128 varint       <= 2 B/sample
+//
+// So is the sensor sensitivity (3/6/12 mg/digit for 6/12/24 g) and is sent
+// in the meta as "so_mg". raw12/delta are lossless for unfiltered sensor data
+// (every mg value is a multiple of So); after filtering, values are rounded
+// to the nearest So and clamped to 12 bits (clamps are counted).
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace vib {
+namespace codec {
+
+enum Codec : uint8_t {
+  RAW16 = 0,
+  RAW12 = 1,
+  DELTA = 2,
+};
+
+inline const char* name(Codec c) {
+  switch (c) {
+    case RAW12: return "raw12";
+    case DELTA: return "delta";
+    default:    return "raw16";
+  }
+}
+
+// Value of the meta "a_fmt" field
+inline const char* format(Codec c) {
+  switch (c) {
+    case RAW12: return "i12p_so";
+    case DELTA: return "dzv_so";
+    default:    return "i16le_mg";
+  }
+}
+
+inline bool parse(const char* s, Codec& out) {
+  if (!s) return false;
+  if (!strcmp(s, "raw16")) { out = RAW16; return true; }
+  if (!strcmp(s, "raw12")) { out = RAW12; return true; }
+  if (!strcmp(s, "delta")) { out = DELTA; return true; }
+  return false;
+}
+
+// Worst-case encoded size for n samples
+inline size_t max_bytes(Codec c, size_t n) {
+  switch (c) {
+    case RAW12: return (3 * n + 1) / 2;
+    default:    return 2 * n;   // raw16; delta diffs fit 2 varint bytes
+  }
+}
+
+// mg -> digit (units of So), rounded half away from zero and clamped to 12 bits
+inline int32_t to_digit(int16_t mg, int32_t so, uint32_t& clamps) {
+  int32_t v = mg;
+  int32_t d = (v >= 0) ? (v + so / 2) / so : -((-v + so / 2) / so);
+  if (d > 2047)  { d = 2047;  clamps++; }
+  if (d < -2048) { d = -2048; clamps++; }
+  return d;
+}
+
+inline uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+inline int32_t unzigzag(uint32_t u) { return (int32_t)(u >> 1) ^ -(int32_t)(u & 1); }
+
+inline size_t put_varint(uint8_t* dst, uint32_t v) {
+  size_t n = 0;
+  while (v >= 0x80) { dst[n++] = (uint8_t)(v | 0x80); v >>= 7; }
+  dst[n++] = (uint8_t)v;
+  return n;
+}
+
+// -------------------------
+// Encoders: return bytes written, 0 if cap is too small
+// -------------------------
+inline size_t encode_raw16(const int16_t* x, size_t n, uint8_t* out, size_t cap) {
+  if (cap < 2 * n) return 0;
+  for (size_t i = 0; i < n; i++) {
+    const uint16_t v = (uint16_t)x[i];
+    out[2 * i]     = (uint8_t)(v & 0xFF);
+    out[2 * i + 1] = (uint8_t)(v >> 8);
+  }
+  return 2 * n;
+}
+
+inline size_t encode_raw12(const int16_t* x, size_t n, int32_t so,
+                           uint8_t* out, size_t cap, uint32_t& clamps) {
+  const size_t need = max_bytes(RAW12, n);
+  if (cap < need) return 0;
+  size_t o = 0;
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    const uint16_t d0 = (uint16_t)to_digit(x[i], so, clamps) & 0x0FFF;
+    const uint16_t d1 = (uint16_t)to_digit(x[i + 1], so, clamps) & 0x0FFF;
+    out[o++] = (uint8_t)(d0 & 0xFF);
+    out[o++] = (uint8_t)((d0 >> 8) | ((d1 & 0x0F) << 4));
+    out[o++] = (uint8_t)(d1 >> 4);
+  }
+  if (i < n) {
+    const uint16_t d0 = (uint16_t)to_digit(x[i], so, clamps) & 0x0FFF;
+    out[o++] = (uint8_t)(d0 & 0xFF);
+    out[o++] = (uint8_t)(d0 >> 8);
+  }
+  return o;
+}
+
+inline size_t encode_delta(const int16_t* x, size_t n, int32_t so,
+                           uint8_t* out, size_t cap, uint32_t& clamps) {
+  if (cap < max_bytes(DELTA, n)) return 0;
+  size_t o = 0;
+  int32_t prev = 0;
+  for (size_t i = 0; i < n; i++) {
+    const int32_t d = to_digit(x[i], so, clamps);
+    o += put_varint(&out[o], zigzag(d - prev));
+    prev = d;
+  }
+  return o;
+}
+
+inline size_t encode(Codec c, const int16_t* x, size_t n, int32_t so,
+                     uint8_t* out, size_t cap, uint32_t& clamps) {
+  switch (c) {
+    case RAW12: return encode_raw12(x, n, so, out, cap, clamps);
+    case DELTA: return encode_delta(x, n, so, out, cap, clamps);
+    default:    return encode_raw16(x, n, out, cap);
+  }
+}
+
+// -------------------------
+// Decoders (to mg): return samples written, or -1 on malformed input
+// -------------------------
+inline long decode(Codec c, const uint8_t* in, size_t len, int32_t so,
+                   int16_t* out, size_t max_n) {
+  size_t n = 0;
+  if (c == RAW16) {
+    if (len % 2) return -1;
+    for (size_t i = 0; i + 1 < len && n < max_n; i += 2) {
+      out[n++] = (int16_t)((uint16_t)in[i] | ((uint16_t)in[i + 1] << 8));
+    }
+    return (long)n;
+  }
+  if (c == RAW12) {
+    size_t i = 0;
+    for (; i + 3 <= len && n + 2 <= max_n; i += 3) {
+      int32_t d0 = (int32_t)in[i] | (((int32_t)in[i + 1] & 0x0F) << 8);
+      int32_t d1 = ((int32_t)in[i + 1] >> 4) | ((int32_t)in[i + 2] << 4);
+      if (d0 & 0x800) d0 -= 0x1000;
+      if (d1 & 0x800) d1 -= 0x1000;
+      out[n++] = (int16_t)(d0 * so);
+      out[n++] = (int16_t)(d1 * so);
+    }
+    if (len - i == 2 && n < max_n) {
+      int32_t d0 = (int32_t)in[i] | (((int32_t)in[i + 1] & 0x0F) << 8);
+      if (d0 & 0x800) d0 -= 0x1000;
+      out[n++] = (int16_t)(d0 * so);
+      i += 2;
+    }
+    return (i == len) ? (long)n : -1;
+  }
+  // DELTA
+  int32_t prev = 0;
+  size_t i = 0;
+  while (i < len && n < max_n) {
+    uint32_t u = 0;
+    int shift = 0;
+    for (;;) {
+      if (i >= len || shift > 28) return -1;
+      const uint8_t b = in[i++];
+      u |= (uint32_t)(b & 0x7F) << shift;
+      if (!(b & 0x80)) break;
+      shift += 7;
+    }
+    prev += unzigzag(u);
+    out[n++] = (int16_t)(prev * so);
+  }
+  return (i == len) ? (long)n : -1;
+}
+
+} // namespace codec
+} // namespace vib
@@ -0,0 +1,126 @@
+// vib_cov.h
+// Streaming 3-axis covariance and principal vibration direction.
+//
+// Cov3 accumulates exact integer sums over (x, y, z) samples in one pass, so
+// it can sit inside the acquisition loop (9 multiply-adds per sample). pca3()
+// turns the sums into the covariance matrix and diagonalizes it with cyclic
+// Jacobi rotations: the eigenvector of the largest eigenvalue is the dominant
+// vibration direction in sensor axes, and the eigenvalues over their sum are
+// the share of (mean-removed) vibration energy along each principal axis.
+// Both are independent of how the sensor is mounted.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+namespace vib {
+
+struct Cov3 {
+  uint32_t n = 0;
+  int64_t s[3] = {0, 0, 0};
+  int64_t ss[6] = {0, 0, 0, 0, 0, 0};   // xx, yy, zz, xy, xz, yz
+
+  void reset() { *this = Cov3(); }
+
+  // |v| <= 32768: each product fits int32; the int64 sums are exact for any
+  // realistic n
+  inline void add(int16_t x, int16_t y, int16_t z) {
+    n++;
+    s[0] += x; s[1] += y; s[2] += z;
+    ss[0] += (int32_t)x * x; ss[1] += (int32_t)y * y; ss[2] += (int32_t)z * z;
+    ss[3] += (int32_t)x * y; ss[4] += (int32_t)x * z; ss[5] += (int32_t)y * z;
+  }
+
+  // Population covariance (divides by n)
+  void covariance(double c[3][3]) const {
+    const double inv = n ? 1.0 / (double)n : 0.0;
+    const double m[3] = { s[0] * inv, s[1] * inv, s[2] * inv };
+    c[0][0] = ss[0] * inv - m[0] * m[0];
+    c[1][1] = ss[1] * inv - m[1] * m[1];
+    c[2][2] = ss[2] * inv - m[2] * m[2];
+    c[0][1] = c[1][0] = ss[3] * inv - m[0] * m[1];
+    c[0][2] = c[2][0] = ss[4] * inv - m[0] * m[2];
+    c[1][2] = c[2][1] = ss[5] * inv - m[1] * m[2];
+  }
+};
+
+// Eigen-decomposition of a symmetric 3x3 matrix by cyclic Jacobi rotations.
+// a is destroyed; w receives the eigenvalues, column j of v the eigenvector
+// of w[j] (unsorted). Converges to double precision in a few sweeps.
+inline void jacobi_eig3(double a[3][3], double v[3][3], double w[3]) {
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++) v[i][j] = (i == j) ? 1.0 : 0.0;
+
+  for (int sweep = 0; sweep < 16; sweep++) {
+    const double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+    const double diag = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+    if (off <= 1e-30 * diag || off == 0.0) break;
+    for (int p = 0; p < 2; p++) {
+      for (int q = p + 1; q < 3; q++) {
+        if (a[p][q] == 0.0) continue;
+        // Rotation angle that zeroes a[p][q] (Numerical Recipes form)
+        const double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+        const double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+        const double c = 1.0 / sqrt(t * t + 1.0);
+        const double sn = t * c;
+        for (int k = 0; k < 3; k++) {
+          const double akp = a[k][p], akq = a[k][q];
+          a[k][p] = c * akp - sn * akq;
+          a[k][q] = sn * akp + c * akq;
+        }
+        for (int k = 0; k < 3; k++) {
+          const double apk = a[p][k], aqk = a[q][k];
+          a[p][k] = c * apk - sn * aqk;
+          a[q][k] = sn * apk + c * aqk;
+        }
+        for (int k = 0; k < 3; k++) {
+          const double vkp = v[k][p], vkq = v[k][q];
+          v[k][p] = c * vkp - sn * vkq;
+          v[k][q] = sn * vkp + c * vkq;
+        }
+      }
+    }
+  }
+  for (int i = 0; i < 3; i++) w[i] = a[i][i];
+}
+
+struct Pca3 {
+  bool valid = false;
+  float dir[3] = {0.0f, 0.0f, 0.0f};     // unit principal direction (largest component > 0)
+  float ratio[3] = {0.0f, 0.0f, 0.0f};   // eigenvalue / trace, descending
+  float var_mg2 = 0.0f;                  // trace: total variance, mg^2
+};
+
+inline Pca3 pca3(const Cov3& acc) {
+  Pca3 r;
+  if (acc.n < 2) return r;
+  double a[3][3], v[3][3], w[3];
+  acc.covariance(a);
+  jacobi_eig3(a, v, w);
+
+  int order[3] = {0, 1, 2};
+  for (int i = 0; i < 2; i++)
+    for (int j = i + 1; j < 3; j++)
+      if (w[order[j]] > w[order[i]]) { const int t = order[i]; order[i] = order[j]; order[j] = t; }
+
+  double trace = 0.0;
+  for (int i = 0; i < 3; i++) trace += (w[i] > 0.0 ? w[i] : 0.0);
+  if (trace <= 0.0) return r;
+
+  const int m = order[0];
+  // Eigenvectors have no sign: make the largest component positive
+  int big = 0;
+  for (int i = 1; i < 3; i++) if (fabs(v[i][m]) > fabs(v[big][m])) big = i;
+  const double sgn = v[big][m] < 0.0 ? -1.0 : 1.0;
+  for (int i = 0; i < 3; i++) {
+    r.dir[i] = (float)(sgn * v[i][m]);
+    r.ratio[i] = (float)((w[order[i]] > 0.0 ? w[order[i]] : 0.0) / trace);
+  }
+  r.var_mg2 = (float)trace;
+  r.valid = true;
+  return r;
+}
+
+} // namespace vib
@@ -0,0 +1,37 @@
+// vib_crc.h
+// CRC-32 (IEEE 802.3: reflected, polynomial 0xEDB88320, init and final xor
+// 0xFFFFFFFF; the zlib / PNG crc32). Every chunk message carries the CRC of
+// its payload so the backend can drop a damaged chunk and NACK it, and the
+// device and host tools compute it with this same code.
+//
+// Nibble table (16 entries, 64 bytes): about 2 table lookups per byte, fast
+// enough for 1 KB chunks without a 1 KB table in DRAM.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace vib {
+namespace crc {
+
+// crc32(a + b) == crc32(b, crc32(a)): pass the previous result to continue
+inline uint32_t crc32(const void* data, size_t len, uint32_t prev = 0) {
+  static const uint32_t kNibble[16] = {
+    0x00000000u, 0x1DB71064u, 0x3B6E20C8u, 0x26D930ACu,
+    0x76DC4190u, 0x6B6B51F4u, 0x4DB26158u, 0x5005713Cu,
+    0xEDB88320u, 0xF00F9344u, 0xD6D6A3E8u, 0xCB61B38Cu,
+    0x9B64C2B0u, 0x86D3D2D4u, 0xA00AE278u, 0xBDBDF21Cu,
+  };
+  const uint8_t* p = (const uint8_t*)data;
+  uint32_t c = ~prev;
+  for (size_t i = 0; i < len; i++) {
+    c ^= p[i];
+    c = (c >> 4) ^ kNibble[c & 15];
+    c = (c >> 4) ^ kNibble[c & 15];
+  }
+  return ~c;
+}
+
+} // namespace crc
+} // namespace vib
@@ -0,0 +1,231 @@
+// vib_fixed.h
+// Fixed-point (Q15 samples / Q30 coefficients / Q27 internal) signal path.
+//
+// Samples stay int16 from the sensor to the gate decision:
+//   - input: int16 counts with a known scale (mg per LSB). The firmware keeps
+//     mg (1 mg/LSB); raw LIS331HH counts are So/16 mg/LSB.
+//   - filters: DF-I biquads with Q30 coefficients (|c| < 2) and a 64-bit
+//     accumulator. Samples are lifted to Q27 in int32, i.e. kGuardBits of
+//     headroom above int16 full scale, so overshoot never wraps internally;
+//     only the final narrowing to int16 saturates, and saturations are counted.
+//   - features: exact int64 sums of squares, integer sqrt, peak and clip
+//     counts.
+//   - gate: threshold is converted once to the sum-of-squares domain; the
+//     per-capture decision is a single integer compare and therefore
+//     bit-exact between device and host.
+//
+// Headroom per range_g: mg samples span +/-2047*So mg (6141/12282/24564 for
+// 6/12/24 g). headroom_bits() reports how much int16 room is left above that,
+// which is what a filter overshoot (e.g. HPF step response) may consume
+// before the int16 output saturates.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "vib_kernels.h"
+
+namespace vib {
+namespace fx {
+
+static constexpr int kGuardBits = 4;               // int16 -> int32 Q27
+static constexpr int kLift = 16 - kGuardBits;      // shift into the Q27 domain
+static constexpr int kCoefFrac = 30;               // Q30 coefficients
+static constexpr double kG0 = 9.80665;
+
+// LIS331HH sensitivity for 12-bit data (datasheet So), mg/digit
+inline int32_t mg_per_digit(uint8_t range_g) {
+  return (range_g == 6) ? 3 : (range_g == 12) ? 6 : 12;
+}
+
+// Largest |mg| the sensor can report at a range
+inline int32_t max_abs_mg(uint8_t range_g) {
+  return 2047 * mg_per_digit(range_g);
+}
+
+// Whole bits of int16 headroom above the sensor full scale when storing mg
+inline int headroom_bits(uint8_t range_g) {
+  int bits = 0;
+  int32_t m = max_abs_mg(range_g);
+  while ((m << 1) <= 32767) { m <<= 1; bits++; }
+  return bits;
+}
+
+// -------------------------
+// Biquads (DF-I, Q30 coefficients)
+// -------------------------
+struct BiquadQ30 {
+  int32_t b0, b1, b2, a1, a2;
+};
+
+struct BiquadStateQ {
+  int32_t x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+};
+
+inline int32_t toQ30(float c) {
+  double v = (double)c * (double)(1L << kCoefFrac);
+  if (v > 2147483647.0) v = 2147483647.0;
+  if (v < -2147483648.0) v = -2147483648.0;
+  return (int32_t)llround(v);
+}
+
+inline BiquadQ30 toQ30(const Biquad& b) {
+  BiquadQ30 q;
+  q.b0 = toQ30(b.b0);
+  q.b1 = toQ30(b.b1);
+  q.b2 = toQ30(b.b2);
+  q.a1 = toQ30(b.a1);
+  q.a2 = toQ30(b.a2);
+  return q;
+}
+
+inline int32_t sat32(int64_t v, uint32_t& sat) {
+  if (v > INT32_MAX) { sat++; return INT32_MAX; }
+  if (v < INT32_MIN) { sat++; return INT32_MIN; }
+  return (int32_t)v;
+}
+
+inline int16_t sat16(int32_t v, uint32_t& sat) {
+  if (v > INT16_MAX) { sat++; return INT16_MAX; }
+  if (v < INT16_MIN) { sat++; return INT16_MIN; }
+  return (int16_t)v;
+}
+
+// One section on Q27 data, in place. With |x| <= 2^27 and |c| < 2^31 each
+// product is < 2^58; a stable section keeps y within the guard bits, so the
+// 5-term sum cannot overflow int64.
+inline void biquad_q27(int32_t* x, size_t n, const BiquadQ30& c, BiquadStateQ& s, uint32_t& sat) {
+  const int64_t rnd = (int64_t)1 << (kCoefFrac - 1);
+  for (size_t i = 0; i < n; i++) {
+    const int32_t x0 = x[i];
+    int64_t acc = (int64_t)c.b0 * x0 + (int64_t)c.b1 * s.x1 + (int64_t)c.b2 * s.x2
+                - (int64_t)c.a1 * s.y1 - (int64_t)c.a2 * s.y2;
+    const int32_t y0 = sat32((acc + rnd) >> kCoefFrac, sat);
+    s.x2 = s.x1; s.x1 = x0;
+    s.y2 = s.y1; s.y1 = y0;
+    x[i] = y0;
+  }
+}
+
+// Puts a section in the steady state of a constant Q27 input x0, as if x0
+// had always been applied: x1 = x2 = x0, y1 = y2 = DC gain * x0. Returns that
+// output (the next section's input). Priming a cascade with the first sample
+// keeps the offset a capture starts at (gravity) from ringing through a
+// high-pass as a 1 g step.
+inline int32_t biquad_prime_q27(const BiquadQ30& c, BiquadStateQ& s, int32_t x0) {
+  const int64_t num = (int64_t)c.b0 + c.b1 + c.b2;
+  const int64_t den = ((int64_t)1 << kCoefFrac) + c.a1 + c.a2;
+  const int32_t y = den ? (int32_t)llround((double)x0 * (double)num / (double)den) : 0;
+  s.x1 = s.x2 = x0;
+  s.y1 = s.y2 = y;
+  return y;
+}
+
+inline void biquad_cascade_prime_q15(const BiquadQ30* sec, BiquadStateQ* st, size_t n_sec, int16_t x0) {
+  int32_t v = (int32_t)x0 * (1 << kLift);
+  for (size_t s = 0; s < n_sec; s++) v = biquad_prime_q27(sec[s], st[s], v);
+}
+
+// int16 -> cascade -> int16. work must hold n int32. out may alias in.
+// Returns the number of saturations (internal + int16 narrowing).
+inline uint32_t biquad_cascade_q15(const int16_t* in, int16_t* out, size_t n,
+                                   const BiquadQ30* sec, BiquadStateQ* st, size_t n_sec,
+                                   int32_t* work) {
+  uint32_t sat = 0;
+  for (size_t i = 0; i < n; i++) work[i] = (int32_t)in[i] * (1 << kLift);
+  for (size_t s = 0; s < n_sec; s++) biquad_q27(work, n, sec[s], st[s], sat);
+  const int32_t rnd = 1 << (kLift - 1);
+  for (size_t i = 0; i < n; i++) out[i] = sat16((int32_t)(((int64_t)work[i] + rnd) >> kLift), sat);
+  return sat;
+}
+
+// -------------------------
+// Auto-ranging
+// -------------------------
+// Range for the next capture from this one's raw peak (|mg| before any
+// filtering) and clipped-sample count. Clipping jumps to 24 g, since the true
+// amplitude is unknown; a peak above 90% of full scale steps up one range;
+// otherwise the smallest range whose full scale is at least twice the peak is
+// used. The 50%..90% band is the hysteresis.
+inline bool is_clipped_digit(int32_t d) {
+  return d >= 2047 || d <= -2048;
+}
+
+// Raw LIS331HH OUT_X/Y/Z (12-bit left-justified two's complement) -> mg.
+// 2047 * 12 mg = 24564 mg, always in int16 range.
+inline int16_t raw_to_mg(int16_t raw, int32_t mg_per_digit) {
+  return (int16_t)((raw >> 4) * mg_per_digit);
+}
+
+inline uint8_t next_range_g(uint8_t range_g, int32_t peak_mg, uint32_t clip) {
+  if (clip > 0) return 24;
+  if ((int64_t)peak_mg * 10 >= (int64_t)max_abs_mg(range_g) * 9) {
+    return range_g == 6 ? 12 : 24;
+  }
+  static const uint8_t kLower[2] = { 6, 12 };
+  for (size_t i = 0; i < 2 && kLower[i] < range_g; i++) {
+    if ((int64_t)peak_mg * 2 < (int64_t)max_abs_mg(kLower[i])) return kLower[i];
+  }
+  return range_g;
+}
+
+// -------------------------
+// Features
+// -------------------------
+inline uint32_t isqrt64(uint64_t v) {
+  // Bitwise integer sqrt (floor); deterministic on any platform.
+  uint64_t r = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+  while (bit > v) bit >>= 2;
+  while (bit) {
+    if (v >= r + bit) { v -= r + bit; r = (r >> 1) + bit; }
+    else r >>= 1;
+    bit >>= 2;
+  }
+  return (uint32_t)r;
+}
+
+struct AxisStatsQ {
+  int64_t sum_sq = 0;
+  int32_t peak = 0;       // max |x|, counts
+  uint32_t clip = 0;      // samples at or beyond clip_level
+};
+
+inline AxisStatsQ axis_stats(const int16_t* x, size_t n, int32_t clip_level) {
+  AxisStatsQ st;
+  st.sum_sq = vib::sum_sq_i16(x, n);
+  for (size_t i = 0; i < n; i++) {
+    const int32_t a = x[i] < 0 ? -(int32_t)x[i] : (int32_t)x[i];
+    if (a > st.peak) st.peak = a;
+    if (a >= clip_level) st.clip++;
+  }
+  return st;
+}
+
+// RMS of the 3-axis magnitude in counts (floor), from the summed squares
+inline uint32_t mag_rms_counts(int64_t sum_sq_xyz, uint32_t n) {
+  if (n == 0) return 0;
+  return isqrt64((uint64_t)sum_sq_xyz / n);
+}
+
+// -------------------------
+// Gate
+// -------------------------
+// sum(x^2+y^2+z^2) >= thr_sum_sq  <=>  mag_rms >= threshold.
+// Computed once per configuration; the decision itself is integer-only.
+inline uint64_t gate_sum_sq_threshold(float thr_mps2, float mg_per_lsb, uint32_t n) {
+  if (thr_mps2 <= 0.0f || n == 0) return 0;
+  const double thr_counts = ((double)thr_mps2 / kG0) * 1000.0 / (double)mg_per_lsb;
+  const double t = ceil(thr_counts * thr_counts * (double)n);
+  if (t >= 18446744073709551615.0) return UINT64_MAX;
+  return (uint64_t)t;
+}
+
+inline bool gate_pass(int64_t sum_sq_xyz, uint64_t thr_sum_sq) {
+  return (uint64_t)sum_sq_xyz >= thr_sum_sq;
+}
+
+} // namespace fx
+} // namespace vib
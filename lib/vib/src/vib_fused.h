@@ -0,0 +1,280 @@
+// vib_fused.h
+// Compile-time specialized pipelines, fused into the acquisition loop.
+//
+// vib_pipeline.h runs one stage at a time over the whole capture. For the
+// stage combinations we actually deploy, this header composes the same stages
+// as templates (Chain<Hpf, Rms, Peak>, ...) whose per-sample step() calls
+// inline into one loop. The firmware runs that loop inside acquireN, so the
+// filter and the feature accumulators run while the sample is still in a
+// register, with no virtual call per sample.
+//
+// Only the filter chains are fused: without a filter the generic rms/peak
+// loops are already tight and the per-sample chain measured slower. The gate
+// and the encoder always run generically after the capture, so a capture the
+// gate rejects is never encoded.
+//
+// The runtime config still decides: match() finds the longest pipeline prefix
+// in the table of instantiated variants, and dispatch() calls a functor with
+// the matching concrete Chain type. Everything after that prefix runs in the
+// generic Pipeline. Results are bit-identical to the generic stages: the
+// fixed-point recurrences and accumulators are the same.
+//
+// Fused stage interface (static, no virtuals):
+//   bool    configure(const pipe::StageSpec&)
+//   void    begin(pipe::Frame&)                    once per capture
+//   int16_t step(unsigned axis, int16_t x)         per sample and axis
+//   bool    end(pipe::Frame&)                      false stops the capture
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vib_pipeline.h"
+
+namespace vib {
+namespace fused {
+
+using pipe::kAxes;
+
+// -------------------------
+// Stages
+// -------------------------
+class Hpf {
+public:
+  bool configure(const pipe::StageSpec& s) {
+    if (strcmp(s.type, "hpf") != 0) return false;
+    fc_hz_ = s.num("fc_hz", 0.0f);
+    q_ = s.num("q", 0.70710678f);
+    order_ = (int)s.num("order", 2.0f);
+    return fc_hz_ > 0.0f;
+  }
+
+  void begin(pipe::Frame& f) {
+    sections_ = pipe::design_butterworth(true, fc_hz_, f.fs_hz, order_, q_, sec_);
+    for (size_t k = 0; k < kAxes; k++) primed_[k] = false;
+    sat_ = 0;
+  }
+
+  // Same arithmetic as fx::biquad_cascade_q15 (primed with the first
+  // sample, as BiquadStage does), one sample at a time
+  inline int16_t step(unsigned axis, int16_t x) {
+    if (!primed_[axis]) {
+      fx::biquad_cascade_prime_q15(sec_, st_[axis], sections_, x);
+      primed_[axis] = true;
+    }
+    const int64_t rnd = (int64_t)1 << (fx::kCoefFrac - 1);
+    int32_t v = (int32_t)x * (1 << fx::kLift);
+    for (uint8_t s = 0; s < sections_; s++) {
+      const fx::BiquadQ30& c = sec_[s];
+      fx::BiquadStateQ& st = st_[axis][s];
+      const int64_t acc = (int64_t)c.b0 * v + (int64_t)c.b1 * st.x1 + (int64_t)c.b2 * st.x2
+                        - (int64_t)c.a1 * st.y1 - (int64_t)c.a2 * st.y2;
+      const int32_t y = fx::sat32((acc + rnd) >> fx::kCoefFrac, sat_);
+      st.x2 = st.x1; st.x1 = v;
+      st.y2 = st.y1; st.y1 = y;
+      v = y;
+    }
+    const int32_t r = 1 << (fx::kLift - 1);
+    return fx::sat16((int32_t)(((int64_t)v + r) >> fx::kLift), sat_);
+  }
+
+  bool end(pipe::Frame& f) { f.filt_sat += sat_; return true; }
+
+private:
+  float fc_hz_ = 0.0f;
+  float q_ = 0.70710678f;
+  int order_ = 2;
+  uint8_t sections_ = 1;
+  uint32_t sat_ = 0;
+  fx::BiquadQ30 sec_[pipe::kMaxSections];
+  fx::BiquadStateQ st_[kAxes][pipe::kMaxSections];
+  bool primed_[kAxes] = {false, false, false};
+};
+
+class Rms {
+public:
+  bool configure(const pipe::StageSpec& s) { return !strcmp(s.type, "rms"); }
+  void begin(pipe::Frame&) { sum_ = 0; }
+  inline int16_t step(unsigned, int16_t x) { sum_ += (int32_t)x * (int32_t)x; return x; }
+  bool end(pipe::Frame& f) {
+    f.feat.sum_sq_mg2 = sum_;
+    f.feat.mag_rms_mps2 = f.n ? (float)(sqrt((double)sum_ / (double)f.n) * (fx::kG0 / 1000.0)) : 0.0f;
+    f.feat.valid |= pipe::FEAT_RMS;
+    return true;
+  }
+private:
+  int64_t sum_ = 0;
+};
+
+class Peak {
+public:
+  bool configure(const pipe::StageSpec& s) { return !strcmp(s.type, "peak"); }
+  void begin(pipe::Frame& f) {
+    clip_mg_ = fx::max_abs_mg(f.range_g);
+    clip_ = 0;
+    for (size_t k = 0; k < kAxes; k++) peak_[k] = 0;
+  }
+  inline int16_t step(unsigned axis, int16_t x) {
+    const int32_t a = x < 0 ? -(int32_t)x : (int32_t)x;
+    if (a > peak_[axis]) peak_[axis] = a;
+    if (a >= clip_mg_) clip_++;
+    return x;
+  }
+  bool end(pipe::Frame& f) {
+    for (size_t k = 0; k < kAxes; k++) f.feat.peak_mg[k] = peak_[k];
+    f.feat.clip = clip_;
+    f.feat.valid |= pipe::FEAT_PEAK;
+    return true;
+  }
+private:
+  int32_t clip_mg_ = 0;
+  int32_t peak_[kAxes] = {0, 0, 0};
+  uint32_t clip_ = 0;
+};
+
+// -------------------------
+// Chain
+// -------------------------
+template <class... S> class Chain;
+
+template <> class Chain<> {
+public:
+  static const size_t kLength = 0;
+  bool configure(const pipe::StageSpec*, size_t n) { return n == 0; }
+  void begin(pipe::Frame&) {}
+  inline int16_t step(unsigned, int16_t x) { return x; }
+  bool end(pipe::Frame&) { return true; }
+};
+
+template <class H, class... T> class Chain<H, T...> {
+public:
+  static const size_t kLength = 1 + sizeof...(T);
+
+  bool configure(const pipe::StageSpec* specs, size_t n) {
+    return n == kLength && head_.configure(specs[0]) && tail_.configure(specs + 1, n - 1);
+  }
+  void begin(pipe::Frame& f) { head_.begin(f); tail_.begin(f); }
+  inline int16_t step(unsigned axis, int16_t x) { return tail_.step(axis, head_.step(axis, x)); }
+  bool end(pipe::Frame& f) { return head_.end(f) && tail_.end(f); }
+
+private:
+  H head_;
+  Chain<T...> tail_;
+};
+
+// Runs a chain over a Frame: push() one 3-axis sample at a time (the
+// processed sample is stored back into the frame buffers), then finish().
+template <class C> class Fused {
+public:
+  bool configure(const pipe::StageSpec* specs, size_t n) { return chain_.configure(specs, n); }
+
+  // f.n, f.fs_hz, f.range_g and the buffers must be set
+  void begin(pipe::Frame& f) {
+    f_ = &f;
+    f.feat = pipe::Features();
+    f.gate_pass = true;
+    f.stopped_by = nullptr;
+    f.filt_sat = 0;
+    chain_.begin(f);
+  }
+
+  inline void push(uint32_t i, const int16_t xyz[kAxes]) {
+    f_->axis[0][i] = chain_.step(0, xyz[0]);
+    f_->axis[1][i] = chain_.step(1, xyz[1]);
+    f_->axis[2][i] = chain_.step(2, xyz[2]);
+  }
+
+  // Finishes the filter and feature stages. false = stopped
+  bool finish() {
+    const bool ok = chain_.end(*f_);
+    if (!ok) f_->stopped_by = "fused";
+    return ok;
+  }
+
+private:
+  C chain_;
+  pipe::Frame* f_ = nullptr;
+};
+
+// -------------------------
+// Instantiated variants
+// -------------------------
+enum Variant : uint8_t {
+  NONE = 0,                 // no fusion: raw samples, generic pipeline afterwards
+  HPF_RMS,
+  HPF_RMS_PEAK,
+};
+
+typedef Chain<> ChainNone;
+typedef Chain<Hpf, Rms> ChainHpfRms;
+typedef Chain<Hpf, Rms, Peak> ChainHpfRmsPeak;
+
+struct VariantInfo {
+  Variant id;
+  const char* signature;    // pipe::Pipeline::describe() of the fused prefix
+};
+
+static const VariantInfo kVariants[] = {
+  { HPF_RMS,      "hpf>rms" },
+  { HPF_RMS_PEAK, "hpf>rms>peak" },
+};
+
+inline const char* name(Variant v) {
+  for (size_t i = 0; i < sizeof(kVariants) / sizeof(kVariants[0]); i++) {
+    if (kVariants[i].id == v) return kVariants[i].signature;
+  }
+  return "none";
+}
+
+// Finds the variant covering the longest prefix of the pipeline. covered
+// receives the number of pipeline stages it replaces (0 for NONE).
+inline Variant match(const pipe::Pipeline& p, size_t& covered) {
+  covered = 0;
+  Variant best = NONE;
+  char sig[96];
+  size_t o = 0;
+  sig[0] = '\0';
+  for (size_t n = 0; n < p.size(); n++) {
+    const pipe::Stage* st = p.stage(n);
+    if (st->kind() == pipe::SINK) break;
+    const int w = snprintf(&sig[o], sizeof(sig) - o, "%s%s", n ? ">" : "", st->type());
+    if (w < 0 || (size_t)w >= sizeof(sig) - o) break;
+    o += (size_t)w;
+    for (size_t i = 0; i < sizeof(kVariants) / sizeof(kVariants[0]); i++) {
+      if (!strcmp(sig, kVariants[i].signature)) {
+        covered = n + 1;
+        best = kVariants[i].id;
+      }
+    }
+  }
+  return best;
+}
+
+// Calls fn(Fused<ChainX>&) with the concrete chain for v, configured from
+// the first `covered` pipeline specs, and returns fn's result. NONE (or a
+// chain that fails to configure) runs the empty chain and sets covered = 0,
+// so the caller runs the whole generic pipeline afterwards.
+template <class Fn>
+bool dispatch(Variant v, const pipe::Pipeline& p, size_t& covered, Fn& fn) {
+#define VIB_FUSED_CASE(ID, TYPE)                                             \
+  case ID: {                                                                 \
+    Fused<TYPE> fz;                                                          \
+    if (fz.configure(p.specs(), covered)) return fn(fz);                     \
+    break;                                                                   \
+  }
+  switch (v) {
+    VIB_FUSED_CASE(HPF_RMS,      ChainHpfRms)
+    VIB_FUSED_CASE(HPF_RMS_PEAK, ChainHpfRmsPeak)
+    default: break;
+  }
+#undef VIB_FUSED_CASE
+  covered = 0;
+  Fused<ChainNone> none;
+  none.configure(nullptr, 0);
+  return fn(none);
+}
+
+} // namespace fused
+} // namespace vib
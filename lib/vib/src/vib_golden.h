@@ -0,0 +1,270 @@
+// vib_golden.h
+// Golden vectors for the feature path shared by the firmware and the host.
+//
+// Each case is a synthetic capture (generated with integer arithmetic only,
+// so it is the same on every platform) run through a Pipeline built from a
+// stage list. The result is one text line:
+//
+//   <case> sum_sq=.. rms=<float bits> peak=x,y,z clip=.. fsat=.. gate=..
+//          stop=.. clamps=.. axes=<fnv64> x=<len>:<fnv64> y=.. z=..
+//          | speed~.. conf~.. kurt_lo~.. kurt_hi~.. kurt~.. kurt_axis~..
+//
+// Fields before "|" come from the integer path (filters, sums of squares,
+// peaks, gate, codecs) and must match bit for bit. Fields after it come from
+// float spectra (the FFT is esp-dsp on the device, SSE/AVX or scalar on the
+// host) and are compared with a tolerance (tools/vib_golden.cpp).
+//
+// Stage lists are written as "hpf fc_hz=2 order=4; rms; encode codec=delta":
+// stages separated by ';', params as key=value, numbers or strings.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vib_fixed.h"
+#include "vib_pipeline.h"
+
+namespace vib {
+namespace golden {
+
+enum Signal : uint8_t {
+  QUIET = 0,     // gravity on z and sensor noise
+  MACHINE = 1,   // running speed with harmonics, unbalance on x/y
+  BEARING = 2,   // noise plus periodic decaying impulses ringing a resonance
+  CLIPPED = 3,   // machine, driven past full scale
+};
+
+struct Case {
+  const char* name;
+  const char* stages;
+  uint8_t range_g;
+  uint16_t fs_hz;
+  uint16_t n;
+  Signal signal;
+};
+
+static const Case kCases[] = {
+  { "default_quiet_24g", "rms; peak; gate feature=mag_rms min=10.78; encode codec=raw16", 24, 1000, 3000, QUIET },
+  { "default_machine_24g", "rms; peak; gate feature=mag_rms min=10.78; encode codec=raw16", 24, 1000, 3000, MACHINE },
+  { "hpf_delta_12g", "hpf fc_hz=2 order=4; rms; peak; encode codec=delta", 12, 1000, 3000, MACHINE },
+  { "demean_raw12_6g", "demean; rms; peak; gate min=0.5; encode codec=raw12", 6, 1000, 3000, MACHINE },
+  { "speed_24g", "hpf fc_hz=5 order=2; rms; speed rpm_min=600 rpm_max=6000 harmonics=4 nfft=2048; encode codec=raw16", 24, 1000, 3000, MACHINE },
+  { "kurtogram_24g", "hpf fc_hz=10 order=4; rms; peak; kurtogram nw_min=16 nw_max=256 fmin_hz=50; encode codec=delta", 24, 1000, 3000, BEARING },
+  { "clipped_6g", "rms; peak; gate feature=peak min=1; encode codec=raw12", 6, 400, 1024, CLIPPED },
+  { "lpf_bpf_12g", "lpf fc_hz=150 order=4; bpf fc_hz=50 q=2; rms; peak; encode codec=delta", 12, 400, 1024, MACHINE },
+  { "window_gate_12g", "rms; gate min=10 max=30; encode codec=raw16", 12, 400, 1200, MACHINE },
+};
+static const size_t kNumCases = sizeof(kCases) / sizeof(kCases[0]);
+
+// -------------------------
+// Integer signal generator
+// -------------------------
+// sin of a 16-bit phase in Q15 (Bhaskara I; ~0.2% error, integer only)
+inline int32_t isin_q15(uint16_t ph) {
+  const int64_t x = ph & 0x7FFF;
+  const int64_t p = x * (32768 - x);
+  int64_t s = (16 * p * 32768) / ((int64_t)5 * 32768 * 32768 - 4 * p);
+  if (s > 32767) s = 32767;
+  return ph & 0x8000 ? -(int32_t)s : (int32_t)s;
+}
+
+struct Osc {
+  uint32_t phase = 0, inc = 0;
+  Osc(uint32_t f_mhz, uint16_t fs_hz, uint32_t phase0)
+    : phase(phase0), inc((uint32_t)(((uint64_t)f_mhz << 32) / ((uint64_t)fs_hz * 1000u))) {}
+  inline int32_t next() { const int32_t s = isin_q15((uint16_t)(phase >> 16)); phase += inc; return s; }
+};
+
+inline uint32_t xorshift32(uint32_t& s) {
+  s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+  return s;
+}
+
+// Roughly normal, sd ~ amp_mg
+inline int32_t noise_mg(uint32_t& s, int32_t amp_mg) {
+  int32_t u = 0;
+  for (int i = 0; i < 4; i++) u += (int32_t)(xorshift32(s) & 0xFFFF) - 32768;
+  return (int32_t)(((int64_t)u * amp_mg) / 37837);   // 4 uniforms: sd = 65536 / sqrt(3)
+}
+
+// Fills x/y/z (mg) the way the sensor would: whole digits of So, clipped at
+// 12 bits, converted with fx::raw_to_mg
+inline void make_signal(const Case& c, int16_t* axis[pipe::kAxes]) {
+  const int32_t so = fx::mg_per_digit(c.range_g);
+  uint32_t rng = 0x9E3779B9u ^ ((uint32_t)c.signal << 8) ^ c.fs_hz;
+  const int32_t drive = c.signal == CLIPPED ? 9000 : 1;   // mg per harmonic-1 amplitude unit
+  Osc f1(24700, c.fs_hz, 0), f2(49400, c.fs_hz, 0x40000000u), f3(74100, c.fs_hz, 0x10000000u);
+  Osc g1(24700, c.fs_hz, 0x40000000u);
+  Osc ring(310000, c.fs_hz, 0);
+  const uint32_t imp_period = (uint32_t)c.fs_hz * 10u / 371u;   // 37.1 Hz
+  int32_t ring_amp = 0;
+
+  for (uint32_t i = 0; i < c.n; i++) {
+    int32_t mg[pipe::kAxes] = { 0, 0, 1000 };
+    for (size_t k = 0; k < pipe::kAxes; k++) mg[k] += noise_mg(rng, c.signal == QUIET ? 15 : 40);
+    if (c.signal == MACHINE || c.signal == CLIPPED) {
+      const int32_t a = c.signal == CLIPPED ? drive : 1500;
+      const int32_t s1 = f1.next(), s2 = f2.next(), s3 = f3.next(), c1 = g1.next();
+      mg[0] += (int32_t)(((int64_t)a * s1 + (int64_t)a / 3 * s2 + (int64_t)a / 5 * s3) >> 15);
+      mg[1] += (int32_t)(((int64_t)a * c1 + (int64_t)a / 4 * s2) >> 15);
+      mg[2] += (int32_t)(((int64_t)a / 6 * s1) >> 15);
+    } else if (c.signal == BEARING) {
+      if (imp_period && i % imp_period == 0) ring_amp = 4000;
+      const int32_t r = (int32_t)(((int64_t)ring_amp * ring.next()) >> 15);
+      ring_amp = (int32_t)(((int64_t)ring_amp * 31130) >> 15);   // ~0.95 per sample
+      mg[0] += r;
+      mg[1] += r / 2;
+      mg[2] += r / 3;
+    }
+    for (size_t k = 0; k < pipe::kAxes; k++) {
+      int32_t d = mg[k] >= 0 ? (mg[k] + so / 2) / so : -((-mg[k] + so / 2) / so);
+      if (d > 2047) d = 2047;
+      if (d < -2048) d = -2048;
+      axis[k][i] = fx::raw_to_mg((int16_t)(d * 16), so);
+    }
+  }
+}
+
+// -------------------------
+// Stage lists
+// -------------------------
+// "hpf fc_hz=2 order=4; rms" -> specs. false on a malformed list.
+inline bool parse_stages(const char* text, pipe::StageSpec* specs, size_t max, size_t& n) {
+  n = 0;
+  const char* p = text;
+  while (*p) {
+    while (*p == ' ' || *p == ';') p++;
+    if (!*p) break;
+    if (n >= max) return false;
+    pipe::StageSpec& sp = specs[n++];
+    sp = pipe::StageSpec();
+    bool first = true;
+    while (*p && *p != ';') {
+      while (*p == ' ') p++;
+      char tok[32];
+      size_t l = 0;
+      while (*p && *p != ' ' && *p != ';') {
+        if (l + 1 >= sizeof(tok)) return false;
+        tok[l++] = *p++;
+      }
+      tok[l] = '\0';
+      if (!l) continue;
+      if (first) {
+        char type[sizeof(sp.type)];
+        if (l >= sizeof(type)) return false;
+        memcpy(type, tok, l + 1);
+        sp.setType(type);
+        first = false;
+        continue;
+      }
+      const char* eq = strchr(tok, '=');
+      char key[sizeof(sp.params[0].key)], val[sizeof(sp.params[0].str)];
+      if (!eq || eq == tok || (size_t)(eq - tok) >= sizeof(key) || strlen(eq + 1) >= sizeof(val)) return false;
+      memcpy(key, tok, (size_t)(eq - tok));
+      key[eq - tok] = '\0';
+      strcpy(val, eq + 1);
+      char* end = nullptr;
+      const float v = strtof(val, &end);
+      const bool ok = (end != val && *end == '\0') ? sp.addNum(key, v) : sp.addStr(key, val);
+      if (!ok) return false;
+    }
+    if (first) return false;
+  }
+  return n > 0;
+}
+
+// -------------------------
+// Running a case
+// -------------------------
+inline uint64_t fnv64(const void* p, size_t n, uint64_t h = 1469598103934665603ULL) {
+  const uint8_t* b = (const uint8_t*)p;
+  for (size_t i = 0; i < n; i++) { h ^= b[i]; h *= 1099511628211ULL; }
+  return h;
+}
+
+// Buffers for one case of up to n samples (allocated once, reused)
+struct Scratch {
+  int16_t* axis[pipe::kAxes] = { nullptr, nullptr, nullptr };
+  int32_t* work = nullptr;
+  uint8_t* out[pipe::kAxes] = { nullptr, nullptr, nullptr };
+  size_t n = 0;
+
+  bool reserve(size_t samples) {
+    if (samples <= n) return true;
+    release();
+    for (size_t k = 0; k < pipe::kAxes; k++) {
+      axis[k] = new int16_t[samples];
+      out[k] = new uint8_t[2 * samples];
+    }
+    work = new int32_t[samples];
+    n = samples;
+    return true;
+  }
+  void release() {
+    for (size_t k = 0; k < pipe::kAxes; k++) { delete[] axis[k]; delete[] out[k]; axis[k] = nullptr; out[k] = nullptr; }
+    delete[] work;
+    work = nullptr;
+    n = 0;
+  }
+  ~Scratch() { release(); }
+};
+
+// Runs case c on the given (already built) pipeline. The frame is left with
+// the results; its buffers point into s.
+inline void run(const Case& c, pipe::Pipeline& p, Scratch& s, pipe::Frame& f) {
+  s.reserve(c.n);
+  make_signal(c, s.axis);
+  f = pipe::Frame();
+  for (size_t k = 0; k < pipe::kAxes; k++) {
+    f.axis[k] = s.axis[k];
+    f.out[k].data = s.out[k];
+    f.out[k].cap = 2 * (size_t)c.n;
+  }
+  f.n = c.n;
+  f.fs_hz = c.fs_hz;
+  f.range_g = c.range_g;
+  f.work = s.work;
+  p.run(f);
+}
+
+inline bool build(const Case& c, pipe::Pipeline& p, char* err, size_t err_len) {
+  pipe::StageSpec specs[pipe::kMaxStages];
+  size_t n = 0;
+  if (!parse_stages(c.stages, specs, pipe::kMaxStages, n)) {
+    snprintf(err, err_len, "bad stage list");
+    return false;
+  }
+  return p.build(specs, n, nullptr, err, err_len);
+}
+
+// The golden line of a finished frame
+inline int format(const Case& c, const pipe::Frame& f, char* out, size_t len) {
+  uint32_t rms_bits;
+  memcpy(&rms_bits, &f.feat.mag_rms_mps2, 4);
+  uint64_t axes = 1469598103934665603ULL;
+  for (size_t k = 0; k < pipe::kAxes; k++) axes = fnv64(f.axis[k], (size_t)f.n * 2, axes);
+  uint64_t h[pipe::kAxes];
+  for (size_t k = 0; k < pipe::kAxes; k++) h[k] = fnv64(f.out[k].data, f.out[k].len);
+  return snprintf(out, len,
+                  "%s sum_sq=%lld rms=%08lx peak=%ld,%ld,%ld clip=%lu fsat=%lu gate=%d stop=%s clamps=%lu"
+                  " axes=%016llx x=%u:%016llx y=%u:%016llx z=%u:%016llx"
+                  " | speed~%.4f conf~%.4f kurt_lo~%.2f kurt_hi~%.2f kurt~%.4f kurt_axis~%u",
+                  c.name, (long long)f.feat.sum_sq_mg2, (unsigned long)rms_bits,
+                  (long)f.feat.peak_mg[0], (long)f.feat.peak_mg[1], (long)f.feat.peak_mg[2],
+                  (unsigned long)f.feat.clip, (unsigned long)f.filt_sat, f.gate_pass ? 1 : 0,
+                  f.stopped_by ? f.stopped_by : "-", (unsigned long)f.codec_clamps,
+                  (unsigned long long)axes,
+                  (unsigned)f.out[0].len, (unsigned long long)h[0],
+                  (unsigned)f.out[1].len, (unsigned long long)h[1],
+                  (unsigned)f.out[2].len, (unsigned long long)h[2],
+                  (double)f.feat.speed_hz, (double)f.feat.speed_conf,
+                  (double)f.feat.kurt_f_lo_hz, (double)f.feat.kurt_f_hi_hz, (double)f.feat.kurt,
+                  (unsigned)f.feat.kurt_axis);
+}
+
+} // namespace golden
+} // namespace vib
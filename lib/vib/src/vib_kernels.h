@@ -0,0 +1,330 @@
+// vib_kernels.h
+// Portable DSP kernels shared by the firmware and the host tools (header-only).
+//
+// vib::ref::*  scalar reference implementation. It defines the semantics and
+//              is always compiled, on target and on host.
+// vib::*       best available variant for the build:
+//                - ESP32 / ESP32-S3: esp-dsp (uses the S3 PIE/AE32 assembly
+//                  kernels shipped with the framework) when esp_dsp.h exists
+//                - host x86: AVX (float) / SSE2 (int16) intrinsics
+//                - anything else: the reference
+//
+// Equivalence contract (checked on host by tools/vib_bench.cpp):
+//   - element-wise kernels (i16_to_f32, mul_f32) are bit-exact
+//   - integer reductions (sum_sq_i16) are exact
+//   - float reductions (sum_sq_f32, dot_f32) differ only by summation order
+//   - biquad_cascade_f32 uses the esp-dsp DF-II form; IIR recursion is serial,
+//     so on host the reference is the fast path
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+#if defined(ESP_PLATFORM) && defined(__has_include)
+#  if __has_include(<esp_dsp.h>)
+#    include <esp_dsp.h>
+#    define VIB_HAVE_ESP_DSP 1
+#  endif
+#endif
+
+#if !defined(VIB_HAVE_ESP_DSP) && (defined(__SSE2__) || defined(_M_X64))
+#  include <immintrin.h>
+#  define VIB_HAVE_SSE2 1
+#  if defined(__AVX__)
+#    define VIB_HAVE_AVX 1
+#  endif
+#endif
+
+namespace vib {
+
+// Biquad section, esp-dsp coefficient order: b0, b1, b2, a1, a2 (a0 == 1).
+struct Biquad {
+  float b0, b1, b2, a1, a2;
+};
+
+// -------------------------
+// Scalar reference
+// -------------------------
+namespace ref {
+
+// out[i] = in[i] * scale
+inline void i16_to_f32(const int16_t* in, float* out, size_t n, float scale) {
+  for (size_t i = 0; i < n; i++) out[i] = (float)in[i] * scale;
+}
+
+// Exact: |x| <= 32768 so x^2 <= 2^30 and int64 cannot overflow for any
+// realistic n (< 2^33 samples).
+inline int64_t sum_sq_i16(const int16_t* x, size_t n) {
+  int64_t acc = 0;
+  for (size_t i = 0; i < n; i++) acc += (int32_t)x[i] * (int32_t)x[i];
+  return acc;
+}
+
+inline float sum_sq_f32(const float* x, size_t n) {
+  float acc = 0.0f;
+  for (size_t i = 0; i < n; i++) acc += x[i] * x[i];
+  return acc;
+}
+
+inline float dot_f32(const float* a, const float* b, size_t n) {
+  float acc = 0.0f;
+  for (size_t i = 0; i < n; i++) acc += a[i] * b[i];
+  return acc;
+}
+
+// out[i] = x[i] * w[i]   (windowing; out may alias x)
+inline void mul_f32(const float* x, const float* w, float* out, size_t n) {
+  for (size_t i = 0; i < n; i++) out[i] = x[i] * w[i];
+}
+
+// Cascade of DF-II sections. state holds 2 floats per section and carries
+// across calls (block processing). out may alias in.
+inline void biquad_cascade_f32(const float* in, float* out, size_t n,
+                               const Biquad* sec, float* state, size_t n_sec) {
+  const float* src = in;
+  for (size_t s = 0; s < n_sec; s++) {
+    const Biquad& c = sec[s];
+    float* w = &state[2 * s];
+    for (size_t i = 0; i < n; i++) {
+      const float d0 = src[i] - c.a1 * w[0] - c.a2 * w[1];
+      out[i] = c.b0 * d0 + c.b1 * w[0] + c.b2 * w[1];
+      w[1] = w[0];
+      w[0] = d0;
+    }
+    src = out;
+  }
+  if (n_sec == 0 && out != in) {
+    for (size_t i = 0; i < n; i++) out[i] = in[i];
+  }
+}
+
+} // namespace ref
+
+// -------------------------
+// Window / filter design (setup-time, scalar everywhere)
+// -------------------------
+inline void window_hann(float* w, size_t n) {
+  if (n < 2) { if (n) w[0] = 1.0f; return; }
+  const double k = 2.0 * M_PI / (double)(n - 1);
+  for (size_t i = 0; i < n; i++) w[i] = (float)(0.5 - 0.5 * cos(k * (double)i));
+}
+
+// RBJ cookbook designs, fc and fs in Hz
+inline Biquad biquad_lowpass(float fc, float fs, float q = 0.70710678f) {
+  const double w0 = 2.0 * M_PI * (double)fc / (double)fs;
+  const double al = sin(w0) / (2.0 * (double)q);
+  const double cw = cos(w0);
+  const double a0 = 1.0 + al;
+  Biquad b;
+  b.b0 = (float)(((1.0 - cw) / 2.0) / a0);
+  b.b1 = (float)((1.0 - cw) / a0);
+  b.b2 = b.b0;
+  b.a1 = (float)((-2.0 * cw) / a0);
+  b.a2 = (float)((1.0 - al) / a0);
+  return b;
+}
+
+inline Biquad biquad_highpass(float fc, float fs, float q = 0.70710678f) {
+  const double w0 = 2.0 * M_PI * (double)fc / (double)fs;
+  const double al = sin(w0) / (2.0 * (double)q);
+  const double cw = cos(w0);
+  const double a0 = 1.0 + al;
+  Biquad b;
+  b.b0 = (float)(((1.0 + cw) / 2.0) / a0);
+  b.b1 = (float)(-(1.0 + cw) / a0);
+  b.b2 = b.b0;
+  b.a1 = (float)((-2.0 * cw) / a0);
+  b.a2 = (float)((1.0 - al) / a0);
+  return b;
+}
+
+// First-order (bilinear) sections as biquads with b2 = a2 = 0: the real
+// pole of an odd-order Butterworth
+inline Biquad biquad_lowpass1(float fc, float fs) {
+  const double k = tan(M_PI * (double)fc / (double)fs);
+  Biquad b;
+  b.b0 = (float)(k / (1.0 + k));
+  b.b1 = b.b0;
+  b.b2 = 0.0f;
+  b.a1 = (float)((k - 1.0) / (k + 1.0));
+  b.a2 = 0.0f;
+  return b;
+}
+
+inline Biquad biquad_highpass1(float fc, float fs) {
+  const double k = tan(M_PI * (double)fc / (double)fs);
+  Biquad b;
+  b.b0 = (float)(1.0 / (1.0 + k));
+  b.b1 = -b.b0;
+  b.b2 = 0.0f;
+  b.a1 = (float)((k - 1.0) / (k + 1.0));
+  b.a2 = 0.0f;
+  return b;
+}
+
+// Q of biquad k (0-based) of an order-n Butterworth, 1 / (2 sin((2k+1) pi / 2n))
+inline float butterworth_q(int n, int k) {
+  return (float)(1.0 / (2.0 * sin((double)(2 * k + 1) * M_PI / (2.0 * (double)n))));
+}
+
+// Constant 0 dB peak gain band-pass
+inline Biquad biquad_bandpass(float fc, float fs, float q) {
+  const double w0 = 2.0 * M_PI * (double)fc / (double)fs;
+  const double al = sin(w0) / (2.0 * (double)q);
+  const double cw = cos(w0);
+  const double a0 = 1.0 + al;
+  Biquad b;
+  b.b0 = (float)(al / a0);
+  b.b1 = 0.0f;
+  b.b2 = (float)(-al / a0);
+  b.a1 = (float)((-2.0 * cw) / a0);
+  b.a2 = (float)((1.0 - al) / a0);
+  return b;
+}
+
+// -------------------------
+// Dispatched variants
+// -------------------------
+#if defined(VIB_HAVE_ESP_DSP)
+
+inline const char* kernel_impl() { return "esp-dsp"; }
+
+inline void i16_to_f32(const int16_t* in, float* out, size_t n, float scale) {
+  ref::i16_to_f32(in, out, n, scale);
+}
+
+inline int64_t sum_sq_i16(const int16_t* x, size_t n) {
+  // Single-cycle MAC on Xtensa; esp-dsp only offers saturating Q15 here.
+  return ref::sum_sq_i16(x, n);
+}
+
+inline float sum_sq_f32(const float* x, size_t n) {
+  float r = 0.0f;
+  dsps_dotprod_f32(x, x, &r, (int)n);
+  return r;
+}
+
+inline float dot_f32(const float* a, const float* b, size_t n) {
+  float r = 0.0f;
+  dsps_dotprod_f32(a, b, &r, (int)n);
+  return r;
+}
+
+inline void mul_f32(const float* x, const float* w, float* out, size_t n) {
+  dsps_mul_f32(x, w, out, (int)n, 1, 1, 1);
+}
+
+inline void biquad_cascade_f32(const float* in, float* out, size_t n,
+                               const Biquad* sec, float* state, size_t n_sec) {
+  if (n_sec == 0) { ref::biquad_cascade_f32(in, out, n, sec, state, 0); return; }
+  const float* src = in;
+  for (size_t s = 0; s < n_sec; s++) {
+    // Biquad is five packed floats in esp-dsp coefficient order
+    dsps_biquad_f32(src, out, (int)n, (float*)&sec[s], &state[2 * s]);
+    src = out;
+  }
+}
+
+#elif defined(VIB_HAVE_SSE2)
+
+#  if defined(VIB_HAVE_AVX)
+inline const char* kernel_impl() { return "avx"; }
+#  else
+inline const char* kernel_impl() { return "sse2"; }
+#  endif
+
+inline void i16_to_f32(const int16_t* in, float* out, size_t n, float scale) {
+  const __m128 vs = _mm_set1_ps(scale);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)&in[i]);
+    // sign-extend int16 -> int32 (SSE2: unpack into the high half, then shift)
+    const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    _mm_storeu_ps(&out[i],     _mm_mul_ps(_mm_cvtepi32_ps(lo), vs));
+    _mm_storeu_ps(&out[i + 4], _mm_mul_ps(_mm_cvtepi32_ps(hi), vs));
+  }
+  for (; i < n; i++) out[i] = (float)in[i] * scale;
+}
+
+inline int64_t sum_sq_i16(const int16_t* x, size_t n) {
+  // madd gives a0^2 + a1^2 <= 2^31 per lane: fits uint32, so zero-extend.
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;  // 2 x u64
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)&x[i]);
+    const __m128i p = _mm_madd_epi16(v, v);
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(p, zero));
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(p, zero));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128((__m128i*)lanes, acc);
+  int64_t r = (int64_t)(lanes[0] + lanes[1]);
+  for (; i < n; i++) r += (int32_t)x[i] * (int32_t)x[i];
+  return r;
+}
+
+inline float dot_f32(const float* a, const float* b, size_t n) {
+  size_t i = 0;
+  float r = 0.0f;
+#  if defined(VIB_HAVE_AVX)
+  __m256 acc8 = _mm256_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    acc8 = _mm256_add_ps(acc8, _mm256_mul_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i])));
+  }
+  __m128 acc = _mm_add_ps(_mm256_castps256_ps128(acc8), _mm256_extractf128_ps(acc8, 1));
+#  else
+  __m128 acc = _mm_setzero_ps();
+#  endif
+  for (; i + 4 <= n; i += 4) {
+    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(&a[i]), _mm_loadu_ps(&b[i])));
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, acc);
+  r = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  for (; i < n; i++) r += a[i] * b[i];
+  return r;
+}
+
+inline float sum_sq_f32(const float* x, size_t n) {
+  return dot_f32(x, x, n);
+}
+
+inline void mul_f32(const float* x, const float* w, float* out, size_t n) {
+  size_t i = 0;
+#  if defined(VIB_HAVE_AVX)
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_loadu_ps(&x[i]), _mm256_loadu_ps(&w[i])));
+  }
+#  endif
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(&out[i], _mm_mul_ps(_mm_loadu_ps(&x[i]), _mm_loadu_ps(&w[i])));
+  }
+  for (; i < n; i++) out[i] = x[i] * w[i];
+}
+
+inline void biquad_cascade_f32(const float* in, float* out, size_t n,
+                               const Biquad* sec, float* state, size_t n_sec) {
+  ref::biquad_cascade_f32(in, out, n, sec, state, n_sec);
+}
+
+#else
+
+inline const char* kernel_impl() { return "ref"; }
+
+inline void i16_to_f32(const int16_t* in, float* out, size_t n, float scale) { ref::i16_to_f32(in, out, n, scale); }
+inline int64_t sum_sq_i16(const int16_t* x, size_t n) { return ref::sum_sq_i16(x, n); }
+inline float sum_sq_f32(const float* x, size_t n) { return ref::sum_sq_f32(x, n); }
+inline float dot_f32(const float* a, const float* b, size_t n) { return ref::dot_f32(a, b, n); }
+inline void mul_f32(const float* x, const float* w, float* out, size_t n) { ref::mul_f32(x, w, out, n); }
+inline void biquad_cascade_f32(const float* in, float* out, size_t n,
+                               const Biquad* sec, float* state, size_t n_sec) {
+  ref::biquad_cascade_f32(in, out, n, sec, state, n_sec);
+}
+
+#endif
+
+} // namespace vib
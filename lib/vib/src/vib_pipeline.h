@@ -0,0 +1,643 @@
+// vib_pipeline.h
+// Composable processing pipeline: source -> filters -> features -> gate ->
+// encoder -> sink.
+//
+// The source (acquisition) fills a Frame with pointers to the capture buffers.
+// Every stage works on those buffers in place; no stage copies sample data.
+// Stages are described by StageSpec (type + a few named params), which the
+// firmware parses from the "pipeline" section of config.json, so this header
+// has no JSON dependency. Types the library does not know (e.g. the MQTT sink)
+// are created through a caller-supplied factory.
+//
+// Dispatch is one virtual call per stage per capture; per-sample loops stay
+// inside the stages.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "vib_kernels.h"
+#include "vib_fixed.h"
+#include "vib_codec.h"
+#include "vib_spectrum.h"
+#include "vib_cov.h"
+#include "vib_timing.h"
+
+namespace vib {
+namespace pipe {
+
+static constexpr size_t kMaxStages = 12;
+static constexpr size_t kMaxParams = 4;
+static constexpr size_t kMaxSections = 4;
+static constexpr size_t kAxes = 3;
+
+enum Kind : uint8_t {
+  FILTER = 0,
+  FEATURE = 1,
+  GATE = 2,
+  ENCODER = 3,
+  SINK = 4,
+};
+
+enum FeatureBits : uint8_t {
+  FEAT_RMS = 1 << 0,
+  FEAT_PEAK = 1 << 1,
+  FEAT_SPEED = 1 << 2,
+  FEAT_KURT = 1 << 3,
+};
+
+struct Features {
+  uint8_t valid = 0;             // FeatureBits
+  int64_t sum_sq_mg2 = 0;        // sum over samples and axes of a^2, mg^2
+  float mag_rms_mps2 = 0.0f;     // sqrt(sum_sq / n), m/s^2
+  int32_t peak_mg[kAxes] = {0, 0, 0};
+  uint32_t clip = 0;             // samples at the sensor full scale
+  float speed_hz = 0.0f;         // running speed from the spectrum (tachless)
+  float speed_conf = 0.0f;       // 0..1
+  float kurt_f_lo_hz = 0.0f;     // kurtogram: band with the highest spectral kurtosis
+  float kurt_f_hi_hz = 0.0f;
+  float kurt = 0.0f;
+  uint8_t kurt_axis = 0;
+};
+
+struct Blob {
+  uint8_t* data = nullptr;
+  size_t cap = 0;
+  size_t len = 0;
+};
+
+// One capture flowing through the pipeline.
+struct Frame {
+  // Source (shared buffers, modified in place by filters)
+  int16_t* axis[kAxes] = {nullptr, nullptr, nullptr};   // mg, length n
+  const uint16_t* dt_us = nullptr;                      // length n-1
+  uint32_t n = 0;
+  uint16_t fs_hz = 0;
+  uint8_t range_g = 24;
+  uint64_t t0_epoch_us = 0;
+  uint32_t t0_err_us = 0;        // bound on t0_epoch_us (clock model)
+  int32_t* work = nullptr;       // n int32 scratch (fixed-point filters)
+  Pca3 pca;                      // principal direction of the raw samples (acquisition)
+  Timing timing;                 // sampling timing quality (acquisition)
+
+  // Stage results
+  Features feat;
+  uint32_t filt_sat = 0;
+  bool gate_pass = true;
+  const char* stopped_by = nullptr;   // type of the stage that stopped the run
+
+  codec::Codec codec = codec::RAW16;
+  uint8_t q_mult = 1;            // quantization step of the 12-bit codecs, in So
+  uint32_t codec_clamps = 0;
+  Blob out[kAxes];               // encoded axes (caller-provided storage)
+
+  int32_t so_mg() const { return fx::mg_per_digit(range_g) * q_mult; }
+};
+
+// -------------------------
+// Stage description
+// -------------------------
+struct StageSpec {
+  struct Param {
+    char key[12];
+    char str[12];
+    float num;
+    bool is_str;
+  };
+
+  char type[12] = {0};
+  Param params[kMaxParams];
+  uint8_t n_params = 0;
+
+  void setType(const char* t) {
+    snprintf(type, sizeof(type), "%s", t ? t : "");
+  }
+
+  bool addNum(const char* key, float v) {
+    if (n_params >= kMaxParams) return false;
+    Param& p = params[n_params++];
+    snprintf(p.key, sizeof(p.key), "%s", key);
+    p.str[0] = '\0';
+    p.num = v;
+    p.is_str = false;
+    return true;
+  }
+
+  bool addStr(const char* key, const char* v) {
+    if (n_params >= kMaxParams) return false;
+    Param& p = params[n_params++];
+    snprintf(p.key, sizeof(p.key), "%s", key);
+    snprintf(p.str, sizeof(p.str), "%s", v ? v : "");
+    p.num = 0.0f;
+    p.is_str = true;
+    return true;
+  }
+
+  const Param* find(const char* key) const {
+    for (uint8_t i = 0; i < n_params; i++) {
+      if (!strcmp(params[i].key, key)) return &params[i];
+    }
+    return nullptr;
+  }
+
+  bool has(const char* key) const { return find(key) != nullptr; }
+
+  float num(const char* key, float def) const {
+    const Param* p = find(key);
+    return (p && !p->is_str) ? p->num : def;
+  }
+
+  const char* str(const char* key, const char* def) const {
+    const Param* p = find(key);
+    return (p && p->is_str) ? p->str : def;
+  }
+};
+
+class Stage {
+public:
+  virtual ~Stage() {}
+  virtual Kind kind() const = 0;
+  virtual const char* type() const = 0;
+  // Feature bits this stage produces / requires
+  virtual uint8_t provides() const { return 0; }
+  virtual uint8_t needs() const { return 0; }
+  // false stops the pipeline for this capture (gate closed, sink failure)
+  virtual bool run(Frame& f) = 0;
+};
+
+typedef Stage* (*StageFactory)(const StageSpec& spec);
+
+// -------------------------
+// Built-in stages
+// -------------------------
+
+// Designs an order-n Butterworth hpf/lpf into sec[] and returns the number
+// of sections: n/2 biquads with the Butterworth Qs, then a first-order
+// section for odd n. q overrides the Q of a single biquad (n == 2). fc is
+// clamped to (0.01 Hz, 0.95 Nyquist).
+inline uint8_t design_butterworth(bool highpass, float fc, uint16_t fs_hz, int order, float q,
+                                  fx::BiquadQ30* sec) {
+  const float nyq = 0.5f * (float)fs_hz;
+  if (fc > 0.95f * nyq) fc = 0.95f * nyq;
+  if (fc < 0.01f) fc = 0.01f;
+  if (order < 1) order = 1;
+  if (order > 2 * (int)kMaxSections) order = 2 * (int)kMaxSections;
+  const float fs = (float)fs_hz;
+  uint8_t n = 0;
+  for (int k = 0; k < order / 2; k++) {
+    const float qk = (order == 2) ? q : butterworth_q(order, k);
+    sec[n++] = fx::toQ30(highpass ? biquad_highpass(fc, fs, qk) : biquad_lowpass(fc, fs, qk));
+  }
+  if (order & 1) sec[n++] = fx::toQ30(highpass ? biquad_highpass1(fc, fs) : biquad_lowpass1(fc, fs));
+  return n;
+}
+
+// hpf / lpf (Butterworth, order 1..8 -> 1..4 sections) and bpf (one
+// section). Fixed-point, in place on every axis. The state starts in
+// steady state for the first sample, so a capture does not begin with a step.
+class BiquadStage : public Stage {
+public:
+  enum Shape : uint8_t { HPF, LPF, BPF };
+
+  // order is ignored for BPF
+  BiquadStage(Shape shape, float fc_hz, float q, int order)
+    : shape_(shape), fc_hz_(fc_hz), q_(q), order_(order) {}
+
+  Kind kind() const override { return FILTER; }
+  const char* type() const override {
+    return shape_ == HPF ? "hpf" : shape_ == LPF ? "lpf" : "bpf";
+  }
+
+  bool run(Frame& f) override {
+    if (!f.work || f.n == 0 || f.fs_hz == 0) return true;
+    if (f.fs_hz != designed_fs_) design(f.fs_hz);
+    for (size_t k = 0; k < kAxes; k++) {
+      fx::BiquadStateQ st[kMaxSections];
+      fx::biquad_cascade_prime_q15(sec_, st, sections_, f.axis[k][0]);
+      f.filt_sat += fx::biquad_cascade_q15(f.axis[k], f.axis[k], f.n, sec_, st, sections_, f.work);
+    }
+    return true;
+  }
+
+private:
+  void design(uint16_t fs_hz) {
+    if (shape_ == BPF) {
+      float fc = fc_hz_;
+      const float nyq = 0.5f * (float)fs_hz;
+      if (fc > 0.95f * nyq) fc = 0.95f * nyq;
+      if (fc < 0.01f) fc = 0.01f;
+      sec_[0] = fx::toQ30(biquad_bandpass(fc, (float)fs_hz, q_));
+      sections_ = 1;
+    } else {
+      sections_ = design_butterworth(shape_ == HPF, fc_hz_, fs_hz, order_, q_, sec_);
+    }
+    designed_fs_ = fs_hz;
+  }
+
+  Shape shape_;
+  float fc_hz_;
+  float q_;
+  int order_;
+  uint8_t sections_ = 0;
+  uint16_t designed_fs_ = 0;
+  fx::BiquadQ30 sec_[kMaxSections];
+};
+
+// Removes the per-axis mean (integer, rounded)
+class DemeanStage : public Stage {
+public:
+  Kind kind() const override { return FILTER; }
+  const char* type() const override { return "demean"; }
+  bool run(Frame& f) override {
+    if (f.n == 0) return true;
+    for (size_t k = 0; k < kAxes; k++) {
+      int64_t sum = 0;
+      for (uint32_t i = 0; i < f.n; i++) sum += f.axis[k][i];
+      const int64_t half = (int64_t)f.n / 2;
+      const int32_t mean = (int32_t)((sum >= 0 ? sum + half : sum - half) / (int64_t)f.n);
+      for (uint32_t i = 0; i < f.n; i++) {
+        uint32_t sat = 0;
+        f.axis[k][i] = fx::sat16((int32_t)f.axis[k][i] - mean, sat);
+        f.filt_sat += sat;
+      }
+    }
+    return true;
+  }
+};
+
+class RmsStage : public Stage {
+public:
+  Kind kind() const override { return FEATURE; }
+  const char* type() const override { return "rms"; }
+  uint8_t provides() const override { return FEAT_RMS; }
+  bool run(Frame& f) override {
+    if (f.n == 0) return true;
+    int64_t s = 0;
+    for (size_t k = 0; k < kAxes; k++) s += sum_sq_i16(f.axis[k], f.n);
+    f.feat.sum_sq_mg2 = s;
+    f.feat.mag_rms_mps2 = (float)(sqrt((double)s / (double)f.n) * (fx::kG0 / 1000.0));
+    f.feat.valid |= FEAT_RMS;
+    return true;
+  }
+};
+
+class PeakStage : public Stage {
+public:
+  Kind kind() const override { return FEATURE; }
+  const char* type() const override { return "peak"; }
+  uint8_t provides() const override { return FEAT_PEAK; }
+  bool run(Frame& f) override {
+    const int32_t clip_mg = fx::max_abs_mg(f.range_g);
+    f.feat.clip = 0;
+    for (size_t k = 0; k < kAxes; k++) {
+      int32_t peak = 0;
+      for (uint32_t i = 0; i < f.n; i++) {
+        const int32_t a = f.axis[k][i] < 0 ? -(int32_t)f.axis[k][i] : (int32_t)f.axis[k][i];
+        if (a > peak) peak = a;
+        if (a >= clip_mg) f.feat.clip++;
+      }
+      f.feat.peak_mg[k] = peak;
+    }
+    f.feat.valid |= FEAT_PEAK;
+    return true;
+  }
+};
+
+// Tachless running speed: harmonic product spectrum of the 3-axis power
+// spectrum (vib_spectrum.h), searched between rpm_min and rpm_max. Uses the
+// first nfft samples (largest power of two <= n, capped by the nfft param);
+// buffers are allocated on the first capture and kept.
+class SpeedStage : public Stage {
+public:
+  SpeedStage(float rpm_min, float rpm_max, uint8_t harmonics, size_t nfft_max)
+    : fmin_(rpm_min / 60.0f), fmax_(rpm_max / 60.0f), harm_(harmonics), nfft_max_(nfft_max) {}
+  ~SpeedStage() override { release(); }
+
+  Kind kind() const override { return FEATURE; }
+  const char* type() const override { return "speed"; }
+  uint8_t provides() const override { return FEAT_SPEED; }
+
+  bool run(Frame& f) override {
+    size_t nfft = spec::floor_pow2(f.n);
+    if (nfft > nfft_max_) nfft = nfft_max_;
+    if (nfft < 16 || f.fs_hz == 0) return true;
+    if (nfft != nfft_) {
+      release();
+      win_ = new float[nfft];
+      cbuf_ = new float[2 * nfft];
+      psd_ = new float[nfft / 2 + 1];
+      window_hann(win_, nfft);
+      nfft_ = nfft;
+    }
+    const int16_t* const ax[kAxes] = { f.axis[0], f.axis[1], f.axis[2] };
+    spec::power_spectrum3(ax, nfft_, win_, cbuf_, psd_);
+    // cbuf_ is free again: use it as the estimator's scratch
+    const spec::SpeedEstimate e = spec::estimate_speed(psd_, nfft_ / 2 + 1, (float)f.fs_hz / (float)nfft_,
+                                                       fmin_, fmax_, harm_, cbuf_);
+    f.feat.speed_hz = e.hz;
+    f.feat.speed_conf = e.confidence;
+    f.feat.valid |= FEAT_SPEED;
+    return true;
+  }
+
+private:
+  void release() {
+    delete[] win_; delete[] cbuf_; delete[] psd_;
+    win_ = cbuf_ = psd_ = nullptr;
+    nfft_ = 0;
+  }
+
+  float fmin_, fmax_;
+  uint8_t harm_;
+  size_t nfft_max_;
+  size_t nfft_ = 0;
+  float* win_ = nullptr;
+  float* cbuf_ = nullptr;
+  float* psd_ = nullptr;
+};
+
+// Kurtogram: picks the demodulation band for envelope analysis as the STFT
+// bin with the highest spectral kurtosis over window lengths nw_min..nw_max
+// and all three axes (vib_spectrum.h). Scratch is allocated once for nw_max.
+class KurtogramStage : public Stage {
+public:
+  KurtogramStage(size_t nw_min, size_t nw_max, float fmin_hz)
+    : nw_min_(nw_min), nw_max_(nw_max), fmin_(fmin_hz) {
+    win_ = new float[nw_max];
+    cbuf_ = new float[2 * nw_max];
+    s2_ = new double[nw_max / 2 + 1];
+    s4_ = new double[nw_max / 2 + 1];
+    sk_ = new float[nw_max / 2 + 1];
+  }
+  ~KurtogramStage() override {
+    delete[] win_; delete[] cbuf_; delete[] s2_; delete[] s4_; delete[] sk_;
+  }
+
+  Kind kind() const override { return FEATURE; }
+  const char* type() const override { return "kurtogram"; }
+  uint8_t provides() const override { return FEAT_KURT; }
+
+  bool run(Frame& f) override {
+    if (f.fs_hz == 0) return true;
+    const int16_t* const ax[kAxes] = { f.axis[0], f.axis[1], f.axis[2] };
+    const spec::KurtBand b = spec::kurtogram(ax, kAxes, f.n, (float)f.fs_hz, nw_min_, nw_max_, fmin_,
+                                             win_, cbuf_, s2_, s4_, sk_);
+    if (b.nw == 0) return true;   // capture too short for nw_min
+    f.feat.kurt_f_lo_hz = b.f_lo_hz;
+    f.feat.kurt_f_hi_hz = b.f_hi_hz;
+    f.feat.kurt = b.kurtosis;
+    f.feat.kurt_axis = b.axis;
+    f.feat.valid |= FEAT_KURT;
+    return true;
+  }
+
+private:
+  size_t nw_min_, nw_max_;
+  float fmin_;
+  float* win_;
+  float* cbuf_;
+  double* s2_;
+  double* s4_;
+  float* sk_;
+};
+
+// Passes when min <= feature (< max, if max > 0). Thresholds in m/s^2.
+// mag_rms is compared in the integer sum-of-squares domain (bit-exact).
+class GateStage : public Stage {
+public:
+  enum Feature : uint8_t { MAG_RMS, PEAK };
+
+  GateStage(Feature feature, float min_mps2, float max_mps2)
+    : feature_(feature), min_(min_mps2), max_(max_mps2) {}
+
+  Kind kind() const override { return GATE; }
+  const char* type() const override { return "gate"; }
+  uint8_t needs() const override { return feature_ == MAG_RMS ? FEAT_RMS : FEAT_PEAK; }
+
+  bool run(Frame& f) override {
+    bool pass;
+    if (feature_ == MAG_RMS) {
+      if (f.n != cached_n_) {
+        thr_min_ = fx::gate_sum_sq_threshold(min_, 1.0f, f.n);
+        thr_max_ = (max_ > 0.0f) ? fx::gate_sum_sq_threshold(max_, 1.0f, f.n) : 0;
+        cached_n_ = f.n;
+      }
+      pass = fx::gate_pass(f.feat.sum_sq_mg2, thr_min_);
+      if (pass && max_ > 0.0f) pass = !fx::gate_pass(f.feat.sum_sq_mg2, thr_max_);
+    } else {
+      int32_t peak = 0;
+      for (size_t k = 0; k < kAxes; k++) if (f.feat.peak_mg[k] > peak) peak = f.feat.peak_mg[k];
+      const float peak_mps2 = (float)((double)peak * fx::kG0 / 1000.0);
+      pass = peak_mps2 >= min_ && (max_ <= 0.0f || peak_mps2 < max_);
+    }
+    f.gate_pass = f.gate_pass && pass;
+    return pass;
+  }
+
+  float minThreshold() const { return min_; }
+
+private:
+  Feature feature_;
+  float min_;
+  float max_;
+  uint32_t cached_n_ = 0;
+  uint64_t thr_min_ = 0;
+  uint64_t thr_max_ = 0;
+};
+
+class EncodeStage : public Stage {
+public:
+  explicit EncodeStage(codec::Codec c) : codec_(c) {}
+  Kind kind() const override { return ENCODER; }
+  const char* type() const override { return codec::name(codec_); }
+  bool run(Frame& f) override {
+    f.codec = codec_;
+    f.codec_clamps = 0;
+    const int32_t so = f.so_mg();
+    for (size_t k = 0; k < kAxes; k++) {
+      f.out[k].len = codec::encode(codec_, f.axis[k], f.n, so, f.out[k].data, f.out[k].cap, f.codec_clamps);
+      if (f.out[k].len == 0 && f.n > 0) return false;
+    }
+    return true;
+  }
+private:
+  codec::Codec codec_;
+};
+
+// Creates a built-in stage from its spec, nullptr if the type is unknown.
+// Sets *bad when the type is known but its params are invalid.
+inline Stage* makeBuiltin(const StageSpec& s, bool* bad) {
+  *bad = false;
+  const char* t = s.type;
+  if (!strcmp(t, "hpf") || !strcmp(t, "lpf") || !strcmp(t, "bpf")) {
+    const float fc = s.num("fc_hz", 0.0f);
+    if (fc <= 0.0f) { *bad = true; return nullptr; }
+    if (!strcmp(t, "bpf")) {
+      return new BiquadStage(BiquadStage::BPF, fc, s.num("q", 2.0f), 2);
+    }
+    return new BiquadStage(!strcmp(t, "hpf") ? BiquadStage::HPF : BiquadStage::LPF,
+                           fc, s.num("q", 0.70710678f), (int)s.num("order", 2.0f));
+  }
+  if (!strcmp(t, "demean")) return new DemeanStage();
+  if (!strcmp(t, "rms"))    return new RmsStage();
+  if (!strcmp(t, "peak"))   return new PeakStage();
+  if (!strcmp(t, "speed")) {
+    const float lo = s.num("rpm_min", 300.0f);
+    const float hi = s.num("rpm_max", 6000.0f);
+    const int harm = (int)s.num("harmonics", 4.0f);
+    const int nfft = (int)s.num("nfft", 2048.0f);
+    if (lo <= 0.0f || hi <= lo || harm < 1 || harm > 8 || nfft < 64 || nfft > 4096 ||
+        !spec::is_pow2((size_t)nfft)) {
+      *bad = true;
+      return nullptr;
+    }
+    return new SpeedStage(lo, hi, (uint8_t)harm, (size_t)nfft);
+  }
+  if (!strcmp(t, "kurtogram")) {
+    const int lo = (int)s.num("nw_min", 16.0f);
+    const int hi = (int)s.num("nw_max", 256.0f);
+    if (lo < 8 || hi > 1024 || lo > hi || !spec::is_pow2((size_t)lo) || !spec::is_pow2((size_t)hi)) {
+      *bad = true;
+      return nullptr;
+    }
+    return new KurtogramStage((size_t)lo, (size_t)hi, s.num("fmin_hz", 0.0f));
+  }
+  if (!strcmp(t, "gate")) {
+    const char* feat = s.str("feature", "mag_rms");
+    GateStage::Feature g;
+    if (!strcmp(feat, "mag_rms")) g = GateStage::MAG_RMS;
+    else if (!strcmp(feat, "peak")) g = GateStage::PEAK;
+    else { *bad = true; return nullptr; }
+    return new GateStage(g, s.num("min", 0.0f), s.num("max", 0.0f));
+  }
+  if (!strcmp(t, "encode")) {
+    codec::Codec c;
+    if (!codec::parse(s.str("codec", "raw16"), c)) { *bad = true; return nullptr; }
+    return new EncodeStage(c);
+  }
+  return nullptr;
+}
+
+// -------------------------
+// Pipeline
+// -------------------------
+class Pipeline {
+public:
+  Pipeline() {}
+  ~Pipeline() { clear(); }
+  Pipeline(const Pipeline&) = delete;
+  Pipeline& operator=(const Pipeline&) = delete;
+
+  void clear() {
+    for (size_t i = 0; i < n_; i++) delete stages_[i];
+    n_ = 0;
+  }
+
+  size_t size() const { return n_; }
+  Stage* stage(size_t i) const { return i < n_ ? stages_[i] : nullptr; }
+  // Effective specs, one per stage (including an inserted encoder)
+  const StageSpec* specs() const { return specs_; }
+
+  // Instantiates specs in order. Stage kinds must not go backwards
+  // (filter -> feature -> gate -> encoder -> sink) and a gate needs its
+  // feature from an earlier stage. A raw16 encoder is inserted before the
+  // first sink if none was given. On failure the pipeline is left empty.
+  bool build(const StageSpec* specs, size_t n, StageFactory ext, char* err, size_t err_len) {
+    clear();
+    uint8_t have = 0;
+    bool have_encoder = false;
+    Kind last = FILTER;
+
+    for (size_t i = 0; i < n; i++) {
+      bool bad = false;
+      Stage* st = makeBuiltin(specs[i], &bad);
+      if (!st && !bad && ext) st = ext(specs[i]);
+      if (!st) {
+        snprintf(err, err_len, "stage %u: %s '%s'", (unsigned)i,
+                 bad ? "bad params for" : "unknown type", specs[i].type);
+        clear();
+        return false;
+      }
+
+      if (st->kind() == SINK && !have_encoder) {
+        Stage* enc = new EncodeStage(codec::RAW16);
+        StageSpec enc_spec;
+        enc_spec.setType("encode");
+        enc_spec.addStr("codec", "raw16");
+        if (!push(enc, enc_spec, err, err_len)) { delete enc; delete st; return false; }
+        have_encoder = true;
+      }
+
+      if (st->kind() < last) {
+        snprintf(err, err_len, "stage %u: '%s' out of order", (unsigned)i, st->type());
+        delete st;
+        clear();
+        return false;
+      }
+      if ((st->needs() & have) != st->needs()) {
+        snprintf(err, err_len, "stage %u: '%s' needs a feature stage before it", (unsigned)i, st->type());
+        delete st;
+        clear();
+        return false;
+      }
+
+      last = st->kind();
+      have |= st->provides();
+      if (st->kind() == ENCODER) have_encoder = true;
+      if (!push(st, specs[i], err, err_len)) { delete st; return false; }
+    }
+    return true;
+  }
+
+  // Runs the stages in order from `first`; stops at the first one returning
+  // false. first > 0 continues a capture whose leading stages already ran
+  // (see vib_fused.h), so their results are kept.
+  bool run(Frame& f, size_t first = 0) {
+    if (first == 0) {
+      f.feat = Features();
+      f.gate_pass = true;
+      f.stopped_by = nullptr;
+      f.filt_sat = 0;
+    }
+    for (size_t i = first; i < n_; i++) {
+      if (!stages_[i]->run(f)) {
+        f.stopped_by = stages_[i]->type();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // "hpf>rms>gate>raw16>mqtt"
+  void describe(char* out, size_t len) const {
+    size_t o = 0;
+    if (len) out[0] = '\0';
+    for (size_t i = 0; i < n_ && o < len; i++) {
+      int w = snprintf(&out[o], len - o, "%s%s", i ? ">" : "", stages_[i]->type());
+      if (w < 0) break;
+      o += (size_t)w;
+    }
+  }
+
+private:
+  bool push(Stage* st, const StageSpec& spec, char* err, size_t err_len) {
+    if (n_ >= kMaxStages) {
+      snprintf(err, err_len, "too many stages (max %u)", (unsigned)kMaxStages);
+      clear();
+      return false;
+    }
+    specs_[n_] = spec;
+    stages_[n_++] = st;
+    return true;
+  }
+
+  Stage* stages_[kMaxStages] = {nullptr};
+  StageSpec specs_[kMaxStages];
+  size_t n_ = 0;
+};
+
+} // namespace pipe
+} // namespace vib
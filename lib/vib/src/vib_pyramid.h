@@ -0,0 +1,188 @@
+// vib_pyramid.h
+// Min/max/RMS overview pyramid of a capture, for zoomable plots that do not
+// read every raw sample.
+//
+// Level l summarizes bins of step = factor^(l+1) samples (sample i falls in
+// bin i / step). The blob is self-describing:
+//
+//   off  size  field
+//   0    4     magic "VPY1"
+//   4    2     factor (u16 le)
+//   6    1     levels
+//   7    1     reserved (0)
+//   8    4     n      samples covered (u32 le)
+//   12   8*L   per level: step (u32 le), bins (u32 le)
+//   ...        bins of level 0, then level 1, ... each 18 bytes:
+//              x min, x max (i16 le), x rms (u16 le), then y, then z
+//
+// Units are those of the samples (mg on the device). A bin with no samples
+// (a gap in a long recording) has min = 32767, max = -32768, rms = 0. The
+// finest levels are left out when the blob would not fit the given buffer.
+//
+// Builder is streaming: push() one sample at a time, in increasing index
+// order, so it can run while a long recording is written.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+namespace vib {
+namespace pyr {
+
+static constexpr size_t kMaxLevels = 6;
+static constexpr size_t kBinBytes = 18;
+static const uint8_t kMagic[4] = { 'V', 'P', 'Y', '1' };
+
+inline size_t header_bytes(size_t levels) { return 12 + 8 * levels; }
+
+class Builder {
+public:
+  // n: samples expected (upper bound), factor >= 2. Returns false if not even
+  // the coarsest level fits or n is too short for one level of 2 bins.
+  bool begin(uint32_t n, uint16_t factor, uint8_t* buf, size_t cap) {
+    buf_ = buf;
+    n_ = n;
+    factor_ = factor;
+    levels_ = 0;
+    seen_ = 0;
+    if (factor < 2 || !buf) return false;
+
+    // Candidate levels: at least 2 bins each
+    uint32_t steps[kMaxLevels];
+    size_t cand = 0;
+    uint64_t step = factor;
+    while (cand < kMaxLevels && step <= 0xFFFFFFFFULL && (n + step - 1) / step >= 2) {
+      steps[cand++] = (uint32_t)step;
+      step *= factor;
+    }
+    // Drop finest levels until everything fits
+    size_t first = 0;
+    for (; first < cand; first++) {
+      size_t bytes = header_bytes(cand - first);
+      for (size_t l = first; l < cand; l++) bytes += bins_for(steps[l]) * kBinBytes;
+      if (bytes <= cap) break;
+    }
+    if (first >= cand) return false;
+
+    size_t off = header_bytes(cand - first);
+    for (size_t l = first; l < cand; l++) {
+      Level& lv = lv_[levels_++];
+      lv.step = steps[l];
+      lv.cap_bins = bins_for(lv.step);
+      lv.off = off;
+      lv.bins = 0;
+      lv.bin = 0;
+      lv.clear();
+      off += lv.cap_bins * kBinBytes;
+    }
+    return true;
+  }
+
+  uint8_t levels() const { return levels_; }
+
+  // idx: sample index (gaps allowed, must increase)
+  inline void push(uint32_t idx, const int16_t xyz[3]) {
+    if (idx >= n_) return;
+    seen_ = idx + 1;
+    for (size_t l = 0; l < levels_; l++) {
+      Level& lv = lv_[l];
+      const uint32_t b = idx / lv.step;
+      if (b != lv.bin) {
+        flush(lv);
+        // empty bins for a gap
+        while (lv.bins < b && lv.bins < lv.cap_bins) writeBin(lv, true);
+        lv.bin = b;
+      }
+      lv.add(xyz);
+    }
+  }
+
+  // Flushes the last bins and compacts the levels. Returns the blob size
+  // (0 if begin() failed or no sample was pushed).
+  size_t finish() {
+    if (!levels_ || !seen_) return 0;
+    size_t off = header_bytes(levels_);
+    for (size_t l = 0; l < levels_; l++) {
+      Level& lv = lv_[l];
+      flush(lv);
+      const size_t len = lv.bins * kBinBytes;
+      if (lv.off != off) memmove(buf_ + off, buf_ + lv.off, len);
+      lv.off = off;
+      off += len;
+    }
+    memcpy(buf_, kMagic, 4);
+    put_u16(buf_ + 4, factor_);
+    buf_[6] = levels_;
+    buf_[7] = 0;
+    put_u32(buf_ + 8, seen_);
+    for (size_t l = 0; l < levels_; l++) {
+      put_u32(buf_ + 12 + 8 * l, lv_[l].step);
+      put_u32(buf_ + 16 + 8 * l, lv_[l].bins);
+    }
+    levels_ = 0;
+    return off;
+  }
+
+private:
+  struct Level {
+    uint32_t step;
+    uint32_t cap_bins;
+    size_t off;
+    uint32_t bins;     // bins written
+    uint32_t bin;      // index of the bin being accumulated
+    int16_t mn[3], mx[3];
+    int64_t ss[3];
+    uint32_t cnt;
+
+    void clear() {
+      for (int k = 0; k < 3; k++) { mn[k] = 32767; mx[k] = -32768; ss[k] = 0; }
+      cnt = 0;
+    }
+    inline void add(const int16_t v[3]) {
+      for (int k = 0; k < 3; k++) {
+        if (v[k] < mn[k]) mn[k] = v[k];
+        if (v[k] > mx[k]) mx[k] = v[k];
+        ss[k] += (int32_t)v[k] * v[k];
+      }
+      cnt++;
+    }
+  };
+
+  uint32_t bins_for(uint32_t step) const { return (n_ + step - 1) / step; }
+
+  void flush(Level& lv) {
+    if (lv.cnt && lv.bins < lv.cap_bins) writeBin(lv, false);
+    lv.clear();
+  }
+
+  void writeBin(Level& lv, bool empty) {
+    uint8_t* p = buf_ + lv.off + (size_t)lv.bins * kBinBytes;
+    for (int k = 0; k < 3; k++) {
+      uint32_t rms = 0;
+      if (!empty) {
+        rms = (uint32_t)lround(sqrt((double)lv.ss[k] / (double)lv.cnt));
+        if (rms > 65535) rms = 65535;
+      }
+      put_u16(p + 6 * k, (uint16_t)(empty ? 32767 : lv.mn[k]));
+      put_u16(p + 6 * k + 2, (uint16_t)(empty ? -32768 : lv.mx[k]));
+      put_u16(p + 6 * k + 4, (uint16_t)rms);
+    }
+    lv.bins++;
+  }
+
+  static void put_u16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+  static void put_u32(uint8_t* p, uint32_t v) { put_u16(p, (uint16_t)v); put_u16(p + 2, (uint16_t)(v >> 16)); }
+
+  Level lv_[kMaxLevels];
+  uint8_t* buf_ = nullptr;
+  uint32_t n_ = 0;
+  uint32_t seen_ = 0;
+  uint16_t factor_ = 10;
+  uint8_t levels_ = 0;
+};
+
+} // namespace pyr
+} // namespace vib
@@ -0,0 +1,166 @@
+// vib_rec.h
+// Block format of long recordings (written on device, decoded on host).
+//
+// A recording is a sequence of fixed-size blocks. Each block holds a run of
+// consecutive samples (no gaps inside a block):
+//
+//   off  size  field
+//   0    4     magic "VRB1"
+//   4    4     first_idx   sample index of the first sample (u32 le)
+//   8    4     t_us        monotonic time of the first sample since the
+//                          start of the recording, us (u32 le)
+//   12   2     n           samples in this block (u16 le)
+//   14   2     seq         block number within the recording (u16 le)
+//   16   ...   payload     n samples, x/y/z interleaved, as the raw12 codec
+//                          ("i12p_so"): 12-bit sensor digits, 4.5 B/sample
+//
+// Lost samples show up as index gaps between blocks; the nominal time of
+// sample i is i / fs.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vib_codec.h"
+
+namespace vib {
+namespace rec {
+
+static constexpr size_t kBlockBytes = 1024;
+static constexpr size_t kHeaderBytes = 16;
+// Whole sample pairs (2 x 3 digits = 9 bytes) that fit the payload
+static constexpr size_t kSamplesPerBlock = ((kBlockBytes - kHeaderBytes) / 9) * 2;
+
+static const uint8_t kMagic[4] = { 'V', 'R', 'B', '1' };
+
+struct BlockHeader {
+  uint32_t first_idx = 0;
+  uint32_t t_us = 0;
+  uint16_t n = 0;
+  uint16_t seq = 0;
+};
+
+inline void put_u16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+inline void put_u32(uint8_t* p, uint32_t v) { put_u16(p, (uint16_t)v); put_u16(p + 2, (uint16_t)(v >> 16)); }
+inline uint16_t get_u16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+inline uint32_t get_u32(const uint8_t* p) { return (uint32_t)get_u16(p) | ((uint32_t)get_u16(p + 2) << 16); }
+
+// digits: h.n * 3 interleaved sensor digits (-2048..2047). Unused payload
+// bytes are left at 0xFF (erased flash). Returns false if h.n is too large.
+inline bool pack_block(const BlockHeader& h, const int16_t* digits, uint8_t out[kBlockBytes]) {
+  if (h.n > kSamplesPerBlock) return false;
+  memset(out, 0xFF, kBlockBytes);
+  memcpy(out, kMagic, 4);
+  put_u32(out + 4, h.first_idx);
+  put_u32(out + 8, h.t_us);
+  put_u16(out + 12, h.n);
+  put_u16(out + 14, h.seq);
+  uint32_t clamps = 0;
+  return codec::encode_raw12(digits, (size_t)h.n * 3, 1, out + kHeaderBytes,
+                             kBlockBytes - kHeaderBytes, clamps) == codec::max_bytes(codec::RAW12, (size_t)h.n * 3);
+}
+
+// mg_xyz receives h.n * 3 interleaved samples in mg (so_mg per digit)
+inline bool unpack_block(const uint8_t in[kBlockBytes], int32_t so_mg, BlockHeader& h, int16_t* mg_xyz) {
+  if (memcmp(in, kMagic, 4) != 0) return false;
+  h.first_idx = get_u32(in + 4);
+  h.t_us = get_u32(in + 8);
+  h.n = get_u16(in + 12);
+  h.seq = get_u16(in + 14);
+  if (h.n > kSamplesPerBlock) return false;
+  const size_t len = codec::max_bytes(codec::RAW12, (size_t)h.n * 3);
+  return codec::decode(codec::RAW12, in + kHeaderBytes, len, so_mg, mg_xyz, (size_t)h.n * 3) == (long)h.n * 3;
+}
+
+// -------------------------
+// Bulk upload form ("VRD1")
+// -------------------------
+// The HTTP backlog upload sends blocks transcoded to a denser record:
+//
+//   off  size  field
+//   0    16    header as above, magic "VRD1"
+//   16   6     byte lengths of the x, y and z streams (u16 le each)
+//   22   ...   x, then y, then z digits of the block as the delta codec
+//              ("dzv_so" with So = 1 digit)
+//
+// Neighbouring samples differ little, so a record is typically ~30% smaller
+// than the raw12 block (and no longer padded to kBlockBytes). Strong signals
+// near full scale can come out larger; those blocks go as stored (VRB1), so
+// an upload stream is a mix of both, told apart by their magic. Either way
+// it is lossless: from_record() gives back the digits pack_block() was given.
+
+static const uint8_t kDeltaMagic[4] = { 'V', 'R', 'D', '1' };
+static constexpr size_t kDeltaHeaderBytes = kHeaderBytes + 6;
+static constexpr size_t kDeltaMaxBytes = kDeltaHeaderBytes + 2 * 3 * kSamplesPerBlock;   // diffs fit 2 varint bytes
+
+// Digit k of a raw12 payload (pairs of 12-bit values in 3 bytes)
+inline int32_t raw12_at(const uint8_t* p, size_t k) {
+  const uint8_t* q = p + (k / 2) * 3;
+  int32_t d = (k & 1) ? (((int32_t)q[1] >> 4) | ((int32_t)q[2] << 4))
+                      : ((int32_t)q[0] | (((int32_t)q[1] & 0x0F) << 8));
+  if (d & 0x800) d -= 0x1000;
+  return d;
+}
+
+// Transcodes a stored block to a VRD1 record. Returns the record size, 0 if
+// blk is not a valid block, cap < kDeltaMaxBytes or the record would not be
+// smaller than the block (then send blk itself).
+inline size_t to_delta(const uint8_t blk[kBlockBytes], uint8_t* out, size_t cap) {
+  if (cap < kDeltaMaxBytes || memcmp(blk, kMagic, 4) != 0) return 0;
+  const uint16_t n = get_u16(blk + 12);
+  if (n > kSamplesPerBlock) return 0;
+
+  memcpy(out, blk, kHeaderBytes);
+  memcpy(out, kDeltaMagic, 4);
+  const uint8_t* payload = blk + kHeaderBytes;
+  size_t o = kDeltaHeaderBytes;
+  for (size_t k = 0; k < 3; k++) {
+    const size_t start = o;
+    int32_t prev = 0;
+    for (size_t i = 0; i < n; i++) {
+      const int32_t d = raw12_at(payload, i * 3 + k);
+      o += codec::put_varint(out + o, codec::zigzag(d - prev));
+      prev = d;
+    }
+    put_u16(out + kHeaderBytes + 2 * k, (uint16_t)(o - start));
+  }
+  return (o < kBlockBytes) ? o : 0;
+}
+
+// Parses one VRD1 record from in. used receives its size; digits receives
+// h.n * 3 interleaved sensor digits. False on a malformed or truncated record.
+inline bool from_delta(const uint8_t* in, size_t len, size_t& used, BlockHeader& h, int16_t* digits) {
+  if (len < kDeltaHeaderBytes || memcmp(in, kDeltaMagic, 4) != 0) return false;
+  h.first_idx = get_u32(in + 4);
+  h.t_us = get_u32(in + 8);
+  h.n = get_u16(in + 12);
+  h.seq = get_u16(in + 14);
+  if (h.n > kSamplesPerBlock) return false;
+
+  size_t o = kDeltaHeaderBytes;
+  int16_t axis[kSamplesPerBlock];
+  for (size_t k = 0; k < 3; k++) {
+    const size_t alen = get_u16(in + kHeaderBytes + 2 * k);
+    if (o + alen > len) return false;
+    if (codec::decode(codec::DELTA, in + o, alen, 1, axis, h.n) != (long)h.n) return false;
+    for (size_t i = 0; i < h.n; i++) digits[i * 3 + k] = axis[i];
+    o += alen;
+  }
+  used = o;
+  return true;
+}
+
+// One record of an upload stream, VRD1 or VRB1
+inline bool from_record(const uint8_t* in, size_t len, size_t& used, BlockHeader& h, int16_t* digits) {
+  if (len >= 4 && memcmp(in, kMagic, 4) == 0) {
+    if (len < kBlockBytes || !unpack_block(in, 1, h, digits)) return false;
+    used = kBlockBytes;
+    return true;
+  }
+  return from_delta(in, len, used, h, digits);
+}
+
+} // namespace rec
+} // namespace vib
@@ -0,0 +1,199 @@
+// vib_sdft.h
+// Sliding DFT of three axes: the spectrum of the last n samples, updated
+// per sample at a cost that does not depend on how often it is read.
+//
+// Modulated form with integer accumulators. For each tracked bin k
+//
+//   Y_k += (x[m] - x[m-n]) * W^(k m)        W = e^(-j 2 pi / n), Q15 table
+//
+// i.e. Y_k is the sum over the window of x * W^(k m) with m the absolute
+// sample index. The products are exact int32 and the sums exact int64, so a
+// sample leaving the window removes exactly what it added: the state never
+// drifts, however long the run (the classic resonator form, Y = W^-k (Y + d),
+// accumulates rounding and needs damping). Reading bin k rotates it to the
+// window start, X_k = W^(-k s) Y_k with s the index of the oldest sample,
+// which is the FFT of the window up to the Q15 twiddles (~3e-5).
+//
+// power() applies a periodic Hann window in the frequency domain (X_k / 2 -
+// (X_k-1 + X_k+1) / 4) with X_0 = 0, which is the same as removing the mean
+// before windowing. The scale is that of spec::power_spectrum3 (whose Hann
+// is the symmetric one: the two differ by well under 1% at n >= 64).
+//
+// Per sample and axis: 2 multiplies and 2 adds for each tracked bin; bins
+// k0 - 1 .. k1 + 1 are tracked (the window needs the neighbours). Memory
+// comes from the caller (bytes()).
+//
+// The same class also runs as an overlapped short-time FFT (sliding =
+// false): push() only fills the window ring and power() transforms it, with
+// the same windowing and output. Per hop samples the sliding form costs
+// hop * bins updates and the FFT (n / 2) log2(n) butterflies, each about one
+// complex multiply-add: prefer_sliding() picks the cheaper. The sliding form
+// wins for narrow bands and fast cadences, and spreads the work evenly over
+// the samples instead of a burst per read.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "vib_spectrum.h"
+
+namespace vib {
+namespace sdft {
+
+class Sliding3 {
+public:
+  static constexpr size_t kAxes = 3;
+
+  // Memory for an n-point window reporting bins k0..k1
+  static size_t bytes(size_t n, size_t k0, size_t k1, bool sliding = true) {
+    size_t t0, t1;
+    if (!tracked(n, k0, k1, t0, t1)) return 0;
+    const size_t ring = kAxes * n * sizeof(int16_t);
+    if (!sliding) return ring + 2 * n * sizeof(float);
+    return kAxes * (t1 - t0 + 1) * 2 * sizeof(int64_t) + ring + 2 * n * sizeof(int16_t);
+  }
+
+  // true if updating per sample costs less than an FFT every hop samples
+  static bool prefer_sliding(size_t n, size_t k0, size_t k1, size_t hop) {
+    size_t t0, t1;
+    if (!tracked(n, k0, k1, t0, t1)) return false;
+    size_t log2n = 0;
+    while (((size_t)1 << log2n) < n) log2n++;
+    return hop * (t1 - t0 + 1) < (n / 2) * log2n;
+  }
+
+  // n power of two, 4..32768; 0 <= k0 <= k1 <= n / 2
+  bool begin(size_t n, size_t k0, size_t k1, void* mem, size_t mem_bytes, bool sliding = true) {
+    if (!tracked(n, k0, k1, t0_, t1_) || mem_bytes < bytes(n, k0, k1, sliding)) return false;
+    n_ = n;
+    mask_ = n - 1;
+    k0_ = k0;
+    k1_ = k1;
+    sliding_ = sliding;
+    nt_ = sliding ? t1_ - t0_ + 1 : 0;
+    acc_ = (int64_t*)mem;
+    hist_ = (int16_t*)(acc_ + kAxes * nt_ * 2);
+    for (size_t i = 0; i < kAxes * nt_ * 2; i++) acc_[i] = 0;
+    for (size_t i = 0; i < kAxes * n; i++) hist_[i] = 0;
+    if (sliding) {
+      tw_ = hist_ + kAxes * n;
+      cbuf_ = nullptr;
+      for (size_t i = 0; i < n; i++) {
+        const double ph = 2.0 * M_PI * (double)i / (double)n;
+        tw_[2 * i] = (int16_t)lround(32767.0 * cos(ph));
+        tw_[2 * i + 1] = (int16_t)lround(32767.0 * sin(ph));
+      }
+    } else {
+      tw_ = nullptr;
+      cbuf_ = (float*)(hist_ + kAxes * n);
+    }
+    pos_ = 0;
+    count_ = 0;
+    return true;
+  }
+
+  void push(const int16_t v[kAxes]) {
+    // Locals: the int64 stores below could alias the size_t members
+    const size_t pos = pos_, mask = mask_, nt = nt_;
+    const int16_t* tw = tw_;
+    for (size_t a = 0; a < kAxes; a++) {
+      int16_t& old = hist_[a * n_ + pos];
+      const int32_t d = (int32_t)v[a] - (int32_t)old;
+      old = v[a];
+      if (!d) continue;
+      int64_t* y = acc_ + a * nt * 2;
+      size_t idx = (t0_ * pos) & mask;
+      for (size_t j = 0; j < nt; j++) {
+        y[2 * j] += (int64_t)(d * (int32_t)tw[2 * idx]);
+        y[2 * j + 1] -= (int64_t)(d * (int32_t)tw[2 * idx + 1]);
+        idx = (idx + pos) & mask;
+      }
+    }
+    pos_ = (pos_ + 1) & mask_;
+    count_++;
+  }
+
+  bool sliding() const { return sliding_; }
+  size_t n() const { return n_; }
+  size_t k0() const { return k0_; }
+  size_t k1() const { return k1_; }
+  uint64_t count() const { return count_; }
+  bool full() const { return count_ >= n_; }
+
+  // Sum over the axes of the Hann-windowed, mean-removed power of bins
+  // k0..k1 (k1 - k0 + 1 floats); until full() the missing samples count as 0
+  void power(float* psd) const {
+    for (size_t k = k0_; k <= k1_; k++) psd[k - k0_] = 0.0f;
+    for (size_t a = 0; a < kAxes; a++) {
+      if (!sliding_) transform(a);
+      float lo_re = 0.0f, lo_im = 0.0f, re, im, hi_re, hi_im;
+      if (k0_ >= 1) {
+        bin(a, k0_ - 1, lo_re, lo_im);
+      } else {
+        bin(a, 1, lo_re, lo_im);         // X_-1 = conj(X_1)
+        lo_im = -lo_im;
+      }
+      bin(a, k0_, re, im);
+      for (size_t k = k0_; k <= k1_; k++) {
+        if (k + 1 <= n_ / 2) {
+          bin(a, k + 1, hi_re, hi_im);
+        } else {
+          hi_re = lo_re;                 // X_(n/2+1) = conj(X_(n/2-1))
+          hi_im = -lo_im;
+        }
+        const float hr = 0.5f * re - 0.25f * (lo_re + hi_re);
+        const float hi = 0.5f * im - 0.25f * (lo_im + hi_im);
+        psd[k - k0_] += hr * hr + hi * hi;
+        lo_re = re; lo_im = im;
+        re = hi_re; im = hi_im;
+      }
+    }
+  }
+
+private:
+  static bool tracked(size_t n, size_t k0, size_t k1, size_t& t0, size_t& t1) {
+    if (n < 4 || n > 32768 || (n & (n - 1)) || k0 > k1 || k1 > n / 2) return false;
+    t0 = k0 > 1 ? k0 - 1 : 1;            // bin 0 is the mean: always 0
+    t1 = k1 + 1 <= n / 2 ? k1 + 1 : n / 2;
+    return true;
+  }
+
+  // FFT of axis a's window, oldest sample first, into cbuf_
+  void transform(size_t a) const {
+    const int16_t* h = hist_ + a * n_;
+    for (size_t i = 0; i < n_; i++) {
+      cbuf_[2 * i] = (float)h[(pos_ + i) & mask_];
+      cbuf_[2 * i + 1] = 0.0f;
+    }
+    spec::fft_c32(cbuf_, n_);
+  }
+
+  // X_k of axis a for the window ending at the last sample pushed
+  void bin(size_t a, size_t k, float& re, float& im) const {
+    if (k == 0) { re = im = 0.0f; return; }
+    if (!sliding_) { re = cbuf_[2 * k]; im = cbuf_[2 * k + 1]; return; }
+    const int64_t* y = acc_ + (a * nt_ + (k - t0_)) * 2;
+    const float yr = (float)y[0] * (1.0f / 32767.0f);
+    const float yi = (float)y[1] * (1.0f / 32767.0f);
+    // pos_ is the oldest sample's index mod n: rotate by +2 pi k pos_ / n
+    const size_t idx = (k * pos_) & mask_;
+    const float c = (float)tw_[2 * idx] * (1.0f / 32767.0f);
+    const float s = (float)tw_[2 * idx + 1] * (1.0f / 32767.0f);
+    re = yr * c - yi * s;
+    im = yr * s + yi * c;
+  }
+
+  size_t n_ = 0, mask_ = 0, k0_ = 0, k1_ = 0, t0_ = 1, t1_ = 1, nt_ = 0;
+  int64_t* acc_ = nullptr;     // [axis][bin t0..t1][re, im], Q15
+  int16_t* hist_ = nullptr;    // [axis][n] ring of the window
+  int16_t* tw_ = nullptr;      // n (cos, sin) pairs, Q15 (sliding)
+  float* cbuf_ = nullptr;      // 2 * n FFT scratch (!sliding)
+  bool sliding_ = true;
+  size_t pos_ = 0;             // next write = oldest sample, mod n
+  uint64_t count_ = 0;
+};
+
+} // namespace sdft
+} // namespace vib
@@ -0,0 +1,293 @@
+// vib_spectrum.h
+// Spectrum helpers: radix-2 FFT, 3-axis power spectrum, tachless running
+// speed estimation (harmonic product spectrum) and STFT spectral kurtosis
+// (kurtogram band selection for envelope analysis).
+//
+// All float, scalar, header-only; used by the "speed" and "kurtogram"
+// pipeline stages and the host tools. The FFT is the plain iterative radix-2
+// (interleaved re/im); on the ESP32-S3 a 2048-point transform per axis takes
+// a few ms, which is small next to a 1-2 s capture, so there is no esp-dsp
+// variant.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+
+#include "vib_kernels.h"
+
+namespace vib {
+namespace spec {
+
+inline bool is_pow2(size_t n) { return n >= 2 && (n & (n - 1)) == 0; }
+
+// Largest power of two <= n (0 for n < 2)
+inline size_t floor_pow2(size_t n) {
+  if (n < 2) return 0;
+  size_t p = 1;
+  while (p * 2 <= n) p *= 2;
+  return p;
+}
+
+// In-place forward FFT of n complex values (x[2i] = re, x[2i+1] = im).
+// n must be a power of two.
+inline void fft_c32(float* x, size_t n) {
+  // bit reversal
+  for (size_t i = 1, j = 0; i < n; i++) {
+    size_t bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      std::swap(x[2 * i], x[2 * j]);
+      std::swap(x[2 * i + 1], x[2 * j + 1]);
+    }
+  }
+  for (size_t len = 2; len <= n; len <<= 1) {
+    // twiddle recurrence in double keeps the error at float level for n <= 64k
+    const double ang = -2.0 * M_PI / (double)len;
+    const double wr_step = cos(ang), wi_step = sin(ang);
+    const size_t half = len / 2;
+    double wr = 1.0, wi = 0.0;
+    for (size_t k = 0; k < half; k++) {
+      const float cr = (float)wr, ci = (float)wi;
+      for (size_t i = k; i < n; i += len) {
+        float* a = &x[2 * i];
+        float* b = &x[2 * (i + half)];
+        const float tr = b[0] * cr - b[1] * ci;
+        const float ti = b[0] * ci + b[1] * cr;
+        b[0] = a[0] - tr; b[1] = a[1] - ti;
+        a[0] += tr;       a[1] += ti;
+      }
+      const double t = wr * wr_step - wi * wi_step;
+      wi = wr * wi_step + wi * wr_step;
+      wr = t;
+    }
+  }
+}
+
+// Sum over the three axes of the Hann-windowed, mean-removed power spectrum.
+// Uses the first nfft samples of each axis (nfft power of two, <= n).
+//   axis[k]  int16 samples (any unit; mg on the device)
+//   win      nfft Hann coefficients (window_hann)
+//   cbuf     2 * nfft floats scratch
+//   psd      nfft/2 + 1 bins out, bin k = k * fs / nfft
+inline void power_spectrum3(const int16_t* const axis[3], size_t nfft, const float* win,
+                            float* cbuf, float* psd) {
+  const size_t nb = nfft / 2 + 1;
+  for (size_t k = 0; k < nb; k++) psd[k] = 0.0f;
+  for (size_t a = 0; a < 3; a++) {
+    int64_t sum = 0;
+    for (size_t i = 0; i < nfft; i++) sum += axis[a][i];
+    const float mean = (float)((double)sum / (double)nfft);
+    for (size_t i = 0; i < nfft; i++) {
+      cbuf[2 * i] = ((float)axis[a][i] - mean) * win[i];
+      cbuf[2 * i + 1] = 0.0f;
+    }
+    fft_c32(cbuf, nfft);
+    for (size_t k = 0; k < nb; k++) {
+      psd[k] += cbuf[2 * k] * cbuf[2 * k] + cbuf[2 * k + 1] * cbuf[2 * k + 1];
+    }
+  }
+}
+
+struct SpeedEstimate {
+  float hz = 0.0f;           // fundamental running speed
+  float confidence = 0.0f;   // 0..1
+  float prominence_db = 0.0f;
+  uint8_t harmonics = 0;     // harmonics below Nyquist at the chosen speed
+};
+
+// Harmonic product spectrum over candidates fmin..fmax (Hz): each candidate
+// bin k scores the mean log power of its harmonics 1..n_harm, taking the
+// largest bin within +-h/2 of h*k (the fundamental is only known to half a
+// bin; capped at k/4). A candidate whose fundamental bin is not 6 dB over the
+// median level gives way to its octave if that one is (f0/2 vs f0
+// ambiguity). The winner is refined by parabolic interpolation on log power
+// at the fundamental. Confidence is the mean harmonic prominence over the
+// median spectral level in the searched band, 30 dB mapping to 1.
+//   scratch  2 * nb floats (nb = psd bins)
+inline SpeedEstimate estimate_speed(const float* psd, size_t nb, float df,
+                                    float fmin, float fmax, uint8_t n_harm, float* scratch) {
+  SpeedEstimate r;
+  if (nb < 4 || df <= 0.0f || n_harm < 1) return r;
+  size_t kmin = (size_t)ceil(fmin / df);
+  size_t kmax = (size_t)floor(fmax / df);
+  if (kmin < 1) kmin = 1;
+  if (kmax > nb - 2) kmax = nb - 2;
+  if (kmin > kmax) return r;
+
+  const float eps = 1e-12f;
+  // log10 of the spectrum once; harmonics reuse it
+  for (size_t k = 0; k < nb; k++) scratch[k] = log10f(psd[k] + eps);
+
+  // Median log level over the searched band (fundamentals .. last harmonic)
+  size_t hi = kmax * (size_t)n_harm;
+  if (hi > nb - 1) hi = nb - 1;
+  const size_t cnt = hi - kmin + 1;
+  float* band = scratch + nb;
+  for (size_t i = 0; i < cnt; i++) band[i] = scratch[kmin + i];
+  std::nth_element(band, band + cnt / 2, band + cnt);
+  const float median = band[cnt / 2];
+
+  // Mean log power of the harmonics of candidate k; used = harmonics scored
+  auto score = [&](size_t k, uint8_t& used) {
+    float s = 0.0f;
+    used = 0;
+    for (uint8_t h = 1; h <= n_harm; h++) {
+      const size_t c = (size_t)h * k;
+      // Tolerance grows with h, but stays well below the harmonic spacing
+      // so a subharmonic candidate cannot reach the true peaks
+      size_t w = h / 2;
+      if (w > k / 4) w = k / 4;
+      if (c + w >= nb) break;
+      float m = scratch[c - w];
+      for (size_t j = c - w + 1; j <= c + w; j++) if (scratch[j] > m) m = scratch[j];
+      s += m;
+      used++;
+    }
+    return used ? s / (float)used : -1e30f;
+  };
+
+  float best = -1e30f;
+  size_t best_k = 0;
+  uint8_t best_h = 0;
+  for (size_t k = kmin; k <= kmax; k++) {
+    uint8_t used = 0;
+    const float s = score(k, used);
+    if (!used) break;
+    if (s > best) { best = s; best_k = k; best_h = used; }
+  }
+  if (!best_h) return r;
+
+  // Octave check: with few harmonics f0/2 scores as well as f0 (every other
+  // harmonic hits). A real fundamental stands out of the floor; if this one
+  // does not and the octave above does, take the octave.
+  const float kFloor = 0.6f;   // 6 dB over the median
+  if (scratch[best_k] - median < kFloor && 2 * best_k + 1 <= kmax) {
+    float oct = -1e30f;
+    size_t oct_k = 0;
+    uint8_t oct_h = 0;
+    for (size_t k2 = 2 * best_k - 1; k2 <= 2 * best_k + 1; k2++) {
+      if (scratch[k2] - median < kFloor) continue;
+      uint8_t used = 0;
+      const float s = score(k2, used);
+      if (used && s > oct) { oct = s; oct_k = k2; oct_h = used; }
+    }
+    if (oct_h && oct > best - kFloor) { best = oct; best_k = oct_k; best_h = oct_h; }
+  }
+
+  // Parabolic peak refinement around the fundamental bin
+  const float ym = scratch[best_k - 1], y0 = scratch[best_k], yp = scratch[best_k + 1];
+  float delta = 0.0f;
+  const float den = ym - 2.0f * y0 + yp;
+  if (y0 >= ym && y0 >= yp && den < 0.0f) delta = 0.5f * (ym - yp) / den;
+
+  r.hz = ((float)best_k + delta) * df;
+  r.harmonics = best_h;
+  r.prominence_db = 10.0f * (best - median);
+  r.confidence = r.prominence_db / 30.0f;
+  if (r.confidence < 0.0f) r.confidence = 0.0f;
+  if (r.confidence > 1.0f) r.confidence = 1.0f;
+  return r;
+}
+
+// -------------------------
+// Spectral kurtosis (STFT kurtogram)
+// -------------------------
+// One kurtogram level: STFT with an nw-point Hann window and hop nw/4, i.e. a
+// uniform bank of nw/2 + 1 band-pass filters of width fs/nw. For every bin
+//   sk[k] = <|X_k|^4> / <|X_k|^2>^2 - 2
+// over the frames: ~0 for stationary Gaussian noise, large where the band
+// carries impulsive (bearing/gear fault) content. Bins 0 and nw/2 are real
+// valued and have a different noise baseline; callers should skip them.
+//   x     n samples (any unit); n >= nw
+//   win   nw Hann coefficients
+//   cbuf  2 * nw floats scratch
+//   s2/s4 nw/2 + 1 doubles scratch each
+//   sk    nw/2 + 1 floats out
+// Returns the number of frames used (0 if n < nw).
+inline size_t spectral_kurtosis(const int16_t* x, size_t n, size_t nw, const float* win,
+                                float* cbuf, double* s2, double* s4, float* sk) {
+  const size_t nb = nw / 2 + 1;
+  if (!is_pow2(nw) || n < nw) return 0;
+  int64_t sum = 0;
+  for (size_t i = 0; i < n; i++) sum += x[i];
+  const float mean = (float)((double)sum / (double)n);
+
+  for (size_t k = 0; k < nb; k++) { s2[k] = 0.0; s4[k] = 0.0; }
+  const size_t hop = nw / 4;
+  size_t frames = 0;
+  for (size_t off = 0; off + nw <= n; off += hop) {
+    for (size_t i = 0; i < nw; i++) {
+      cbuf[2 * i] = ((float)x[off + i] - mean) * win[i];
+      cbuf[2 * i + 1] = 0.0f;
+    }
+    fft_c32(cbuf, nw);
+    for (size_t k = 0; k < nb; k++) {
+      const double p = (double)cbuf[2 * k] * cbuf[2 * k] + (double)cbuf[2 * k + 1] * cbuf[2 * k + 1];
+      s2[k] += p;
+      s4[k] += p * p;
+    }
+    frames++;
+  }
+  for (size_t k = 0; k < nb; k++) {
+    const double m2 = s2[k] / (double)frames;
+    sk[k] = (m2 > 0.0) ? (float)(s4[k] / (double)frames / (m2 * m2) - 2.0) : 0.0f;
+  }
+  return frames;
+}
+
+struct KurtBand {
+  float f_lo_hz = 0.0f;
+  float f_hi_hz = 0.0f;
+  float kurtosis = 0.0f;
+  uint16_t nw = 0;           // window length of the winning level
+  uint8_t axis = 0;
+};
+
+// Best band over the levels nw = nw_min, 2*nw_min, ..., nw_max (all powers of
+// two) and the given axes. Bin k of level nw is reported as the band
+// [(k - 1), (k + 1)] * fs / nw, the -6 dB width of the Hann window, which is
+// what a demodulation filter for that bin should pass. Bands starting below
+// fmin_hz are skipped (structural low-frequency content is not what envelope
+// analysis is after).
+// Each level needs at least 8 frames to give a usable estimate. Bands are
+// ranked by SK times its noise standard error (frames/4 are independent with
+// hop nw/4), i.e. by how unlikely the value is for Gaussian noise.
+//   win/cbuf/s2/s4/sk  scratch sized for nw_max (see spectral_kurtosis)
+inline KurtBand kurtogram(const int16_t* const* axis, size_t n_axes, size_t n, float fs,
+                          size_t nw_min, size_t nw_max, float fmin_hz,
+                          float* win, float* cbuf, double* s2, double* s4, float* sk) {
+  KurtBand best;
+  float best_score = -1e30f;
+  for (size_t nw = nw_min; nw <= nw_max; nw *= 2) {
+    if (n < nw + 7 * (nw / 4)) break;
+    window_hann(win, nw);
+    const float df = fs / (float)nw;
+    for (size_t a = 0; a < n_axes; a++) {
+      const size_t frames = spectral_kurtosis(axis[a], n, nw, win, cbuf, s2, s4, sk);
+      if (!frames) continue;
+      // SK of Gaussian noise has a spread ~ 2/sqrt(independent frames); rank
+      // by significance so fine levels (few frames) do not win on noise
+      const float z = sqrtf((float)frames / 4.0f) / 2.0f;
+      for (size_t k = 1; k < nw / 2; k++) {
+        const float lo = ((float)k - 1.0f) * df;
+        if (lo < fmin_hz) continue;
+        if (sk[k] * z > best_score) {
+          best_score = sk[k] * z;
+          best.kurtosis = sk[k];
+          best.f_lo_hz = lo;
+          best.f_hi_hz = ((float)k + 1.0f) * df;
+          best.nw = (uint16_t)nw;
+          best.axis = (uint8_t)a;
+        }
+      }
+    }
+  }
+  return best;
+}
+
+} // namespace spec
+} // namespace vib
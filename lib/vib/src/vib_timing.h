@@ -0,0 +1,78 @@
+// vib_timing.h
+// Sampling timing quality of a capture.
+//
+// Timing is fed every sample interval during acquisition (a few integer ops)
+// and summarizes how far the real sampling was from the nominal grid:
+//
+//   hist      |dt - period| as a log2 histogram: bin 0 < 2 us, bin k in
+//             [2^k, 2^(k+1)) us, the last bin everything from 128 us on
+//   missed    intervals of 1.5 periods or more: a sample slot passed
+//             unread, so the spectrum sees a phase jump there
+//   sat       intervals that did not fit the u16 dt field (65535 us)
+//   lag_max   worst delay of a read behind its slot t0 + i * period (the
+//             scheduler never reads early, it can only fall behind)
+//
+// plus dt min/max/mean/standard deviation. Set by the caller at the end:
+// read_max_us, the slowest sensor read, and end_err_us, the wall clock at the
+// end of the capture minus what the clock model (vib_clock.h) predicts for
+// it (NTP steps or slews during the capture show up here).
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+namespace vib {
+
+struct Timing {
+  static constexpr size_t kBins = 8;
+
+  uint32_t period_us = 0;
+  uint32_t n = 0;                 // intervals
+  uint32_t hist[kBins] = {0, 0, 0, 0, 0, 0, 0, 0};
+  uint32_t missed = 0;
+  uint32_t sat = 0;
+  uint32_t dt_min_us = 0xFFFFFFFFu;
+  uint32_t dt_max_us = 0;
+  uint64_t dt_sum_us = 0;
+  uint64_t dt_sum2 = 0;           // sum of dt^2, us^2
+  uint32_t lag_max_us = 0;
+  uint32_t read_max_us = 0;
+  int32_t end_err_us = 0;
+
+  void begin(uint32_t period) { *this = Timing(); period_us = period; }
+
+  static inline size_t bin(uint32_t dev_us) {
+    if (dev_us < 2) return 0;
+    size_t k = 0;
+    while (dev_us >= 2 && k < kBins - 1) { dev_us >>= 1; k++; }
+    return k;
+  }
+
+  // dt_us: interval before this sample (clamped to 65535 by the caller);
+  // lag_us: how late this sample was read vs its slot
+  inline void add(uint32_t dt_us, uint32_t lag_us) {
+    n++;
+    const uint32_t dev = dt_us > period_us ? dt_us - period_us : period_us - dt_us;
+    hist[bin(dev)]++;
+    if (2 * (uint64_t)dt_us >= 3 * (uint64_t)period_us) missed++;
+    if (dt_us >= 65535u) sat++;
+    if (dt_us < dt_min_us) dt_min_us = dt_us;
+    if (dt_us > dt_max_us) dt_max_us = dt_us;
+    dt_sum_us += dt_us;
+    dt_sum2 += (uint64_t)dt_us * dt_us;
+    if (lag_us > lag_max_us) lag_max_us = lag_us;
+  }
+
+  double dt_mean_us() const { return n ? (double)dt_sum_us / (double)n : 0.0; }
+
+  double dt_sd_us() const {
+    if (n < 2) return 0.0;
+    const double m = dt_mean_us();
+    const double v = (double)dt_sum2 / (double)n - m * m;
+    return v > 0.0 ? sqrt(v) : 0.0;
+  }
+};
+
+} // namespace vib
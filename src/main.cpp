@@ -1,5 +1,5 @@
 // main.cpp
-// ESP32-S3 Feather + LIS331HH (I2C) + HiveMQ TLS + NTP + MQTT + TinyCBOR (TOKITA)
+// ESP32-S3 Feather + LIS331HH (I2C/SPI) + HiveMQ TLS + NTP + MQTT + TinyCBOR (TOKITA)
 //
 // Fixes applied:
 // 1) meta epoch_s + iso are derived from t0_us (acquisition start), so timestamps are coherent.
@@ -8,6 +8,7 @@
 
 #include <Arduino.h>
 #include <Wire.h>
+#include <SPI.h>
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
 #include <PubSubClient.h>
@@ -19,8 +20,10 @@
 
 #include <time.h>
 #include <sys/time.h>
+#include <utility>    // std::swap
 
 #include <esp_timer.h>   // esp_timer_get_time()
+#include <esp_partition.h>
 
 #include <cbor.h>
 #include <Adafruit_NeoPixel.h>
@@ -28,10 +31,34 @@
 #include <WebServer.h>
 #include <DNSServer.h>
 
+#include "vib_kernels.h"
+#include "vib_fixed.h"
+#include "vib_pipeline.h"
+#include "vib_pyramid.h"
+#include "vib_fused.h"
+#include "vib_rec.h"
+#include "vib_clock.h"
+#include "vib_sdft.h"
+#include "vib_crc.h"
+#ifdef VIB_GOLDEN_SELFTEST
+#include "vib_golden.h"
+#endif
+
 
 // -------------------------
 // Config
 // -------------------------
+static constexpr uint16_t ACQ_MAX_SAMPLES = 3000;  // per burst capture (buffers)
+static constexpr uint8_t ACQ_MAX_PROFILES = 4;
+static constexpr size_t PYR_BURST_BYTES = 2048;     // overview pyramid per burst (finest levels dropped)
+
+// One burst capture of a multi-rate measurement ("acq.profiles")
+struct AcqProfile {
+  char name[12] = "";
+  uint16_t fs_hz = 1000;
+  uint16_t n_samples = 500;
+};
+
 struct Config {
   String client_id;
 
@@ -46,8 +73,12 @@ struct Config {
 
   String ca_path = "/ca.pem";
 
+  String sensor_bus = "i2c";     // "i2c" | "spi"
   uint8_t i2c_addr = 0x18;
+  uint8_t spi_cs = 10;           // chip select (default SPI pins for SCK/MISO/MOSI)
+  uint32_t spi_hz = 8000000;     // LIS331HH max SPI clock is 10 MHz
   uint8_t range_g = 24;
+  bool auto_range = false;       // pick 6/12/24 g per capture from the last one
 
   // NTP
   String ntp_server1 = "pool.ntp.org";
@@ -59,11 +90,41 @@ struct Config {
   uint16_t n_samples = 500;      // 500 samples
   uint16_t fs_hz = 1000;         // target rate
   float mag_rms_threshold = 10.78f; // m/s^2
+  String acq_mode = "burst";     // "burst" | "long" (stream to flash, upload later) | "trend" | "spectrum"
+  uint16_t long_s = 120;         // long capture length, capped by the "rec" partition
+  uint16_t upload_s = 60;        // per-wake upload budget for long recordings
+  float trend_hz = 1.0f;         // trend mode rate, 0.1..10 Hz
+  uint16_t trend_batch = 480;    // trend samples per upload (RTC buffer size)
+  AcqProfile profiles[ACQ_MAX_PROFILES]; // burst profiles run back to back; none = fs_hz/n_samples
+  uint8_t n_profiles = 0;
+  uint16_t pyr_factor = 10;      // min/max/RMS overview pyramid step ratio, 0 = off
+
+  // Processing pipeline ("pipeline.stages"); empty = default pipeline
+  vib::pipe::StageSpec pipeline_specs[vib::pipe::kMaxStages];
+  uint8_t pipeline_n = 0;
+
+  // Continuous spectrum ("spectrum", acq.mode "spectrum" for acq.long_s)
+  uint16_t spec_nfft = 512;      // window, power of two 64..1024
+  float spec_f_lo_hz = 0.0f;     // published band
+  float spec_f_hi_hz = 0.0f;     // 0 = fs/2
+  uint16_t spec_publish_ms = 250;
+  String spec_engine = "auto";   // "auto" | "sliding" | "fft"
+
+  // Link-adaptive payload ("link")
+  String link_mode = "auto";     // "auto" | "fixed" (always the pipeline's encoder)
+  uint16_t link_target_s = 8;    // target data transfer time per capture
+
+  // Bulk upload of long recordings ("upload"); empty url = one MQTT message per block
+  String upload_url;             // http[s]://host[:port]/path (https uses tls.ca_path)
+  String upload_token;           // sent as "Authorization: Bearer <token>" when set
+
   // Sleep
   uint32_t sleep_s = 300;        // 5 minutes
 };
 
 static Config cfg;
+
+static constexpr uint16_t TREND_MAX = 480;   // trend samples held in RTC memory
 static String ca_pem;
 
 static WiFiClientSecure tlsClient;
@@ -71,9 +132,32 @@ static PubSubClient mqtt(tlsClient);
 
 static Adafruit_LIS331HH lis;
 
+static vib::pipe::Pipeline pipeline;
+static vib::fused::Variant fused_variant = vib::fused::NONE;
+static size_t fused_covered = 0;   // pipeline stages run inside acquireN
+static bool ntp_synced = false;
+static RTC_DATA_ATTR uint8_t rtc_range_g = 0;   // auto-range: range for the next capture
+
+// Multi-rate measurement: profiles of one wake share meas_id (id of the first)
+static char meas_id[64] = "";
+static uint8_t meas_prof = 0;
+static uint8_t meas_profs = 0;                   // 0 = no acq.profiles configured
+
 static WebServer web(80);
 static DNSServer dns;                 // opcional
-static bool portal_saved = false;
+static bool portal_saved = false;          // network settings changed: restart
+static bool portal_applied = false;        // a save was applied live
+static bool portal_done = false;           // "Finish": leave the portal, carry on with this wake
+static bool portal_dry_run = false;        // test captures from the portal publish nothing
+static uint32_t portal_activity_ms = 0;    // last request (the timeout is for inactivity)
+static String portal_status;               // shown above the form after a save
+static bool lis_ready = false;
+static vib::pipe::Frame last_capture;      // results of the last runCapture()
+
+// Defined further down; the portal applies sensor and pipeline changes live
+static bool initLIS331();
+static bool buildPipeline();
+static bool runCapture(uint16_t fs_hz, uint16_t N, bool& gate_pass_out, uint8_t& next_range_g_io);
 
 // -------------------------
 // NeoPixel status (GPIO 17)
@@ -206,7 +290,106 @@ static String rowNumber(const String& label, const String& name, const String& c
   return r;
 }
 
+// -------------------------
+// Pipeline specs <-> JSON
+// -------------------------
+// "pipeline": { "stages": [ { "type": "hpf", "fc_hz": 2, "order": 4 }, ... ] }
+static bool parsePipelineSpecs(JsonVariantConst stages, vib::pipe::StageSpec* out, uint8_t& n_out) {
+  n_out = 0;
+  if (stages.isNull()) return true;
+  if (!stages.is<JsonArrayConst>()) return false;
+
+  for (JsonVariantConst v : stages.as<JsonArrayConst>()) {
+    if (n_out >= vib::pipe::kMaxStages) return false;
+    JsonObjectConst st = v.as<JsonObjectConst>();
+    vib::pipe::StageSpec& sp = out[n_out];
+    sp = vib::pipe::StageSpec();
+
+    const char* type = st["type"] | "";
+    if (!type[0]) return false;
+    sp.setType(type);
+
+    for (JsonPairConst kv : st) {
+      if (!strcmp(kv.key().c_str(), "type")) continue;
+      bool ok = kv.value().is<const char*>()
+              ? sp.addStr(kv.key().c_str(), kv.value().as<const char*>())
+              : sp.addNum(kv.key().c_str(), kv.value().as<float>());
+      if (!ok) return false;
+    }
+    n_out++;
+  }
+  return true;
+}
+
+static void pipelineSpecsToJsonArray(JsonArray arr) {
+  for (uint8_t i = 0; i < cfg.pipeline_n; i++) {
+    const vib::pipe::StageSpec& sp = cfg.pipeline_specs[i];
+    JsonObject o = arr.add<JsonObject>();
+    o["type"] = sp.type;
+    for (uint8_t k = 0; k < sp.n_params; k++) {
+      if (sp.params[k].is_str) o[sp.params[k].key] = sp.params[k].str;
+      else o[sp.params[k].key] = sp.params[k].num;
+    }
+  }
+}
+
+static String pipelineSpecsToJson() {
+  JsonDocument doc;
+  pipelineSpecsToJsonArray(doc.to<JsonArray>());
+  String out;
+  serializeJson(doc, out);
+  return out;
+}
+
+// -------------------------
+// Capture profiles <-> JSON
+// -------------------------
+// "acq": { "profiles": [ { "name": "slow", "fs_hz": 50, "n_samples": 3000 }, ... ] }
+static bool parseAcqProfiles(JsonVariantConst arr, AcqProfile* out, uint8_t& n_out) {
+  n_out = 0;
+  if (arr.isNull()) return true;
+  if (!arr.is<JsonArrayConst>()) return false;
+
+  for (JsonVariantConst v : arr.as<JsonArrayConst>()) {
+    if (n_out >= ACQ_MAX_PROFILES) return false;
+    if (!v.is<JsonObjectConst>()) return false;
+    AcqProfile& pr = out[n_out];
+    pr = AcqProfile();
+
+    const uint32_t fs = v["fs_hz"] | 0UL;
+    const uint32_t n = v["n_samples"] | 0UL;
+    if (fs < 50 || fs > 2000 || n < 10 || n > ACQ_MAX_SAMPLES) return false;
+    pr.fs_hz = (uint16_t)fs;
+    pr.n_samples = (uint16_t)n;
+
+    const char* name = v["name"] | "";
+    strncpy(pr.name, name, sizeof(pr.name) - 1);
+    pr.name[sizeof(pr.name) - 1] = '\0';
+    n_out++;
+  }
+  return true;
+}
+
+static void acqProfilesToJsonArray(JsonArray arr) {
+  for (uint8_t i = 0; i < cfg.n_profiles; i++) {
+    const AcqProfile& pr = cfg.profiles[i];
+    JsonObject o = arr.add<JsonObject>();
+    if (pr.name[0]) o["name"] = pr.name;
+    o["fs_hz"] = pr.fs_hz;
+    o["n_samples"] = pr.n_samples;
+  }
+}
+
+static String acqProfilesToJson() {
+  JsonDocument doc;
+  acqProfilesToJsonArray(doc.to<JsonArray>());
+  String out;
+  serializeJson(doc, out);
+  return out;
+}
+
 static void handleRoot() {
+  portal_activity_ms = millis();
   // theme override: ?theme=light | dark | hc
   String theme = "";
   if (web.hasArg("theme")) {
@@ -315,7 +498,10 @@ static void handleRoot() {
   h += "</style></head><body>";
 
   h += "<h2>DIMITRI Configuration</h2>";
-  h += "<p class='sub'>Leave a field empty to keep the current value. Click <b>Save & Restart</b> when done.</p>";
+  if (portal_status.length()) {
+    h += "<div class='note'>" + portal_status + "</div>";
+  }
+  h += "<p class='sub'>Leave a field empty to keep the current value. Click <b>Save & Apply</b> when done (network settings restart the device).</p>";
 
   // Theme toolbar (manual override)
   h += "<div class='toolbar'>";
@@ -352,8 +538,12 @@ static void handleRoot() {
 
   // Sensor
   h += "<tr><th colspan='3'>Sensor</th></tr>";
+  h += row("sensor.bus (i2c/spi)", "sensor.bus", cfg.sensor_bus);
   h += rowNumber("sensor.i2c_addr (hex ok e.g. 0x18)", "sensor.i2c_addr", "0x" + String(cfg.i2c_addr, HEX));
+  h += rowNumber("sensor.spi_cs (GPIO)", "sensor.spi_cs", String(cfg.spi_cs));
+  h += rowNumber("sensor.spi_hz", "sensor.spi_hz", String(cfg.spi_hz));
   h += rowNumber("sensor.range_g (6/12/24)", "sensor.range_g", String(cfg.range_g));
+  h += rowNumber("sensor.auto_range (0/1)", "sensor.auto_range", String(cfg.auto_range ? 1 : 0));
 
   // NTP
   h += "<tr><th colspan='3'>NTP</th></tr>";
@@ -367,16 +557,51 @@ static void handleRoot() {
   h += rowNumber("acq.n_samples", "acq.n_samples", String(cfg.n_samples));
   h += rowNumber("acq.fs_hz", "acq.fs_hz", String(cfg.fs_hz));
   h += rowNumber("acq.mag_rms_threshold (m/s^2)", "acq.mag_rms_threshold", String(cfg.mag_rms_threshold, 3));
+  h += row("acq.mode (burst/long/trend/spectrum)", "acq.mode", cfg.acq_mode);
+  h += rowNumber("acq.long_s", "acq.long_s", String(cfg.long_s));
+  h += rowNumber("acq.upload_s", "acq.upload_s", String(cfg.upload_s));
+  h += rowNumber("acq.trend_hz (0.1-10)", "acq.trend_hz", String(cfg.trend_hz, 2));
+  h += rowNumber("acq.trend_batch", "acq.trend_batch", String(cfg.trend_batch));
+  h += row("acq.profiles (JSON array, [] = fs_hz/n_samples)", "acq.profiles", acqProfilesToJson());
+  h += rowNumber("acq.pyr_factor (0 = off)", "acq.pyr_factor", String(cfg.pyr_factor));
+
+  // Pipeline
+  h += "<tr><th colspan='3'>Pipeline</th></tr>";
+  h += row("pipeline.stages (JSON array, [] = default)", "pipeline.stages", pipelineSpecsToJson());
+
+  // Spectrum
+  h += "<tr><th colspan='3'>Spectrum (acq.mode spectrum)</th></tr>";
+  h += rowNumber("spectrum.nfft (64-1024, power of 2)", "spectrum.nfft", String(cfg.spec_nfft));
+  h += rowNumber("spectrum.f_lo_hz", "spectrum.f_lo_hz", String(cfg.spec_f_lo_hz, 1));
+  h += rowNumber("spectrum.f_hi_hz (0 = fs/2)", "spectrum.f_hi_hz", String(cfg.spec_f_hi_hz, 1));
+  h += rowNumber("spectrum.publish_ms", "spectrum.publish_ms", String(cfg.spec_publish_ms));
+  h += row("spectrum.engine (auto | sliding | fft)", "spectrum.engine", cfg.spec_engine);
+
+  // Link
+  h += "<tr><th colspan='3'>Link</th></tr>";
+  h += row("link.mode (auto | fixed)", "link.mode", cfg.link_mode);
+  h += rowNumber("link.target_s", "link.target_s", String(cfg.link_target_s));
+
+  // Bulk upload
+  h += "<tr><th colspan='3'>Bulk upload</th></tr>";
+  h += row("upload.url (off = MQTT)", "upload.url", cfg.upload_url);
+  h += row("upload.token", "upload.token", cfg.upload_token, true);
 
   // Sleep
   h += "<tr><th colspan='3'>Sleep</th></tr>";
   h += rowNumber("sleep.seconds", "sleep.seconds", String(cfg.sleep_s));
 
   h += "</table>";
-  h += "<button class='btn' type='submit'>Save & Restart</button>";
+  h += "<button class='btn' type='submit'>Save & Apply</button>";
   h += "<button class='btn btn2' type='button' onclick='location.reload()'>Reset Form</button>";
+  h += "<button class='btn btn2' type='button' onclick=\"location.href='/measure'\">Test Capture</button>";
+  h += "<div class='note'>Sensor, acquisition, pipeline and gate changes apply at once; "
+       "WiFi, MQTT, TLS and client_id changes restart the device. "
+       "Test Capture runs one capture with the current settings and publishes nothing.</div>";
   h += "<div class='note'>AP mode: connect to this WiFi, open any page (or <code>192.168.4.1</code>).</div>";
-  h += "</form></body></html>";
+  h += "</form>";
+  h += "<form method='POST' action='/done'><button class='btn' type='submit'>Finish</button></form>";
+  h += "</body></html>";
 
   web.send(200, "text/html", h);
 }
@@ -476,8 +701,12 @@ static bool saveConfigToFS() {
   doc["tls"]["ca_path"] = cfg.ca_path;
 
   // sensor
+  doc["sensor"]["bus"]      = cfg.sensor_bus;
   doc["sensor"]["i2c_addr"] = cfg.i2c_addr;   // se guarda decimal (ok). Si quieres hex string, dime.
+  doc["sensor"]["spi_cs"]   = cfg.spi_cs;
+  doc["sensor"]["spi_hz"]   = cfg.spi_hz;
   doc["sensor"]["range_g"]  = cfg.range_g;
+  doc["sensor"]["auto_range"] = cfg.auto_range;
 
   // ntp
   doc["ntp"]["server1"]    = cfg.ntp_server1;
@@ -489,6 +718,31 @@ static bool saveConfigToFS() {
   doc["acq"]["n_samples"]          = cfg.n_samples;
   doc["acq"]["fs_hz"]              = cfg.fs_hz;
   doc["acq"]["mag_rms_threshold"]  = cfg.mag_rms_threshold;
+  doc["acq"]["mode"]               = cfg.acq_mode;
+  doc["acq"]["long_s"]             = cfg.long_s;
+  doc["acq"]["upload_s"]           = cfg.upload_s;
+  doc["acq"]["trend_hz"]           = cfg.trend_hz;
+  doc["acq"]["trend_batch"]        = cfg.trend_batch;
+  acqProfilesToJsonArray(doc["acq"]["profiles"].to<JsonArray>());
+  doc["acq"]["pyr_factor"]         = cfg.pyr_factor;
+
+  // pipeline
+  pipelineSpecsToJsonArray(doc["pipeline"]["stages"].to<JsonArray>());
+
+  // spectrum
+  doc["spectrum"]["nfft"]       = cfg.spec_nfft;
+  doc["spectrum"]["f_lo_hz"]    = cfg.spec_f_lo_hz;
+  doc["spectrum"]["f_hi_hz"]    = cfg.spec_f_hi_hz;
+  doc["spectrum"]["publish_ms"] = cfg.spec_publish_ms;
+  doc["spectrum"]["engine"]     = cfg.spec_engine;
+
+  // link
+  doc["link"]["mode"]     = cfg.link_mode;
+  doc["link"]["target_s"] = cfg.link_target_s;
+
+  // bulk upload
+  doc["upload"]["url"]   = cfg.upload_url;
+  doc["upload"]["token"] = cfg.upload_token;
 
   // sleep
   doc["sleep"]["seconds"] = cfg.sleep_s;
@@ -523,57 +777,242 @@ static bool saveConfigToFS() {
 }
 
 
-static void handleSave() {
-  // Actualiza cfg solo con campos no vacíos
-  applyIfProvided("device.client_id", cfg.client_id);
+// Settings that only a restart applies cleanly (WiFi/TLS/MQTT identity)
+static String netFingerprint(const Config& c) {
+  return c.client_id + '\n' + c.wifi_ssid + '\n' + c.wifi_password + '\n' +
+         c.mqtt_host + '\n' + String(c.mqtt_port) + '\n' + c.mqtt_user + '\n' +
+         c.mqtt_pass + '\n' + c.ca_path;
+}
 
-  applyIfProvided("wifi.ssid", cfg.wifi_ssid);
-  applyIfProvided("wifi.password", cfg.wifi_password);
+// Settings that need the LIS331 re-initialized
+static String sensorFingerprint(const Config& c) {
+  return c.sensor_bus + '\n' + String(c.i2c_addr) + '\n' + String(c.spi_cs) + '\n' +
+         String(c.spi_hz) + '\n' + String(c.range_g);
+}
+
+// Everything else is read from cfg when used: only the sensor and the
+// pipeline hold state built from it
+static String applyLive(bool sensor_changed) {
+  String s;
+  if (sensor_changed && lis_ready) {
+    lis_ready = false;
+    s += initLIS331() ? "sensor re-initialized; " : "sensor re-init FAILED (check sensor.*); ";
+  }
+  if (buildPipeline()) {
+    char desc[96];
+    pipeline.describe(desc, sizeof(desc));
+    s += "pipeline ";
+    s += desc;
+  } else {
+    s += "pipeline build FAILED";
+  }
+  return s;
+}
 
-  applyIfProvided("mqtt.host", cfg.mqtt_host);
-  applyU16IfProvided("mqtt.port", cfg.mqtt_port, 1, 65535);
-  applyIfProvided("mqtt.username", cfg.mqtt_user);
-  applyIfProvided("mqtt.password", cfg.mqtt_pass);
-  applyIfProvided("mqtt.topic", cfg.mqtt_topic);
+static void handleSave() {
+  portal_activity_ms = millis();
+  // The form is parsed into a copy and checked as a whole: a rejected save
+  // leaves the running config untouched (static: Config is ~2 KB)
+  static Config next;
+  next = cfg;
+
+  // Actualiza la copia solo con campos no vacíos
+  applyIfProvided("device.client_id", next.client_id);
+
+  applyIfProvided("wifi.ssid", next.wifi_ssid);
+  applyIfProvided("wifi.password", next.wifi_password);
+
+  applyIfProvided("mqtt.host", next.mqtt_host);
+  applyU16IfProvided("mqtt.port", next.mqtt_port, 1, 65535);
+  applyIfProvided("mqtt.username", next.mqtt_user);
+  applyIfProvided("mqtt.password", next.mqtt_pass);
+  applyIfProvided("mqtt.topic", next.mqtt_topic);
+
+  applyIfProvided("tls.ca_path", next.ca_path);
+
+  applyIfProvided("sensor.bus", next.sensor_bus);
+  applyI2CAddrIfProvided("sensor.i2c_addr", next.i2c_addr);
+  applyU8IfProvided("sensor.spi_cs", next.spi_cs, 0, 48);
+  applyUIntIfProvided("sensor.spi_hz", next.spi_hz, 100000, 10000000);
+  applyU8IfProvided("sensor.range_g", next.range_g, 6, 24); // luego clamp a 6/12/24
+  uint8_t auto_range = next.auto_range ? 1 : 0;
+  if (applyU8IfProvided("sensor.auto_range", auto_range, 0, 1)) next.auto_range = (auto_range != 0);
+
+  applyIfProvided("ntp.server1", next.ntp_server1);
+  applyIfProvided("ntp.server2", next.ntp_server2);
+  applyIfProvided("ntp.server3", next.ntp_server3);
+  applyU16IfProvided("ntp.timeout_s", next.ntp_timeout_s, 3, 60);
+
+  applyU16IfProvided("acq.n_samples", next.n_samples, 10, ACQ_MAX_SAMPLES);
+  applyU16IfProvided("acq.fs_hz", next.fs_hz, 50, 2000);
+  applyFloatIfProvided("acq.mag_rms_threshold", next.mag_rms_threshold, 0.0f, 50.0f);
+  applyIfProvided("acq.mode", next.acq_mode);
+  applyU16IfProvided("acq.long_s", next.long_s, 1, 3600);
+  applyU16IfProvided("acq.upload_s", next.upload_s, 5, 600);
+  applyFloatIfProvided("acq.trend_hz", next.trend_hz, 0.1f, 10.0f);
+  applyU16IfProvided("acq.trend_batch", next.trend_batch, 1, TREND_MAX);
+  applyU16IfProvided("acq.pyr_factor", next.pyr_factor, 0, 100);
+
+  applyU16IfProvided("spectrum.nfft", next.spec_nfft, 64, 1024);
+  applyFloatIfProvided("spectrum.f_lo_hz", next.spec_f_lo_hz, 0.0f, 1000.0f);
+  applyFloatIfProvided("spectrum.f_hi_hz", next.spec_f_hi_hz, 0.0f, 1000.0f);
+  applyU16IfProvided("spectrum.publish_ms", next.spec_publish_ms, 20, 60000);
+  applyIfProvided("spectrum.engine", next.spec_engine);
+
+  applyIfProvided("link.mode", next.link_mode);
+  applyU16IfProvided("link.target_s", next.link_target_s, 1, 120);
+
+  applyIfProvided("upload.url", next.upload_url);
+  applyIfProvided("upload.token", next.upload_token);
+
+  applyUIntIfProvided("sleep.seconds", next.sleep_s, 5, 86400);
+
+  String profilesJson;
+  if (applyIfProvided("acq.profiles", profilesJson)) {
+    JsonDocument pd;
+    AcqProfile profiles[ACQ_MAX_PROFILES];
+    uint8_t n = 0;
+    if (deserializeJson(pd, profilesJson) || !parseAcqProfiles(pd.as<JsonVariantConst>(), profiles, n)) {
+      web.send(400, "text/plain", "Invalid acq.profiles JSON.\n");
+      return;
+    }
+    for (uint8_t i = 0; i < n; i++) next.profiles[i] = profiles[i];
+    next.n_profiles = n;
+  }
 
-  applyIfProvided("tls.ca_path", cfg.ca_path);
+  String stagesJson;
+  if (applyIfProvided("pipeline.stages", stagesJson)) {
+    JsonDocument sd;
+    vib::pipe::StageSpec specs[vib::pipe::kMaxStages];
+    uint8_t n = 0;
+    if (deserializeJson(sd, stagesJson) || !parsePipelineSpecs(sd.as<JsonVariantConst>(), specs, n)) {
+      web.send(400, "text/plain", "Invalid pipeline.stages JSON.\n");
+      return;
+    }
+    for (uint8_t i = 0; i < n; i++) next.pipeline_specs[i] = specs[i];
+    next.pipeline_n = n;
+  }
 
-  applyI2CAddrIfProvided("sensor.i2c_addr", cfg.i2c_addr);
-  applyU8IfProvided("sensor.range_g", cfg.range_g, 6, 24); // luego clamp a 6/12/24
+  // Normaliza range_g a {6,12,24}
+  if (next.range_g != 6 && next.range_g != 12 && next.range_g != 24) next.range_g = 24;
 
-  applyIfProvided("ntp.server1", cfg.ntp_server1);
-  applyIfProvided("ntp.server2", cfg.ntp_server2);
-  applyIfProvided("ntp.server3", cfg.ntp_server3);
-  applyU16IfProvided("ntp.timeout_s", cfg.ntp_timeout_s, 3, 60);
+  // Normaliza bus a {i2c,spi}
+  next.sensor_bus.toLowerCase();
+  if (next.sensor_bus != "spi") next.sensor_bus = "i2c";
 
-  applyU16IfProvided("acq.n_samples", cfg.n_samples, 10, 2000);
-  applyU16IfProvided("acq.fs_hz", cfg.fs_hz, 50, 2000);
-  applyFloatIfProvided("acq.mag_rms_threshold", cfg.mag_rms_threshold, 0.0f, 50.0f);
+  next.acq_mode.toLowerCase();
+  if (next.acq_mode != "long" && next.acq_mode != "trend" && next.acq_mode != "spectrum") next.acq_mode = "burst";
 
-  applyUIntIfProvided("sleep.seconds", cfg.sleep_s, 5, 86400);
+  next.spec_nfft = (uint16_t)vib::spec::floor_pow2(next.spec_nfft);   // 64..1024 already
+  next.spec_engine.toLowerCase();
+  if (next.spec_engine != "sliding" && next.spec_engine != "fft") next.spec_engine = "auto";
 
-  // Normaliza range_g a {6,12,24}
-  if (cfg.range_g != 6 && cfg.range_g != 12 && cfg.range_g != 24) cfg.range_g = 24;
+  next.link_mode.toLowerCase();
+  if (next.link_mode != "fixed") next.link_mode = "auto";
+  // An empty field keeps the value, so "off" clears it
+  if (next.upload_url == "off") next.upload_url = "";
+  if (next.upload_token == "off") next.upload_token = "";
 
   // Validaciones mínimas requeridas
-  if (cfg.wifi_ssid.isEmpty() || cfg.mqtt_host.isEmpty()) {
+  if (next.wifi_ssid.isEmpty() || next.mqtt_host.isEmpty()) {
     web.send(400, "text/plain", "Missing required fields: wifi.ssid and mqtt.host must be set.\n");
     return;
   }
 
+  // Compared with what is running, then made the running config
+  const bool net_changed = netFingerprint(next) != netFingerprint(cfg);
+  const bool sensor_changed = sensorFingerprint(next) != sensorFingerprint(cfg);
+  std::swap(cfg, next);
+
   // Guarda JSON
   if (!saveConfigToFS()) {
+    std::swap(cfg, next);
     web.send(500, "text/plain", "Failed to write /config.json\n");
     return;
   }
 
-  portal_saved = true;
-  web.send(200, "text/plain", "Saved. Restarting...\n");
+  if (net_changed) {
+    portal_saved = true;
+    web.send(200, "text/plain", "Saved. Network settings changed: restarting...\n");
+    return;
+  }
+
+  portal_applied = true;
+  portal_status = "Saved and applied: " + applyLive(sensor_changed);
+  Serial.println(portal_status);
+  web.sendHeader("Location", "/", true);
+  web.send(303, "text/plain", "");
+}
+
+// One capture with the live settings (first profile if acq.profiles is set)
+static void handleMeasure() {
+  portal_activity_ms = millis();
+  if (!lis_ready && !initLIS331()) {
+    web.send(500, "text/plain", "Sensor init failed: check sensor.*\n");
+    return;
+  }
+  const uint16_t fs = cfg.n_profiles ? cfg.profiles[0].fs_hz : cfg.fs_hz;
+  const uint16_t n = cfg.n_profiles ? cfg.profiles[0].n_samples : cfg.n_samples;
+  bool pass = false;
+  uint8_t next_range_g = 0;
+  portal_dry_run = true;
+  const bool ok = runCapture(fs, n, pass, next_range_g);
+  portal_dry_run = false;
+  portal_activity_ms = millis();
+  if (!ok) {
+    web.send(500, "text/plain", "Capture failed\n");
+    return;
+  }
+
+  const vib::pipe::Frame& f = last_capture;
+  char desc[96];
+  pipeline.describe(desc, sizeof(desc));
+  char b[160];
+  String out;
+  snprintf(b, sizeof(b), "%u samples @ %u Hz, %ug, pipeline %s\n", (unsigned)f.n, (unsigned)f.fs_hz,
+           (unsigned)f.range_g, desc);
+  out += b;
+  if (f.feat.valid & vib::pipe::FEAT_RMS) {
+    snprintf(b, sizeof(b), "mag_rms: %.3f m/s^2 (threshold %.2f)\n", f.feat.mag_rms_mps2, cfg.mag_rms_threshold);
+    out += b;
+  }
+  if (f.feat.valid & vib::pipe::FEAT_PEAK) {
+    snprintf(b, sizeof(b), "peak: x=%ld y=%ld z=%ld mg, clipped %lu\n", (long)f.feat.peak_mg[0],
+             (long)f.feat.peak_mg[1], (long)f.feat.peak_mg[2], (unsigned long)f.feat.clip);
+    out += b;
+  }
+  if (f.feat.valid & vib::pipe::FEAT_SPEED) {
+    snprintf(b, sizeof(b), "speed: %.1f rpm (conf %.2f)\n", f.feat.speed_hz * 60.0f, f.feat.speed_conf);
+    out += b;
+  }
+  if (f.feat.valid & vib::pipe::FEAT_KURT) {
+    snprintf(b, sizeof(b), "kurtogram: %.1f-%.1f Hz on %c, SK=%.2f\n", f.feat.kurt_f_lo_hz,
+             f.feat.kurt_f_hi_hz, "xyz"[f.feat.kurt_axis], f.feat.kurt);
+    out += b;
+  }
+  snprintf(b, sizeof(b), "gate: %s%s%s\n", pass ? "pass (would publish)" : "closed (would not publish)",
+           f.stopped_by ? ", stopped by " : "", f.stopped_by ? f.stopped_by : "");
+  out += b;
+  snprintf(b, sizeof(b), "timing: dt sd %.1f us, missed %lu, filter saturations %lu\n", f.timing.dt_sd_us(),
+           (unsigned long)f.timing.missed, (unsigned long)f.filt_sat);
+  out += b;
+  web.send(200, "text/plain", out);
+}
+
+static void handleDone() {
+  portal_done = true;
+  web.send(200, "text/plain", "Leaving the portal: starting a normal wake with these settings.\n");
 }
 
+// Returns true when a restart is needed (network settings were saved).
+// Other saves are applied live; portal_applied / portal_done tell the caller
+// whether to carry on with this wake.
 static bool startConfigAPPortal(uint32_t timeout_s = 300) {
   blinkStart(C_PURPLE(), 250, 250); // provisioning = morado parpadeando
   portal_saved = false;
+  portal_applied = false;
+  portal_done = false;
+  portal_status = "";
 
   // AP config
   WiFi.mode(WIFI_AP);
@@ -592,6 +1031,8 @@ static bool startConfigAPPortal(uint32_t timeout_s = 300) {
 
   web.on("/", HTTP_GET, handleRoot);
   web.on("/save", HTTP_POST, handleSave);
+  web.on("/measure", HTTP_GET, handleMeasure);
+  web.on("/done", HTTP_POST, handleDone);
   web.onNotFound([]() {
     web.sendHeader("Location", String("http://") + WiFi.softAPIP().toString() + "/", true);
     web.send(302, "text/plain", "");
@@ -599,14 +1040,16 @@ static bool startConfigAPPortal(uint32_t timeout_s = 300) {
 
   web.begin();
 
-  uint32_t t0 = millis();
-  while ((millis() - t0) < timeout_s * 1000UL) {
+  // timeout_s counts from the last request, so a session of edits and test
+  // captures is not cut short
+  portal_activity_ms = millis();
+  while ((millis() - portal_activity_ms) < timeout_s * 1000UL) {
     dns.processNextRequest();
     web.handleClient();
     blinkTick();   // <-- mantiene el parpadeo sin bloquear
     delay(5);
 
-    if (portal_saved) break;
+    if (portal_saved || portal_done) break;
   }
 
   web.stop();
@@ -667,8 +1110,12 @@ static bool loadConfig() {
 
   cfg.ca_path       = doc["tls"]["ca_path"] | String("/ca.pem");
 
+  cfg.sensor_bus    = doc["sensor"]["bus"] | String("i2c");
   cfg.i2c_addr      = doc["sensor"]["i2c_addr"] | 0x18;
+  cfg.spi_cs        = doc["sensor"]["spi_cs"] | 10;
+  cfg.spi_hz        = doc["sensor"]["spi_hz"] | 8000000UL;
   cfg.range_g       = doc["sensor"]["range_g"] | 24;
+  cfg.auto_range    = doc["sensor"]["auto_range"] | false;
 
   cfg.ntp_server1   = doc["ntp"]["server1"] | String("pool.ntp.org");
   cfg.ntp_server2   = doc["ntp"]["server2"] | String("time.nist.gov");
@@ -678,25 +1125,85 @@ static bool loadConfig() {
   cfg.n_samples     = doc["acq"]["n_samples"] | 500;
   cfg.fs_hz         = doc["acq"]["fs_hz"] | 1000;
   cfg.mag_rms_threshold = doc["acq"]["mag_rms_threshold"] | 10.78f;
+  cfg.acq_mode      = doc["acq"]["mode"] | String("burst");
+  cfg.long_s        = doc["acq"]["long_s"] | 120;
+  cfg.upload_s      = doc["acq"]["upload_s"] | 60;
+  cfg.trend_hz      = doc["acq"]["trend_hz"] | 1.0f;
+  cfg.trend_batch   = doc["acq"]["trend_batch"] | TREND_MAX;
+  cfg.pyr_factor    = doc["acq"]["pyr_factor"] | 10;
+
+  cfg.spec_nfft       = doc["spectrum"]["nfft"] | 512;
+  cfg.spec_f_lo_hz    = doc["spectrum"]["f_lo_hz"] | 0.0f;
+  cfg.spec_f_hi_hz    = doc["spectrum"]["f_hi_hz"] | 0.0f;
+  cfg.spec_publish_ms = doc["spectrum"]["publish_ms"] | 250;
+  cfg.spec_engine     = doc["spectrum"]["engine"] | String("auto");
+
+  cfg.link_mode     = doc["link"]["mode"] | String("auto");
+  cfg.link_target_s = doc["link"]["target_s"] | 8;
+
+  cfg.upload_url    = doc["upload"]["url"] | String("");
+  cfg.upload_token  = doc["upload"]["token"] | String("");
 
   cfg.sleep_s       = doc["sleep"]["seconds"] | 300;
 
+  if (!parseAcqProfiles(doc["acq"]["profiles"], cfg.profiles, cfg.n_profiles)) {
+    Serial.println("config.json: invalid acq.profiles, using acq.fs_hz/n_samples");
+    cfg.n_profiles = 0;
+  }
+
+  if (!parsePipelineSpecs(doc["pipeline"]["stages"], cfg.pipeline_specs, cfg.pipeline_n)) {
+    Serial.println("config.json: invalid pipeline.stages, using default pipeline");
+    cfg.pipeline_n = 0;
+  }
+
   if (cfg.wifi_ssid.isEmpty() || cfg.mqtt_host.isEmpty()) {
     Serial.println("Config missing required fields (wifi.ssid or mqtt.host)");
     return false;
   }
 
+  cfg.sensor_bus.toLowerCase();
+  if (cfg.sensor_bus != "spi") cfg.sensor_bus = "i2c";
+  if (cfg.spi_hz < 100000UL) cfg.spi_hz = 100000UL;
+  if (cfg.spi_hz > 10000000UL) cfg.spi_hz = 10000000UL;
+
   if (cfg.ntp_timeout_s < 3) cfg.ntp_timeout_s = 3;
   if (cfg.ntp_timeout_s > 60) cfg.ntp_timeout_s = 60;
 
   if (cfg.n_samples < 10) cfg.n_samples = 10;
-  if (cfg.n_samples > 2000) cfg.n_samples = 2000; // safety
+  if (cfg.n_samples > ACQ_MAX_SAMPLES) cfg.n_samples = ACQ_MAX_SAMPLES; // buffer size
   if (cfg.fs_hz < 50) cfg.fs_hz = 50;
   if (cfg.fs_hz > 2000) cfg.fs_hz = 2000;
 
+  cfg.acq_mode.toLowerCase();
+  if (cfg.acq_mode != "long" && cfg.acq_mode != "trend" && cfg.acq_mode != "spectrum") cfg.acq_mode = "burst";
+  if (cfg.long_s < 1) cfg.long_s = 1;
+  if (cfg.long_s > 3600) cfg.long_s = 3600;
+  if (cfg.upload_s < 5) cfg.upload_s = 5;
+  if (cfg.upload_s > 600) cfg.upload_s = 600;
+  if (cfg.trend_hz < 0.1f) cfg.trend_hz = 0.1f;
+  if (cfg.trend_hz > 10.0f) cfg.trend_hz = 10.0f;
+  if (cfg.trend_batch < 1) cfg.trend_batch = 1;
+  if (cfg.trend_batch > TREND_MAX) cfg.trend_batch = TREND_MAX;
+  if (cfg.pyr_factor == 1) cfg.pyr_factor = 0;
+  if (cfg.pyr_factor > 100) cfg.pyr_factor = 100;
+
   if (cfg.mag_rms_threshold < 0.0f)     cfg.mag_rms_threshold = 0.0f;
   if (cfg.mag_rms_threshold > 50.0f)    cfg.mag_rms_threshold = 50.0f; // sanity
 
+  if (cfg.spec_nfft < 64) cfg.spec_nfft = 64;
+  if (cfg.spec_nfft > 1024) cfg.spec_nfft = 1024;
+  cfg.spec_nfft = (uint16_t)vib::spec::floor_pow2(cfg.spec_nfft);
+  if (cfg.spec_f_lo_hz < 0.0f) cfg.spec_f_lo_hz = 0.0f;
+  if (cfg.spec_f_hi_hz < 0.0f) cfg.spec_f_hi_hz = 0.0f;
+  if (cfg.spec_publish_ms < 20) cfg.spec_publish_ms = 20;
+  cfg.spec_engine.toLowerCase();
+  if (cfg.spec_engine != "sliding" && cfg.spec_engine != "fft") cfg.spec_engine = "auto";
+
+  cfg.link_mode.toLowerCase();
+  if (cfg.link_mode != "fixed") cfg.link_mode = "auto";
+  if (cfg.link_target_s < 1) cfg.link_target_s = 1;
+  if (cfg.link_target_s > 120) cfg.link_target_s = 120;
+
   if (cfg.sleep_s < 5) cfg.sleep_s = 5;
 
   return true;
@@ -712,11 +1219,172 @@ static bool loadCA() {
   return true;
 }
 
+// -------------------------
+// Radio power per phase
+// -------------------------
+// The handshake (association, DHCP, NTP, TLS) runs at full TX power without
+// power save (rung 0). Once MQTT is up the radio moves to a learned rung of
+// RADIO_LADDER; new sites start at the Arduino defaults (full power, modem
+// sleep). A wake whose publishes all succeed counts toward one rung down
+// (lower TX power), taken after RADIO_OK_WAKES clean wakes if the estimated
+// RSSI at the AP keeps RADIO_MIN_RSSI; a failed publish restores rung 0 for
+// the rest of the wake and moves the learned rung up one, down to rung 0
+// (no modem sleep) on links where even the defaults fail. The rung is kept
+// per access point (BSSID hash) in RTC memory.
+//
+// Energy accounting: radio-on time per phase and time spent in publish
+// writes (a proxy for TX airtime), times a current model of the rung in
+// use (typical ESP32-S3 figures, not measured), next to the same phases at
+// the default settings. The previous wake's totals go in the meta.
+struct RadioRung {
+  wifi_power_t tx;
+  bool modem_sleep;
+  float tx_dbm;
+  float ma_idle;    // connected, not transmitting (CPU included)
+  float ma_tx;      // while transmitting
+};
+
+static const RadioRung RADIO_LADDER[] = {
+  { WIFI_POWER_19_5dBm, false, 19.5f, 100.0f, 300.0f },   // handshake
+  { WIFI_POWER_19_5dBm, true,  19.5f,  45.0f, 300.0f },   // Arduino defaults
+  { WIFI_POWER_17dBm,   true,  17.0f,  45.0f, 265.0f },
+  { WIFI_POWER_15dBm,   true,  15.0f,  45.0f, 240.0f },
+  { WIFI_POWER_13dBm,   true,  13.0f,  45.0f, 220.0f },
+  { WIFI_POWER_11dBm,   true,  11.0f,  45.0f, 205.0f },
+  { WIFI_POWER_8_5dBm,  true,   8.5f,  45.0f, 190.0f },
+};
+static constexpr uint8_t RADIO_RUNGS = sizeof(RADIO_LADDER) / sizeof(RADIO_LADDER[0]);
+static constexpr uint8_t RADIO_DEFAULT_RUNG = 1;
+static constexpr uint32_t RADIO_MAGIC = 0x31444152;   // "RAD1"
+static constexpr uint8_t RADIO_OK_WAKES = 3;
+static constexpr int RADIO_MIN_RSSI = -75;            // estimated at the AP, dBm
+
+struct RadioRtc {
+  uint32_t magic;
+  uint32_t site;        // BSSID hash the rung was learned on
+  uint8_t rung;
+  uint8_t ok_wakes;
+  uint16_t fails;
+  float last_mC;        // previous wake: modelled radio charge
+  float last_base_mC;   // same phases at the default settings
+};
+
+static RTC_DATA_ATTR RadioRtc radio_rtc;
+static bool radio_on = false;
+static bool radio_send = false;      // past the handshake
+static bool radio_fail = false;      // a publish failed below full power
+static uint32_t radio_pub_ok = 0;    // publishes that succeeded in the send phase
+static uint8_t radio_rung = 0;       // applied now
+static int64_t radio_t0 = 0;         // start of the current segment
+static uint64_t radio_tx_us = 0;     // publish write time in the segment
+static float radio_mC = 0.0f;
+static float radio_base_mC = 0.0f;
+
+static void radioApply(uint8_t rung) {
+  radio_rung = rung;
+  WiFi.setSleep(RADIO_LADDER[rung].modem_sleep);
+  WiFi.setTxPower(RADIO_LADDER[rung].tx);
+}
+
+// Closes the current segment at the rung in use
+static void radioAccount() {
+  const int64_t now = esp_timer_get_time();
+  const float t_s = (float)(now - radio_t0) / 1e6f;
+  const float tx_s = (float)radio_tx_us / 1e6f;
+  const RadioRung& r = RADIO_LADDER[radio_rung];
+  const RadioRung& b = RADIO_LADDER[RADIO_DEFAULT_RUNG];
+  radio_mC += t_s * r.ma_idle + tx_s * (r.ma_tx - r.ma_idle);
+  radio_base_mC += t_s * b.ma_idle + tx_s * (b.ma_tx - b.ma_idle);
+  radio_t0 = now;
+  radio_tx_us = 0;
+}
+
+static uint32_t radioSite() {
+  const String bssid = WiFi.BSSIDstr();
+  uint32_t h = 2166136261u;   // FNV-1a
+  for (size_t i = 0; i < bssid.length(); i++) { h ^= (uint8_t)bssid[i]; h *= 16777619u; }
+  return h;
+}
+
+// Right after WiFi.mode(WIFI_STA)
+static void radioBeginHandshake() {
+  radio_on = true;
+  radio_send = false;
+  radio_fail = false;
+  radio_pub_ok = 0;
+  radio_mC = radio_base_mC = 0.0f;
+  radio_t0 = esp_timer_get_time();
+  radio_tx_us = 0;
+  radioApply(0);
+}
+
+// Once MQTT is connected: switch to the learned rung for this AP
+static void radioBeginSend() {
+  if (!radio_on || radio_send) return;
+  radioAccount();
+  const uint32_t site = radioSite();
+  if (radio_rtc.magic != RADIO_MAGIC || radio_rtc.site != site || radio_rtc.rung >= RADIO_RUNGS) {
+    memset(&radio_rtc, 0, sizeof(radio_rtc));
+    radio_rtc.magic = RADIO_MAGIC;
+    radio_rtc.site = site;
+    radio_rtc.rung = RADIO_DEFAULT_RUNG;
+  }
+  radio_send = true;
+  radioApply(radio_rtc.rung);
+  Serial.printf("radio: send phase at %.1f dBm, modem sleep %s (rung %u/%u)\n",
+                RADIO_LADDER[radio_rung].tx_dbm, RADIO_LADDER[radio_rung].modem_sleep ? "on" : "off",
+                (unsigned)radio_rung, (unsigned)(RADIO_RUNGS - 1));
+}
+
+// Every publish: write time, and back to full power if one fails below it
+static void radioNoteTx(uint32_t us, bool ok) {
+  radio_tx_us += us;
+  if (ok && radio_send) radio_pub_ok++;
+  if (ok || !radio_send || radio_rung == 0) return;
+  radioAccount();
+  radio_fail = true;
+  radioApply(0);
+  Serial.println("radio: publish failed, back to full power");
+}
+
+// Before the radio goes off: closes the accounting and updates the rung
+static void radioEnd() {
+  if (!radio_on) return;
+  radioAccount();
+  radio_on = false;
+
+  // A wake that published nothing proves nothing about the rung: it neither
+  // counts toward stepping down nor resets the count
+  if (radio_send) {
+    const uint8_t learned = radio_rtc.rung;
+    if (radio_fail) {
+      if (radio_rtc.rung > 0) radio_rtc.rung--;
+      radio_rtc.ok_wakes = 0;
+      if (radio_rtc.fails < 0xFFFF) radio_rtc.fails++;
+    } else if (radio_pub_ok && ++radio_rtc.ok_wakes >= RADIO_OK_WAKES) {
+      radio_rtc.ok_wakes = 0;
+      // A lower TX power reaches the AP that much weaker (symmetric path)
+      const uint8_t next = learned + 1;
+      if (next < RADIO_RUNGS &&
+          (int)WiFi.RSSI() - (int)(RADIO_LADDER[0].tx_dbm - RADIO_LADDER[next].tx_dbm) >= RADIO_MIN_RSSI) {
+        radio_rtc.rung = next;
+      }
+    }
+    radio_rtc.last_mC = radio_mC;
+    radio_rtc.last_base_mC = radio_base_mC;
+  }
+  Serial.printf("radio: ~%.0f mC this wake, ~%.0f mC at default settings (%+.0f%%); next rung %u\n",
+                radio_mC, radio_base_mC,
+                radio_base_mC > 0.0f ? 100.0f * (radio_mC / radio_base_mC - 1.0f) : 0.0f,
+                (unsigned)radio_rtc.rung);
+}
+
 // -------------------------
 // Helpers: WiFi / MQTT
 // -------------------------
 static bool connectWiFi(uint32_t timeout_ms = 20000) {
   WiFi.mode(WIFI_STA);
+  radioBeginHandshake();
   WiFi.begin(cfg.wifi_ssid.c_str(), cfg.wifi_password.c_str());
 
   uint32_t t0 = millis();
@@ -787,6 +1455,45 @@ static uint64_t epochUsNow() {
   return (uint64_t)tv.tv_sec * 1000000ULL + (uint64_t)tv.tv_usec;
 }
 
+// -------------------------
+// Clock correlation: wall clock <-> esp_timer
+// -------------------------
+// Capture times are taken on the monotonic esp_timer and mapped to the epoch
+// through a vib::clk::Model instead of reading gettimeofday() next to it: the
+// model knows the error of the mapping, follows a slew of the wall clock and
+// notices a step. It is anchored right after NTP and refreshed around each
+// capture.
+static const int CLOCK_TRIES = 8;   // bracketed reads per pair, the narrowest is kept
+static vib::clk::Model clock_model;
+
+static vib::clk::Pair clockSample() {
+  return vib::clk::sample([]() { return (int64_t)esp_timer_get_time(); },
+                          []() { return (int64_t)epochUsNow(); },
+                          CLOCK_TRIES);
+}
+
+static void clockUpdate() {
+  if (!clock_model.update(clockSample())) {
+    Serial.printf("clock: wall clock stepped by %lld us, model re-anchored\n",
+                  (long long)clock_model.last_resid_us());
+  }
+}
+
+static void clockAnchor() {
+  clock_model.reset();
+  clockUpdate();
+  Serial.printf("clock: anchored, pair width %lu us\n",
+                (unsigned long)clock_model.anchor_pair().width_us);
+}
+
+// Epoch at a monotonic time (the wall clock itself until the model is anchored)
+static uint64_t clockEpochAt(int64_t mono_us) {
+  if (!clock_model.valid()) return epochUsNow() - (uint64_t)(esp_timer_get_time() - mono_us);
+  return (uint64_t)clock_model.epoch_at(mono_us);
+}
+
+static uint64_t clockEpochNow() { return clockEpochAt(esp_timer_get_time()); }
+
 static void formatISO8601UTC(time_t t, char* out, size_t out_len) {
   struct tm tm_utc;
   gmtime_r(&t, &tm_utc);
@@ -815,36 +1522,126 @@ static void formatISO8601UTC_us(uint64_t epoch_us, char* out, size_t out_len) {
 // -------------------------
 // Helpers: Sensor
 // -------------------------
+// The Adafruit driver is only used for probing/configuration. Sample reads go
+// through lisReadRaw(): one 6-byte burst from OUT_X_L with address
+// auto-increment, no float conversion and no range register read per sample
+// (getEvent() does both). On SPI @ 8 MHz a burst is a few microseconds; on
+// I2C @ 400 kHz it is still ~200 us, dominated by the bus itself.
+static constexpr uint8_t LIS331_REG_CTRL4  = 0x23;
+static constexpr uint8_t LIS331_REG_OUT_X_L = 0x28;
+
+static bool lis_use_spi = false;
+static SPISettings lis_spi_settings(8000000, MSBFIRST, SPI_MODE3);
+static int16_t lis_mg_per_digit = 12;   // datasheet So for 12-bit data: 3/6/12 mg/digit
+
+static void lisReadBytes(uint8_t reg, uint8_t* out, size_t len) {
+  if (lis_use_spi) {
+    // bit7 = read, bit6 = auto-increment (SPI)
+    uint8_t tx[8] = {0};
+    uint8_t rx[8] = {0};
+    tx[0] = (uint8_t)(reg | 0x80 | (len > 1 ? 0x40 : 0x00));
+    SPI.beginTransaction(lis_spi_settings);
+    digitalWrite(cfg.spi_cs, LOW);
+    SPI.transferBytes(tx, rx, (uint32_t)(len + 1));
+    digitalWrite(cfg.spi_cs, HIGH);
+    SPI.endTransaction();
+    memcpy(out, &rx[1], len);
+    return;
+  }
+
+  // bit7 = auto-increment (I2C)
+  Wire.beginTransmission(cfg.i2c_addr);
+  Wire.write((uint8_t)(reg | (len > 1 ? 0x80 : 0x00)));
+  Wire.endTransmission(false);
+  Wire.requestFrom(cfg.i2c_addr, len);
+  for (size_t i = 0; i < len; i++) {
+    out[i] = Wire.available() ? (uint8_t)Wire.read() : 0;
+  }
+}
+
+static void lisWriteReg(uint8_t reg, uint8_t v) {
+  if (lis_use_spi) {
+    uint8_t tx[2] = { (uint8_t)(reg & 0x3F), v };
+    uint8_t rx[2];
+    SPI.beginTransaction(lis_spi_settings);
+    digitalWrite(cfg.spi_cs, LOW);
+    SPI.transferBytes(tx, rx, 2);
+    digitalWrite(cfg.spi_cs, HIGH);
+    SPI.endTransaction();
+    return;
+  }
+
+  Wire.beginTransmission(cfg.i2c_addr);
+  Wire.write(reg);
+  Wire.write(v);
+  Wire.endTransmission();
+}
+
+// Raw OUT_X/Y/Z: 12-bit left-justified two's complement
+static inline void lisReadRaw(int16_t raw[3]) {
+  uint8_t b[6];
+  lisReadBytes(LIS331_REG_OUT_X_L, b, sizeof(b));
+  raw[0] = (int16_t)((uint16_t)b[0] | ((uint16_t)b[1] << 8));
+  raw[1] = (int16_t)((uint16_t)b[2] | ((uint16_t)b[3] << 8));
+  raw[2] = (int16_t)((uint16_t)b[4] | ((uint16_t)b[5] << 8));
+}
+
+// Raw counts -> mg (int16), shared with the host tools
+static inline int16_t lisRawToMg(int16_t raw) {
+  return vib::fx::raw_to_mg(raw, lis_mg_per_digit);
+}
+
+// Configure ODR closer to target
+static void lisSetDataRate(uint16_t fs_hz) {
+  if (fs_hz >= 1000) lis.setDataRate(LIS331_DATARATE_1000_HZ);
+  else if (fs_hz >= 400) lis.setDataRate(LIS331_DATARATE_400_HZ);
+  else if (fs_hz >= 100) lis.setDataRate(LIS331_DATARATE_100_HZ);
+  else lis.setDataRate(LIS331_DATARATE_50_HZ);
+}
+
 static bool initLIS331() {
-  Wire.begin();
-  Wire.setClock(400000);
+  lis_use_spi = (cfg.sensor_bus == "spi");
 
-  if (!lis.begin_I2C(cfg.i2c_addr)) {
-    Serial.println("LIS331HH begin_I2C failed");
-    return false;
+  if (lis_use_spi) {
+    SPI.begin();
+    pinMode(cfg.spi_cs, OUTPUT);
+    digitalWrite(cfg.spi_cs, HIGH);
+    lis_spi_settings = SPISettings(cfg.spi_hz, MSBFIRST, SPI_MODE3);
+
+    if (!lis.begin_SPI(cfg.spi_cs, &SPI, cfg.spi_hz)) {
+      Serial.println("LIS331HH begin_SPI failed");
+      return false;
+    }
+  } else {
+    Wire.begin();
+    Wire.setClock(400000);
+
+    if (!lis.begin_I2C(cfg.i2c_addr)) {
+      Serial.println("LIS331HH begin_I2C failed");
+      return false;
+    }
   }
 
   if (cfg.range_g == 6) lis.setRange(LIS331HH_RANGE_6_G);
   else if (cfg.range_g == 12) lis.setRange(LIS331HH_RANGE_12_G);
   else lis.setRange(LIS331HH_RANGE_24_G);
 
-  // Configure ODR closer to target
-  if (cfg.fs_hz >= 1000) lis.setDataRate(LIS331_DATARATE_1000_HZ);
-  else if (cfg.fs_hz >= 400) lis.setDataRate(LIS331_DATARATE_400_HZ);
-  else if (cfg.fs_hz >= 100) lis.setDataRate(LIS331_DATARATE_100_HZ);
-  else lis.setDataRate(LIS331_DATARATE_50_HZ);
+  lis_mg_per_digit = (cfg.range_g == 6) ? 3 : (cfg.range_g == 12) ? 6 : 12;
 
-  return true;
-}
+  lisSetDataRate(cfg.fs_hz);
 
-// Convert m/s^2 -> mg (int16)
-static int16_t mps2_to_mg(float a_mps2) {
-  const float g0 = 9.80665f;
-  float mg = (a_mps2 / g0) * 1000.0f;
-  long v = lroundf(mg);
-  if (v > 32767) v = 32767;
-  if (v < -32768) v = -32768;
-  return (int16_t)v;
+  // BDU=1: output registers are not updated mid-burst (low/high bytes stay
+  // from the same sample). FS bits must be preserved.
+  uint8_t ctrl4 = 0;
+  lisReadBytes(LIS331_REG_CTRL4, &ctrl4, 1);
+  lisWriteReg(LIS331_REG_CTRL4, (uint8_t)(ctrl4 | 0x80));
+
+  Serial.print("LIS331HH on ");
+  Serial.print(lis_use_spi ? "SPI @ " : "I2C @ ");
+  Serial.print(lis_use_spi ? cfg.spi_hz : 400000UL);
+  Serial.println(" Hz");
+  lis_ready = true;
+  return true;
 }
 
 // -------------------------
@@ -854,21 +1651,214 @@ static inline void put_u16_le(uint8_t* dst, uint16_t v) {
   dst[0] = (uint8_t)(v & 0xFF);
   dst[1] = (uint8_t)((v >> 8) & 0xFF);
 }
-static inline void put_i16_le(uint8_t* dst, int16_t v) {
-  put_u16_le(dst, (uint16_t)v);
+
+// -------------------------
+// Store-and-forward area (/sf)
+// -------------------------
+// Blobs are published in chunks of SF_CHUNK bytes ({type, id, idx, parts,
+// crc}, crc = CRC-32 of the chunk payload, vib_crc.h).
+// Every capture is also stored as /sf/<id>.bin, keeping the last SF_KEEP.
+// The backend lists lost chunks as a retained JSON message on
+// <topic>/nack/<client_id>:
+//   {"missing":[{"id":"dev-123","type":"x","idx":2}, {"id":"dev-123","type":"meta"}]}
+// On the next connection the device resends only those chunks, then clears
+// the retained message.
+//
+// A capture cut short by a dropped connection is not sent again from the
+// start: its chunks are numbered in store-file order (meta = 1 chunk, then
+// each blob's parts) and the first one the connection did not take is kept
+// as its transmit cursor. The next connection resumes from there (txResume).
+//
+// Store file: entries of  type[4] | key[4] | u32le len | len bytes.
+// The "meta" entry holds the encoded meta message itself.
+static constexpr size_t SF_CHUNK = 1024;
+static constexpr size_t META_MAX = 1024;       // encoded meta message (publishMetaCbor)
+static constexpr uint8_t SF_KEEP = 8;
+static constexpr uint32_t SF_NACK_WAIT_MS = 500;
+static constexpr size_t SF_NACK_MAX = 4096;       // longest NACK acted on
+static constexpr uint16_t SF_NACK_BUF = 2 * SF_NACK_MAX;   // MQTT buffer while waiting
+static const char* SF_DIR = "/sf";
+static const char* SF_INDEX = "/sf/index.txt";
+static const char* SF_TX = "/sf/tx.json";      // copy of tx_rtc (survives power loss)
+
+static File sf_file;   // open while a capture is being published
+
+static inline uint16_t sfParts(size_t len) {
+  return len ? (uint16_t)((len + SF_CHUNK - 1) / SF_CHUNK) : 1;
+}
+
+// Transmit cursor of the capture being published
+static uint16_t tx_ord = 0;      // ordinal of the next chunk
+static uint16_t tx_next = 0;     // first chunk the connection did not take
+static bool tx_broken = false;   // a publish failed: later chunks are past the cursor
+
+static void txNote(bool ok) {
+  if (!ok) tx_broken = true;
+  else if (!tx_broken && tx_ord == tx_next) tx_next++;
+  tx_ord++;
+}
+
+// Captures left unfinished, oldest first. RTC memory keeps them across deep
+// sleep and resets; SF_TX is rewritten only when the list changes.
+static constexpr uint8_t TX_PENDING_MAX = 4;
+static constexpr uint32_t TX_MAGIC = 0x31435854;   // "TXC1"
+
+struct TxPending {
+  char id[64];
+  uint16_t next;     // first chunk to send
+  uint16_t total;    // chunks in the store file
+};
+
+struct TxRtc {
+  uint32_t magic;
+  uint8_t n;
+  TxPending p[TX_PENDING_MAX];
+};
+
+static RTC_DATA_ATTR TxRtc tx_rtc;
+
+// After a power cycle the RTC copy is gone: reload it from SF_TX
+static void txLoad() {
+  if (tx_rtc.magic == TX_MAGIC && tx_rtc.n <= TX_PENDING_MAX) return;
+  tx_rtc.magic = TX_MAGIC;
+  tx_rtc.n = 0;
+  String json;
+  if (!readFileToString(SF_TX, json)) return;
+  JsonDocument doc;
+  if (deserializeJson(doc, json)) return;
+  for (JsonVariantConst e : doc["pending"].as<JsonArrayConst>()) {
+    if (tx_rtc.n >= TX_PENDING_MAX) break;
+    TxPending& p = tx_rtc.p[tx_rtc.n];
+    snprintf(p.id, sizeof(p.id), "%s", e["id"] | "");
+    p.next = e["next"] | 0;
+    p.total = e["total"] | 0;
+    if (p.id[0]) tx_rtc.n++;
+  }
+}
+
+static void txSave() {
+  if (!tx_rtc.n) {
+    LittleFS.remove(SF_TX);
+    return;
+  }
+  JsonDocument doc;
+  JsonArray arr = doc["pending"].to<JsonArray>();
+  for (uint8_t i = 0; i < tx_rtc.n; i++) {
+    JsonObject e = arr.add<JsonObject>();
+    e["id"]    = tx_rtc.p[i].id;
+    e["next"]  = tx_rtc.p[i].next;
+    e["total"] = tx_rtc.p[i].total;
+  }
+  File f = LittleFS.open(SF_TX, "w");
+  if (!f) return;
+  serializeJson(doc, f);
+  f.close();
+}
+
+static void txPendingAdd(const char* id_msg, uint16_t next, uint16_t total) {
+  txLoad();
+  uint8_t i = 0;
+  while (i < tx_rtc.n && strcmp(tx_rtc.p[i].id, id_msg) != 0) i++;
+  if (i == tx_rtc.n) {
+    if (tx_rtc.n == TX_PENDING_MAX) {
+      Serial.printf("tx: %s dropped (pending list full)\n", tx_rtc.p[0].id);
+      memmove(&tx_rtc.p[0], &tx_rtc.p[1], (TX_PENDING_MAX - 1) * sizeof(TxPending));
+      i = --tx_rtc.n;
+    }
+    tx_rtc.n++;
+    snprintf(tx_rtc.p[i].id, sizeof(tx_rtc.p[i].id), "%s", id_msg);
+  }
+  tx_rtc.p[i].next = next;
+  tx_rtc.p[i].total = total;
+  txSave();
+}
+
+static String sfPath(const char* id_msg) {
+  return String(SF_DIR) + "/" + id_msg + ".bin";
+}
+
+static void sfBegin(const char* id_msg) {
+  LittleFS.mkdir(SF_DIR);
+  sf_file = LittleFS.open(sfPath(id_msg), "w");
+  if (!sf_file) Serial.println("sf: cannot open store file");
+  tx_ord = 0;
+  tx_next = 0;
+  tx_broken = false;
+}
+
+static void sfAppend(const char* type, const char* key, const uint8_t* data, size_t len) {
+  if (!sf_file) return;
+  uint8_t hdr[12] = {0};
+  strncpy((char*)hdr, type, 4);
+  strncpy((char*)hdr + 4, key, 4);
+  put_u16_le(&hdr[8], (uint16_t)len);
+  put_u16_le(&hdr[10], (uint16_t)(len >> 16));
+  sf_file.write(hdr, sizeof(hdr));
+  sf_file.write(data, len);
+}
+
+// Closes the store file, records the transmit cursor of an unfinished
+// capture and drops the oldest captures beyond SF_KEEP
+static void sfEnd(const char* id_msg) {
+  if (!sf_file) return;
+  sf_file.close();
+
+  if (tx_next < tx_ord) {
+    // The chunk written just before the failure may not have left the
+    // socket: send it again too (the backend drops duplicates)
+    const uint16_t from = tx_next ? tx_next - 1 : 0;
+    txPendingAdd(id_msg, from, tx_ord);
+    Serial.printf("tx: %s stopped at chunk %u/%u, resumes on the next connection\n",
+                  id_msg, (unsigned)tx_next, (unsigned)tx_ord);
+  }
+
+  String index;
+  readFileToString(SF_INDEX, index);
+  index += id_msg;
+  index += "\n";
+
+  uint8_t lines = 0;
+  for (int i = 0; i < (int)index.length(); i++) if (index[i] == '\n') lines++;
+  while (lines > SF_KEEP) {
+    const int nl = index.indexOf('\n');
+    LittleFS.remove(sfPath(index.substring(0, nl).c_str()));
+    index = index.substring(nl + 1);
+    lines--;
+  }
+
+  File f = LittleFS.open(SF_INDEX, "w");
+  if (f) {
+    f.write((const uint8_t*)index.c_str(), index.length());
+    f.close();
+  }
 }
 
 // -------------------------
 // CBOR publish helpers
 // -------------------------
-static bool mqttPublishCbor(const uint8_t* payload, size_t len) {
+// Link tier of the capture being published and the uplink accounting behind
+// it (reset per capture by publishCapture)
+enum LinkTier : uint8_t { TIER_RAW = 0, TIER_LOSSLESS = 1, TIER_LOSSY = 2, TIER_FEATURES = 3, TIER_ROUNDED = 4 };
+static const char* const LINK_TIER_NAMES[5] = { "raw", "lossless", "lossy", "features", "rounded" };
+static LinkTier link_tier = TIER_RAW;
+static int8_t link_rssi_now = 0;
+static float link_kBps_used = 0.0f;
+static uint32_t link_tx_bytes = 0;
+static uint64_t link_tx_us = 0;
+
+static bool mqttPublishCbor(const uint8_t* payload, size_t len, uint16_t flush_ms = 200) {
+  const int64_t t_pub = esp_timer_get_time();
   bool ok = mqtt.publish(cfg.mqtt_topic.c_str(), (const uint8_t*)payload, len, false);
+  const uint32_t pub_us = (uint32_t)(esp_timer_get_time() - t_pub);
+  link_tx_us += pub_us;
+  link_tx_bytes += (uint32_t)len;
+  radioNoteTx(pub_us, ok);
   // Give time to flush before next message
   uint32_t t0 = millis();
-  while (millis() - t0 < 200) {
+  do {
     mqtt.loop();
-    delay(5);
-  }
+    if (flush_ms) delay(5);
+  } while (millis() - t0 < flush_ms);
   return ok;
 }
 
@@ -877,13 +1867,13 @@ static bool publishMetaCbor(const char* id_msg,
                             time_t epoch_s,
                             const char* iso_utc,
                             bool ntp_ok,
-                            uint16_t n_samples,
-                            uint16_t fs_hz) {
-  uint8_t buf[512];
+                            const vib::pipe::Frame& f) {
+  uint8_t buf[META_MAX];
   CborEncoder root, map;
 
   cbor_encoder_init(&root, buf, sizeof(buf), 0);
-  CborError err = cbor_encoder_create_map(&root, &map, 12);
+  // Indefinite length: the set of feature keys depends on the pipeline
+  CborError err = cbor_encoder_create_map(&root, &map, CborIndefiniteLength);
   if (err) return false;
 
   err = cbor_encode_text_stringz(&map, "type"); if (err) return false;
@@ -911,21 +1901,186 @@ static bool publishMetaCbor(const char* id_msg,
   err = cbor_encode_text_stringz(&map, "t0_us"); if (err) return false;
   err = cbor_encode_uint(&map, (uint64_t)epoch_us0); if (err) return false;
 
+  err = cbor_encode_text_stringz(&map, "t0_err_us"); if (err) return false;
+  err = cbor_encode_uint(&map, f.t0_err_us); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "skew_ppb"); if (err) return false;
+  err = cbor_encode_int(&map, (int64_t)llround(clock_model.skew_ppm() * 1000.0)); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "clk_steps"); if (err) return false;
+  err = cbor_encode_uint(&map, clock_model.steps()); if (err) return false;
+
   err = cbor_encode_text_stringz(&map, "n"); if (err) return false;
-  err = cbor_encode_uint(&map, n_samples); if (err) return false;
+  err = cbor_encode_uint(&map, f.n); if (err) return false;
 
   err = cbor_encode_text_stringz(&map, "fs"); if (err) return false;
-  err = cbor_encode_uint(&map, fs_hz); if (err) return false;
+  err = cbor_encode_uint(&map, f.fs_hz); if (err) return false;
 
   err = cbor_encode_text_stringz(&map, "dt_fmt"); if (err) return false;
   err = cbor_encode_text_stringz(&map, "u16le_us"); if (err) return false;
 
-  err = cbor_encode_text_stringz(&map, "a_fmt"); if (err) return false;
-  err = cbor_encode_text_stringz(&map, "i16le_mg"); if (err) return false;
+  // No codec to report when no axis blobs follow
+  if (link_tier != TIER_FEATURES) {
+    err = cbor_encode_text_stringz(&map, "a_fmt"); if (err) return false;
+    err = cbor_encode_text_stringz(&map, vib::codec::format(f.codec)); if (err) return false;
+  }
+
+  err = cbor_encode_text_stringz(&map, "so_mg"); if (err) return false;
+  err = cbor_encode_uint(&map, (uint64_t)f.so_mg()); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "range_g"); if (err) return false;
+  err = cbor_encode_uint(&map, f.range_g); if (err) return false;
+
+  if (meas_profs) {
+    err = cbor_encode_text_stringz(&map, "mid"); if (err) return false;
+    err = cbor_encode_text_stringz(&map, meas_id); if (err) return false;
+
+    err = cbor_encode_text_stringz(&map, "prof"); if (err) return false;
+    err = cbor_encode_uint(&map, meas_prof); if (err) return false;
+
+    err = cbor_encode_text_stringz(&map, "profs"); if (err) return false;
+    err = cbor_encode_uint(&map, meas_profs); if (err) return false;
+
+    if (cfg.profiles[meas_prof].name[0]) {
+      err = cbor_encode_text_stringz(&map, "prof_name"); if (err) return false;
+      err = cbor_encode_text_stringz(&map, cfg.profiles[meas_prof].name); if (err) return false;
+    }
+  }
+
+  char pipe_desc[96];
+  pipeline.describe(pipe_desc, sizeof(pipe_desc));
+  err = cbor_encode_text_stringz(&map, "pipe"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, pipe_desc); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "tier"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, LINK_TIER_NAMES[link_tier]); if (err) return false;
+
+  // Blobs rounded to a grid the samples were not on: error up to half a step
+  if (link_tier == TIER_ROUNDED || link_tier == TIER_LOSSY) {
+    err = cbor_encode_text_stringz(&map, "q_step_mg"); if (err) return false;
+    err = cbor_encode_uint(&map, (uint64_t)f.so_mg()); if (err) return false;
+  }
+
+  err = cbor_encode_text_stringz(&map, "rssi"); if (err) return false;
+  err = cbor_encode_int(&map, link_rssi_now); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "link_kBps"); if (err) return false;
+  err = cbor_encode_float(&map, link_kBps_used); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "tx_dbm"); if (err) return false;
+  err = cbor_encode_float(&map, RADIO_LADDER[radio_rung].tx_dbm); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "ps"); if (err) return false;
+  err = cbor_encode_boolean(&map, RADIO_LADDER[radio_rung].modem_sleep); if (err) return false;
+
+  if (radio_rtc.magic == RADIO_MAGIC && radio_rtc.last_base_mC > 0.0f) {
+    err = cbor_encode_text_stringz(&map, "e_prev_mC"); if (err) return false;
+    err = cbor_encode_float(&map, radio_rtc.last_mC); if (err) return false;
+
+    err = cbor_encode_text_stringz(&map, "e_prev_base_mC"); if (err) return false;
+    err = cbor_encode_float(&map, radio_rtc.last_base_mC); if (err) return false;
+  }
+
+  if (f.feat.valid & vib::pipe::FEAT_RMS) {
+    err = cbor_encode_text_stringz(&map, "mag_rms"); if (err) return false;
+    err = cbor_encode_float(&map, f.feat.mag_rms_mps2); if (err) return false;
+  }
+
+  if (f.feat.valid & vib::pipe::FEAT_PEAK) {
+    CborEncoder arr;
+    err = cbor_encode_text_stringz(&map, "peak_mg"); if (err) return false;
+    err = cbor_encoder_create_array(&map, &arr, 3); if (err) return false;
+    for (size_t k = 0; k < 3; k++) {
+      err = cbor_encode_uint(&arr, (uint64_t)f.feat.peak_mg[k]); if (err) return false;
+    }
+    err = cbor_encoder_close_container(&map, &arr); if (err) return false;
+
+    err = cbor_encode_text_stringz(&map, "clip"); if (err) return false;
+    err = cbor_encode_uint(&map, f.feat.clip); if (err) return false;
+  }
+
+  if (f.feat.valid & vib::pipe::FEAT_SPEED) {
+    err = cbor_encode_text_stringz(&map, "rpm"); if (err) return false;
+    err = cbor_encode_float(&map, f.feat.speed_hz * 60.0f); if (err) return false;
+    err = cbor_encode_text_stringz(&map, "rpm_conf"); if (err) return false;
+    err = cbor_encode_float(&map, f.feat.speed_conf); if (err) return false;
+  }
+
+  if (f.feat.valid & vib::pipe::FEAT_KURT) {
+    CborEncoder arr;
+    err = cbor_encode_text_stringz(&map, "sk_band"); if (err) return false;
+    err = cbor_encoder_create_array(&map, &arr, 2); if (err) return false;
+    err = cbor_encode_float(&arr, f.feat.kurt_f_lo_hz); if (err) return false;
+    err = cbor_encode_float(&arr, f.feat.kurt_f_hi_hz); if (err) return false;
+    err = cbor_encoder_close_container(&map, &arr); if (err) return false;
+
+    err = cbor_encode_text_stringz(&map, "sk"); if (err) return false;
+    err = cbor_encode_float(&map, f.feat.kurt); if (err) return false;
+    err = cbor_encode_text_stringz(&map, "sk_axis"); if (err) return false;
+    err = cbor_encode_uint(&map, f.feat.kurt_axis); if (err) return false;
+  }
+
+  if (f.pca.valid) {
+    CborEncoder arr;
+    err = cbor_encode_text_stringz(&map, "pca_dir"); if (err) return false;
+    err = cbor_encoder_create_array(&map, &arr, 3); if (err) return false;
+    for (size_t k = 0; k < 3; k++) {
+      err = cbor_encode_float(&arr, f.pca.dir[k]); if (err) return false;
+    }
+    err = cbor_encoder_close_container(&map, &arr); if (err) return false;
+
+    err = cbor_encode_text_stringz(&map, "pca_ratio"); if (err) return false;
+    err = cbor_encoder_create_array(&map, &arr, 3); if (err) return false;
+    for (size_t k = 0; k < 3; k++) {
+      err = cbor_encode_float(&arr, f.pca.ratio[k]); if (err) return false;
+    }
+    err = cbor_encoder_close_container(&map, &arr); if (err) return false;
+  }
+
+  // Timing quality (vib_timing.h), all in us
+  {
+    const vib::Timing& tq = f.timing;
+    CborEncoder tqm, arr;
+    err = cbor_encode_text_stringz(&map, "tq"); if (err) return false;
+    err = cbor_encoder_create_map(&map, &tqm, CborIndefiniteLength); if (err) return false;
+
+    err = cbor_encode_text_stringz(&tqm, "h"); if (err) return false;
+    err = cbor_encoder_create_array(&tqm, &arr, vib::Timing::kBins); if (err) return false;
+    for (size_t k = 0; k < vib::Timing::kBins; k++) {
+      err = cbor_encode_uint(&arr, tq.hist[k]); if (err) return false;
+    }
+    err = cbor_encoder_close_container(&tqm, &arr); if (err) return false;
+
+    err = cbor_encode_text_stringz(&tqm, "miss"); if (err) return false;
+    err = cbor_encode_uint(&tqm, tq.missed); if (err) return false;
+
+    err = cbor_encode_text_stringz(&tqm, "sat"); if (err) return false;
+    err = cbor_encode_uint(&tqm, tq.sat); if (err) return false;
+
+    err = cbor_encode_text_stringz(&tqm, "sd"); if (err) return false;
+    err = cbor_encode_float(&tqm, (float)tq.dt_sd_us()); if (err) return false;
+
+    err = cbor_encode_text_stringz(&tqm, "lag"); if (err) return false;
+    err = cbor_encode_uint(&tqm, tq.lag_max_us); if (err) return false;
+
+    err = cbor_encode_text_stringz(&tqm, "rd"); if (err) return false;
+    err = cbor_encode_uint(&tqm, tq.read_max_us); if (err) return false;
+
+    err = cbor_encode_text_stringz(&tqm, "clk"); if (err) return false;
+    err = cbor_encode_int(&tqm, tq.end_err_us); if (err) return false;
+
+    err = cbor_encoder_close_container(&map, &tqm); if (err) return false;
+  }
+
+  if (f.filt_sat) {
+    err = cbor_encode_text_stringz(&map, "filt_sat"); if (err) return false;
+    err = cbor_encode_uint(&map, f.filt_sat); if (err) return false;
+  }
 
   err = cbor_encoder_close_container(&root, &map); if (err) return false;
 
   size_t nbytes = cbor_encoder_get_buffer_size(&root, buf);
+  sfAppend("meta", "", buf, nbytes);   // kept for NACK resends
   return mqttPublishCbor(buf, nbytes);
 }
 
@@ -935,13 +2090,14 @@ static bool publishBlobCbor(const char* type,
                             const uint8_t* blob,
                             size_t blob_len,
                             uint16_t idx,
-                            uint16_t total_parts) {
+                            uint16_t total_parts,
+                            uint16_t flush_ms = 200) {
   uint8_t buf[1400];
   CborEncoder root, map;
 
   cbor_encoder_init(&root, buf, sizeof(buf), 0);
 
-  CborError err = cbor_encoder_create_map(&root, &map, 5);
+  CborError err = cbor_encoder_create_map(&root, &map, 6);
   if (err) return false;
 
   err = cbor_encode_text_stringz(&map, "type"); if (err) return false;
@@ -956,44 +2112,251 @@ static bool publishBlobCbor(const char* type,
   err = cbor_encode_text_stringz(&map, "parts"); if (err) return false;
   err = cbor_encode_uint(&map, total_parts); if (err) return false;
 
+  err = cbor_encode_text_stringz(&map, "crc"); if (err) return false;
+  err = cbor_encode_uint(&map, vib::crc::crc32(blob, blob_len)); if (err) return false;
+
   err = cbor_encode_text_stringz(&map, key); if (err) return false;
   err = cbor_encode_byte_string(&map, blob, blob_len); if (err) return false;
 
   err = cbor_encoder_close_container(&root, &map); if (err) return false;
 
   size_t nbytes = cbor_encoder_get_buffer_size(&root, buf);
-  Serial.print("CBOR msg bytes="); Serial.println(nbytes);
-  return mqttPublishCbor(buf, nbytes);
+  if (flush_ms) { Serial.print("CBOR msg bytes="); Serial.println(nbytes); }
+  return mqttPublishCbor(buf, nbytes, flush_ms);
 }
 
 // -------------------------
-// Acquisition (N samples)
+// Chunked blobs + NACK retransmission
 // -------------------------
-static bool acquireN(uint16_t N,
-                     uint16_t fs_hz,
-                     uint64_t& epoch_us0,
-                     uint16_t* dt_us,   // length N-1
-                     int16_t* ax_mg,    // length N
-                     int16_t* ay_mg,
-                     int16_t* az_mg,
-                     uint64_t& dt_sum_us_out) {
+// Once the connection is gone the remaining chunks are only stored
+static bool publishChunked(const char* type, const char* id_msg, const char* key,
+                           const uint8_t* data, size_t len) {
+  const uint16_t parts = sfParts(len);
+  bool ok = true;
+  for (uint16_t i = 0; i < parts; i++) {
+    const size_t off = (size_t)i * SF_CHUNK;
+    const size_t n = (len - off < SF_CHUNK) ? len - off : SF_CHUNK;
+    const bool sent = (!tx_broken || mqtt.connected()) &&
+                      publishBlobCbor(type, id_msg, key, data + off, n, i, parts);
+    txNote(sent);
+    ok &= sent;
+  }
+  sfAppend(type, key, data, len);
+  return ok;
+}
 
-  if (N < 2) return false;
+// Reads the next store entry header; pos is where its len bytes start
+static bool sfNextEntry(File& f, char etype[5], char ekey[5], uint32_t& len, size_t& pos) {
+  uint8_t hdr[12];
+  if (f.read(hdr, sizeof(hdr)) != sizeof(hdr)) return false;
+  len = (uint32_t)hdr[8] | ((uint32_t)hdr[9] << 8) |
+        ((uint32_t)hdr[10] << 16) | ((uint32_t)hdr[11] << 24);
+  pos = f.position();
+  memset(etype, 0, 5);
+  memset(ekey, 0, 5);
+  memcpy(etype, hdr, 4);
+  memcpy(ekey, hdr + 4, 4);
+  return true;
+}
 
-  // Absolute wall-clock start (NTP-derived if synced)
-  epoch_us0 = epochUsNow();
+// Publishes chunk idx of the store entry at pos (idx is ignored for "meta")
+static bool sfSendEntryChunk(File& f, size_t pos, uint32_t len, const char* id_msg,
+                             const char* type, const char* key, uint16_t idx) {
+  if (!strcmp(type, "meta")) {
+    uint8_t meta[META_MAX];
+    return len <= sizeof(meta) && f.seek(pos) && f.read(meta, len) == len && mqttPublishCbor(meta, len);
+  }
+  static uint8_t buf[SF_CHUNK];
+  const uint16_t parts = sfParts(len);
+  if (idx >= parts) return false;
+  const size_t off = (size_t)idx * SF_CHUNK;
+  const size_t n = (len - off < SF_CHUNK) ? len - off : SF_CHUNK;
+  return f.seek(pos + off) && f.read(buf, n) == n && publishBlobCbor(type, id_msg, key, buf, n, idx, parts);
+}
 
-  // Monotonic reference for relative timing
-  int64_t t0_rel_us = esp_timer_get_time();
-  int64_t last_t_us = t0_rel_us;
+// Resends one stored chunk (idx is ignored for "meta")
+static bool sfResend(const char* id_msg, const char* type, uint16_t idx) {
+  File f = LittleFS.open(sfPath(id_msg), "r");
+  if (!f) return false;
+
+  char etype[5], ekey[5];
+  uint32_t len;
+  size_t pos;
+  bool ok = false;
+  while (sfNextEntry(f, etype, ekey, len, pos)) {
+    if (strcmp(etype, type) != 0) {
+      if (!f.seek(pos + len)) break;
+      continue;
+    }
+    ok = sfSendEntryChunk(f, pos, len, id_msg, type, ekey, idx);
+    break;
+  }
+  f.close();
+  return ok;
+}
+
+// Publishes the chunks of a stored capture from ordinal `from` on, stopping
+// at the first failure. next is the first chunk not sent (total when all
+// went out). False if the capture is no longer stored.
+static bool sfSendFrom(const char* id_msg, uint16_t from, uint16_t& next, uint16_t& total) {
+  File f = LittleFS.open(sfPath(id_msg), "r");
+  if (!f) return false;
+
+  char etype[5], ekey[5];
+  uint32_t len;
+  size_t pos;
+  uint16_t ord = 0;
+  bool failed = false;
+  while (sfNextEntry(f, etype, ekey, len, pos)) {
+    const uint16_t parts = strcmp(etype, "meta") ? sfParts(len) : 1;
+    for (uint16_t i = 0; i < parts; i++, ord++) {
+      if (failed || ord < from) continue;
+      if (!sfSendEntryChunk(f, pos, len, id_msg, etype, ekey, i)) {
+        failed = true;
+        next = ord;
+      }
+    }
+    if (!f.seek(pos + len)) break;
+  }
+  f.close();
+  total = ord;
+  if (!failed) next = ord;
+  return true;
+}
+
+static String sfNackTopic() {
+  return cfg.mqtt_topic + "/nack/" + cfg.client_id;
+}
+
+// PubSubClient drops a message larger than its buffer without a callback, so
+// the buffer is raised to SF_NACK_BUF while waiting: a NACK over SF_NACK_MAX
+// still arrives, and is cut rather than left retained unseen
+static char sf_nack[SF_NACK_MAX];
+static size_t sf_nack_len = 0;
+static bool sf_nack_got = false;
+static bool sf_nack_cut = false;   // did not fit in sf_nack
+
+static void mqttOnMessage(char* topic, uint8_t* payload, unsigned int len) {
+  if (sfNackTopic() != topic) return;
+  sf_nack_cut = len >= sizeof(sf_nack);
+  sf_nack_len = sf_nack_cut ? sizeof(sf_nack) - 1 : len;
+  memcpy(sf_nack, payload, sf_nack_len);
+  sf_nack[sf_nack_len] = '\0';
+  sf_nack_got = true;
+}
+
+// Handles a pending NACK (retained) right after connecting
+static void sfProcessNacks() {
+  const String topic = sfNackTopic();
+  sf_nack_got = false;
+  mqtt.setCallback(mqttOnMessage);
+  if (!mqtt.setBufferSize(SF_NACK_BUF)) Serial.println("nack: no memory for a larger MQTT buffer");
+  if (!mqtt.subscribe(topic.c_str(), 1)) {
+    mqtt.setBufferSize(MQTT_MAX_PACKET_SIZE);
+    return;
+  }
+
+  uint32_t t0 = millis();
+  while (!sf_nack_got && millis() - t0 < SF_NACK_WAIT_MS) {
+    mqtt.loop();
+    delay(10);
+  }
+  mqtt.unsubscribe(topic.c_str());
+  mqtt.setBufferSize(MQTT_MAX_PACKET_SIZE);
+  if (!sf_nack_got || sf_nack_len == 0) return;   // empty retained = cleared
+
+  // A cut or garbled NACK cannot be acted on. It is logged and cleared like a
+  // handled one, or it would come back on every wake; the backend NACKs again
+  // whatever is still missing.
+  JsonDocument doc;
+  if (sf_nack_cut) {
+    Serial.printf("nack: longer than %u B, dropped\n", (unsigned)(sizeof(sf_nack) - 1));
+  } else if (deserializeJson(doc, sf_nack)) {
+    Serial.println("nack: invalid JSON, dropped");
+  } else {
+    uint16_t resent = 0, gone = 0;
+    for (JsonVariantConst m : doc["missing"].as<JsonArrayConst>()) {
+      const char* id = m["id"] | "";
+      const char* type = m["type"] | "";
+      const uint16_t idx = m["idx"] | 0;
+      if (sfResend(id, type, idx)) resent++;
+      else gone++;
+    }
+    Serial.printf("nack: resent %u chunk(s), %u not available\n", (unsigned)resent, (unsigned)gone);
+  }
 
-  const uint32_t period_us = (uint32_t)(1000000UL / (uint32_t)fs_hz);
+  // Clear the retained NACK
+  mqtt.publish(topic.c_str(), (const uint8_t*)"", 0, true);
+}
+
+// Resumes captures left unfinished on earlier wakes, oldest first, from
+// their transmit cursor. A failure keeps that capture and the later ones.
+static void txResume() {
+  txLoad();
+  if (!tx_rtc.n) return;
+
+  uint8_t keep = 0;
+  bool failed = false;
+  for (uint8_t i = 0; i < tx_rtc.n; i++) {
+    TxPending p = tx_rtc.p[i];
+    if (!failed) {
+      uint16_t next = p.next, total = p.total;
+      if (!sfSendFrom(p.id, p.next, next, total)) {
+        Serial.printf("tx: %s no longer stored, dropped\n", p.id);
+        continue;
+      }
+      Serial.printf("tx: %s resent chunks %u..%u of %u\n", p.id, (unsigned)p.next,
+                    (unsigned)next, (unsigned)total);
+      if (next >= total) continue;
+      failed = true;
+      p.next = next > p.next ? next - 1 : p.next;   // as in sfEnd
+      p.total = total;
+    }
+    tx_rtc.p[keep++] = p;
+  }
+  tx_rtc.n = keep;
+  txSave();
+}
+
+// -------------------------
+// Acquisition (N samples)
+// -------------------------
+// Each sample goes through the fused pipeline prefix (vib_fused.h) while it
+// is read: filtered and accumulated into features in the same loop. The gate
+// and encoder run in the generic pipeline afterwards. With Chain<> the raw mg
+// samples are stored and the whole pipeline runs afterwards. f.n, f.fs_hz and f.axis must be set.
+template <class C>
+static bool acquireN(vib::fused::Fused<C>& fz,
+                     vib::pipe::Frame& f,
+                     uint16_t* dt_us,   // length N-1
+                     uint64_t& dt_sum_us_out,
+                     uint32_t& read_us_max_out,
+                     int32_t& raw_peak_mg_out,     // before any filtering
+                     uint32_t& raw_clip_out,
+                     vib::Cov3& cov_out) {
+
+  const uint16_t N = (uint16_t)f.n;
+  if (N < 2 || f.fs_hz == 0) return false;
+
+  // Monotonic reference for relative timing; the absolute start is mapped
+  // from it through the clock model, refreshed just before
+  clockUpdate();
+  int64_t t0_rel_us = esp_timer_get_time();
+  int64_t last_t_us = t0_rel_us;
+  f.t0_epoch_us = clockEpochAt(t0_rel_us);
+  f.t0_err_us = clock_model.valid() ? clock_model.err_at(t0_rel_us) : 0;
+
+  const uint32_t period_us = (uint32_t)(1000000UL / (uint32_t)f.fs_hz);
+  f.timing.begin(period_us);
   uint64_t dt_sum_us = 0;
+  uint32_t read_us_max = 0;
+  int32_t peak_digits = 0;
+  uint32_t clip = 0;
 
   for (uint16_t i = 0; i < N; i++) {
     // Soft schedule: target time since t0
+    const int64_t target = t0_rel_us + (int64_t)i * (int64_t)period_us;
     if (i > 0) {
-      int64_t target = t0_rel_us + (int64_t)i * (int64_t)period_us;
       while (esp_timer_get_time() < target) {
         delayMicroseconds(50);
       }
@@ -1008,26 +2371,73 @@ static bool acquireN(uint16_t N,
       if (d > 65535UL) d = 65535UL;
       dt_us[i - 1] = (uint16_t)d;
       dt_sum_us += d;
+      f.timing.add(d, (uint32_t)(t_now_us - target));
     }
     last_t_us = t_now_us;
 
-    sensors_event_t event;
-    lis.getEvent(&event);
+    int16_t raw[3];
+    lisReadRaw(raw);
+
+    uint32_t read_us = (uint32_t)(esp_timer_get_time() - t_now_us);
+    if (read_us > read_us_max) read_us_max = read_us;
+
+    for (size_t k = 0; k < 3; k++) {
+      const int32_t d = raw[k] >> 4;
+      const int32_t a = d < 0 ? -d : d;
+      if (a > peak_digits) peak_digits = a;
+      if (vib::fx::is_clipped_digit(d)) clip++;
+    }
+
+    const int16_t xyz[3] = { lisRawToMg(raw[0]), lisRawToMg(raw[1]), lisRawToMg(raw[2]) };
+    cov_out.add(xyz[0], xyz[1], xyz[2]);
+    fz.push(i, xyz);
+  }
 
-    ax_mg[i] = mps2_to_mg((float)event.acceleration.x);
-    ay_mg[i] = mps2_to_mg((float)event.acceleration.y);
-    az_mg[i] = mps2_to_mg((float)event.acceleration.z);
+  // Clock cross-check: where the wall clock is at the end vs where the model
+  // expects it (a slew or step during the capture), then feed the model
+  const vib::clk::Pair end_pair = clockSample();
+  if (clock_model.valid()) {
+    f.timing.end_err_us = (int32_t)(end_pair.epoch_us - clock_model.epoch_at(end_pair.mono_us));
+    if (!clock_model.update(end_pair)) {
+      Serial.printf("clock: wall clock stepped by %lld us during the capture\n",
+                    (long long)clock_model.last_resid_us());
+    }
   }
+  f.timing.read_max_us = read_us_max;
 
   dt_sum_us_out = dt_sum_us;
+  read_us_max_out = read_us_max;
+  raw_peak_mg_out = peak_digits * lis_mg_per_digit;
+  raw_clip_out = clip;
   return true;
 }
 
+// Called by vib::fused::dispatch() with the concrete chain type
+struct AcquireFused {
+  vib::pipe::Frame* f;
+  uint16_t* dt_us;
+  uint64_t dt_sum_us;
+  uint32_t read_us_max;
+  int32_t raw_peak_mg;
+  uint32_t raw_clip;
+  vib::Cov3 cov;
+  bool acq_ok;
+
+  template <class C>
+  bool operator()(vib::fused::Fused<C>& fz) {
+    fz.begin(*f);
+    cov.reset();
+    acq_ok = acquireN(fz, *f, dt_us, dt_sum_us, read_us_max, raw_peak_mg, raw_clip, cov);
+    return acq_ok && fz.finish();
+  }
+};
+
 // -------------------------
 // Deep sleep
 // -------------------------
 static void goToSleep(uint32_t seconds) {
   pixelSetSolid(C_OFF());   // add this
+  radioEnd();
   mqtt.disconnect();
   WiFi.disconnect(true);
   WiFi.mode(WIFI_OFF);
@@ -1049,222 +2459,1623 @@ static void makeIdMsg(char* out, size_t out_len, uint64_t epoch_us0) {
   snprintf(out, out_len, "%s-%lu", cfg.client_id.c_str(), (unsigned long)low);
 }
 
-static float computeMagRms_mps2(const int16_t* ax_mg,
-                               const int16_t* ay_mg,
-                               const int16_t* az_mg,
-                               uint16_t N) {
-  // Convert mg -> m/s^2: (mg/1000)*g0
-  const float g0 = 9.80665f;
-  double sum_sq = 0.0;
+// -------------------------
+// Link-adaptive payload tiers
+// -------------------------
+// Each capture goes out in the richest tier whose predicted transfer time
+// fits link.target_s: raw (the pipeline's encoder), lossless (delta on the
+// sensor grid), lossy (delta on a 4x coarser grid) or features (meta only).
+// Behind a filter the samples are no longer on the sensor grid, so the
+// sensor-grid tier rounds them and is sent as "rounded" instead of lossless.
+// The prediction uses the uplink throughput measured on earlier wakes (kept
+// in RTC memory), derated when the RSSI is worse now than when it was
+// measured; without history it goes by RSSI alone.
+static constexpr uint32_t LINK_MAGIC = 0x314B4E4C;        // "LNK1"
+static constexpr uint8_t LINK_LOSSY_Q = 4;                 // lossy step, in So
+static constexpr uint32_t LINK_MIN_SAMPLE_BYTES = 4096;    // smaller sends do not update the estimate
+
+struct LinkRtc {
+  uint32_t magic;
+  float kBps;        // EWMA of the measured uplink throughput
+  int8_t rssi;       // RSSI of the last measurement
+  uint8_t tier;      // tier of the last capture
+  uint16_t n_meas;
+};
+
+static RTC_DATA_ATTR LinkRtc link_rtc;
 
-  for (uint16_t i = 0; i < N; i++) {
-    const float ax = ((float)ax_mg[i] / 1000.0f) * g0;
-    const float ay = ((float)ay_mg[i] / 1000.0f) * g0;
-    const float az = ((float)az_mg[i] / 1000.0f) * g0;
-    const double mag2 = (double)ax * ax + (double)ay * ay + (double)az * az;
-    sum_sq += mag2;
+// Throughput expected now: history halved per 6 dB of RSSI lost since
+static float linkExpectedKBps(int8_t rssi) {
+  if (link_rtc.magic != LINK_MAGIC || link_rtc.n_meas == 0) {
+    if (rssi >= -67) return 40.0f;
+    if (rssi >= -75) return 12.0f;
+    if (rssi >= -82) return 4.0f;
+    return 1.0f;
   }
+  float k = link_rtc.kBps;
+  const int drop = (int)link_rtc.rssi - (int)rssi;
+  if (drop > 0) k *= powf(0.5f, (float)drop / 6.0f);
+  return k;
+}
 
-  const double mean_sq = sum_sq / (double)N;
-  return (float)sqrt(mean_sq);
+// len bytes in SF_CHUNK messages, each followed by the 200 ms flush wait.
+// With an adaptive tier publishCapture() sends the axes back to back, so
+// that is all the awake time the capture costs.
+static uint32_t linkPredictMs(size_t len, float kBps) {
+  const uint32_t msgs = (uint32_t)((len + SF_CHUNK - 1) / SF_CHUNK);
+  return (uint32_t)((float)len / (kBps * 1.024f)) + msgs * 200UL;
 }
 
-static bool bootHeldForMs(uint32_t hold_ms = 3000) {
-  const int BOOT_PIN = 0;            // en ESP32-S3 Feather suele ser GPIO0
-  pinMode(BOOT_PIN, INPUT_PULLUP);   // BOOT normalmente a GND al presionar
-  uint32_t t0 = millis();
-  while (millis() - t0 < hold_ms) {
-    if (digitalRead(BOOT_PIN) == HIGH) return false; // soltó antes
-    delay(10);
+static size_t linkAxesBytes(const vib::pipe::Frame& f) {
+  return f.out[0].len + f.out[1].len + f.out[2].len;
+}
+
+// Re-encodes the axis blobs from the (filtered) samples as delta with step q*So
+static bool linkReencode(vib::pipe::Frame& f, uint8_t q) {
+  f.codec = vib::codec::DELTA;
+  f.q_mult = q;
+  f.codec_clamps = 0;
+  const int32_t so = f.so_mg();
+  for (size_t k = 0; k < 3; k++) {
+    f.out[k].len = vib::codec::encode(f.codec, f.axis[k], f.n, so, f.out[k].data, f.out[k].cap, f.codec_clamps);
+    if (f.out[k].len == 0 && f.n > 0) return false;
   }
-  return true; // mantuvo presionado hold_ms
+  return true;
 }
 
-void setup() {
-  Serial.begin(115200);
-  delay(1500);
+// Filters leave samples off the sensor grid (raw digits times So)
+static bool pipelineHasFilter() {
+  for (size_t i = 0; i < pipeline.size(); i++) {
+    if (pipeline.stage(i)->kind() == vib::pipe::FILTER) return true;
+  }
+  return false;
+}
 
-  // Start NeoPixel ASAP
-  pixelBegin();
+// Picks the tier for f and re-encodes f.out when needed
+static LinkTier linkChooseTier(vib::pipe::Frame& f) {
+  link_rssi_now = (int8_t)WiFi.RSSI();
+  link_kBps_used = linkExpectedKBps(link_rssi_now);
+  if (cfg.link_mode != "auto") return TIER_RAW;
 
-  // During setup + measurement: solid green
-  pixelSetSolid(C_GREEN());
+  const uint32_t budget_ms = (uint32_t)cfg.link_target_s * 1000UL;
+  const size_t fixed = META_MAX + (f.n ? (size_t)(f.n - 1) * 2 : 0) + (cfg.pyr_factor ? PYR_BURST_BYTES : 0);
 
-  if (!mountFS()) { failAndRestart(5); }
+  uint32_t ms = linkPredictMs(fixed + linkAxesBytes(f), link_kBps_used);
+  if (ms <= budget_ms) return TIER_RAW;
+  if (linkReencode(f, 1) &&
+      linkPredictMs(fixed + linkAxesBytes(f), link_kBps_used) <= budget_ms) {
+    return pipelineHasFilter() ? TIER_ROUNDED : TIER_LOSSLESS;
+  }
+  if (linkReencode(f, LINK_LOSSY_Q) &&
+      linkPredictMs(fixed + linkAxesBytes(f), link_kBps_used) <= budget_ms) return TIER_LOSSY;
+  f.q_mult = 1;   // so_mg is the sensor step again: no blobs use the lossy grid
+  return TIER_FEATURES;
+}
 
-    // Carga config si existe; si no, cfg tendrá defaults
-  loadConfig(); // si falla, igual puedes entrar al portal
+// Folds this capture's measured throughput into the RTC history
+static void linkUpdate(LinkTier tier) {
+  if (link_rtc.magic != LINK_MAGIC) {
+    memset(&link_rtc, 0, sizeof(link_rtc));
+    link_rtc.magic = LINK_MAGIC;
+  }
+  link_rtc.tier = tier;
+  if (link_tx_bytes < LINK_MIN_SAMPLE_BYTES || link_tx_us == 0) return;
+
+  const float k = (float)((double)link_tx_bytes * 1e6 / (double)link_tx_us / 1024.0);
+  link_rtc.kBps = link_rtc.n_meas ? 0.7f * link_rtc.kBps + 0.3f * k : k;
+  link_rtc.rssi = link_rssi_now;
+  if (link_rtc.n_meas < 0xFFFF) link_rtc.n_meas++;
+  Serial.printf("link: %lu B in %lu ms of writes = %.1f kB/s (avg %.1f kB/s @ %d dBm)\n",
+                (unsigned long)link_tx_bytes, (unsigned long)(link_tx_us / 1000), k,
+                link_rtc.kBps, (int)link_rtc.rssi);
+}
 
-  bool forcePortal = bootHeldForMs(3000);
+// -------------------------
+// Pipeline: firmware stages + build
+// -------------------------
+// Publishes one capture: meta, then dt and the encoded x/y/z blobs.
+static bool publishCapture(vib::pipe::Frame& f) {
+  link_tx_bytes = 0;
+  link_tx_us = 0;
+  link_tier = linkChooseTier(f);
+  Serial.printf("link: tier %s (rssi %d dBm, expect %.1f kB/s, target %u s)\n",
+                LINK_TIER_NAMES[link_tier], (int)link_rssi_now, link_kBps_used,
+                (unsigned)cfg.link_target_s);
 
-  if (forcePortal) {
-    pixelBlink(C_YELLOW(), 2, 300, 300);
-    bool saved = startConfigAPPortal(300); // 5 min
-    if (saved) {
-      pixelBlink(C_GREEN(), 3, 250, 250);
-      ESP.restart();
-    } else {
-      // No guardó → reinicia o duerme
-      failAndRestart(5);
+  char id_msg[64];
+  makeIdMsg(id_msg, sizeof(id_msg), f.t0_epoch_us);
+
+  // Timestamp coherence for meta (derived from t0_us)
+  time_t t0_s = (time_t)(f.t0_epoch_us / 1000000ULL);
+  char iso_us[48];
+  formatISO8601UTC_us(f.t0_epoch_us, iso_us, sizeof(iso_us));
+
+  bool all_ok = true;
+
+  sfBegin(id_msg);
+
+  // 1) meta (coherent with acquisition t0)
+  bool ok = publishMetaCbor(id_msg, f.t0_epoch_us, t0_s, iso_us, ntp_synced, f);
+  txNote(ok);
+  Serial.print("pub meta: "); Serial.println(ok ? "ok" : "fail");
+  all_ok &= ok;
+
+  if (link_tier == TIER_FEATURES) {
+    sfEnd(id_msg);
+    linkUpdate(link_tier);
+    return all_ok;
+  }
+
+  // Overview pyramid of what the axis blobs carry (after filters)
+  if (cfg.pyr_factor) {
+    static uint8_t pyr_buf[PYR_BURST_BYTES];
+    vib::pyr::Builder pb;
+    if (pb.begin(f.n, cfg.pyr_factor, pyr_buf, sizeof(pyr_buf))) {
+      for (uint32_t i = 0; i < f.n; i++) {
+        const int16_t v[3] = { f.axis[0][i], f.axis[1][i], f.axis[2][i] };
+        pb.push(i, v);
+      }
+      const size_t len = pb.finish();
+      ok = publishChunked("pyr", id_msg, "pyr", pyr_buf, len);
+      Serial.printf("pub pyr (%u B): %s\n", (unsigned)len, ok ? "ok" : "fail");
+      all_ok &= ok;
     }
   }
 
-  // Config/FS/CA errors -> treat as generic init error (4 blinks)
-  if (!loadConfig()) { failAndRestart(5); }
-  if (!loadCA())     { failAndRestart(5); }
+  // Pack dt (N-1) into bytes (u16le)
+  const uint16_t dt_count = (f.n > 0) ? (uint16_t)(f.n - 1) : 0;
+  static uint8_t dt_bytes[2 * ACQ_MAX_SAMPLES];
+  for (uint16_t i = 0; i < dt_count; i++) {
+    put_u16_le(&dt_bytes[2 * i], f.dt_us[i]);
+  }
 
-  // WiFi (1 blink red)
-  if (!connectWiFi()) { failAndRestart(1); }
+  // 2..5) blobs, in SF_CHUNK parts
+  ok = publishChunked("dt", id_msg, "dt", dt_bytes, (size_t)dt_count * 2);
+  Serial.print("pub dt: "); Serial.println(ok ? "ok" : "fail");
+  all_ok &= ok;
+
+  static const char* const axis_type[3] = { "x", "y", "z" };
+  for (size_t k = 0; k < 3; k++) {
+    // The fixed 3 s pause between axes is kept for link.mode "fixed" only:
+    // linkChooseTier() budgets for the messages alone
+    if (cfg.link_mode != "auto" && !tx_broken) delay(3000);
+    ok = publishChunked(axis_type[k], id_msg, "a", f.out[k].data, f.out[k].len);
+    Serial.printf("pub %s: %s\n", axis_type[k], ok ? "ok" : "fail");
+    all_ok &= ok;
+  }
 
-  bool ntp_ok = syncTimeNTP();
-  if (!ntp_ok) { failAndRestart(2); }
-  Serial.printf("epochUsNow=%llu (ntp_ok=%u)\n",
-                (unsigned long long)epochUsNow(),
-                ntp_ok ? 1 : 0);
+  // Kept whether or not publishing worked: lost chunks can be NACKed
+  sfEnd(id_msg);
+  linkUpdate(link_tier);
+  return all_ok;
+}
 
-  // MQTT connect (3 blinks red)
-  if (!connectMQTT()) { failAndRestart(3); }
+class MqttSinkStage : public vib::pipe::Stage {
+public:
+  vib::pipe::Kind kind() const override { return vib::pipe::SINK; }
+  const char* type() const override { return "mqtt"; }
+  bool run(vib::pipe::Frame& f) override { return portal_dry_run || publishCapture(f); }
+};
 
-  // Sensor init (4 blinks red)
-  if (!initLIS331())  { failAndRestart(4); }
+static vib::pipe::Stage* makeFirmwareStage(const vib::pipe::StageSpec& spec) {
+  if (!strcmp(spec.type, "mqtt")) return new MqttSinkStage();
+  return nullptr;
+}
 
-  const uint16_t N = cfg.n_samples;
+// Default = the historical behaviour: RMS gate, raw int16 blobs over MQTT
+static uint8_t defaultPipelineSpecs(vib::pipe::StageSpec* specs) {
+  uint8_t n = 0;
+  specs[n++].setType("rms");
+  specs[n++].setType("peak");
+  specs[n].setType("gate");
+  specs[n].addStr("feature", "mag_rms");
+  specs[n++].addNum("min", cfg.mag_rms_threshold);
+  specs[n].setType("encode");
+  specs[n++].addStr("codec", "raw16");
+  specs[n++].setType("mqtt");
+  return n;
+}
 
-  static uint16_t dt_us_buf[2000];   // max N-1
-  static int16_t ax_mg_buf[2000];
-  static int16_t ay_mg_buf[2000];
-  static int16_t az_mg_buf[2000];
+static bool buildPipeline() {
+  vib::pipe::StageSpec specs[vib::pipe::kMaxStages];
+  uint8_t n = cfg.pipeline_n;
+
+  if (n == 0) {
+    n = defaultPipelineSpecs(specs);
+  } else {
+    for (uint8_t i = 0; i < n; i++) {
+      specs[i] = cfg.pipeline_specs[i];
+      // A gate without "min" uses acq.mag_rms_threshold
+      if (!strcmp(specs[i].type, "gate") && !specs[i].has("min")) {
+        specs[i].addNum("min", cfg.mag_rms_threshold);
+      }
+    }
+  }
 
-  uint64_t epoch_us0 = 0;
-  uint64_t dt_sum_us = 0;
+  char err[64];
+  if (!pipeline.build(specs, n, makeFirmwareStage, err, sizeof(err))) {
+    Serial.print("pipeline: ");
+    Serial.print(err);
+    Serial.println(" -> using default pipeline");
+    n = defaultPipelineSpecs(specs);
+    if (!pipeline.build(specs, n, makeFirmwareStage, err, sizeof(err))) return false;
+  }
+
+  char desc[96];
+  pipeline.describe(desc, sizeof(desc));
+  Serial.print("pipeline: ");
+  Serial.println(desc);
 
-  bool ok_acq = acquireN(N, cfg.fs_hz, epoch_us0,
-                         dt_us_buf,
-                         ax_mg_buf, ay_mg_buf, az_mg_buf,
-                         dt_sum_us);
+  fused_variant = vib::fused::match(pipeline, fused_covered);
+  Serial.printf("fused: %s (%u stages)\n", vib::fused::name(fused_variant), (unsigned)fused_covered);
+  return true;
+}
 
-  if (!ok_acq) {
-    Serial.println("Acquisition failed");
-    // Not specified; treat as sensor-ish failure (4)
-    failAndRestart(4);
+#ifdef VIB_GOLDEN_SELFTEST
+// Build with -D VIB_GOLDEN_SELFTEST to print the golden vectors at boot;
+// `vib_golden check <serial log>` on the host compares them with its own
+static void goldenSelfTest() {
+  static vib::pipe::Pipeline p;
+  vib::golden::Scratch s;
+  vib::pipe::Frame f;
+  char line[512];
+  for (size_t i = 0; i < vib::golden::kNumCases; i++) {
+    const vib::golden::Case& c = vib::golden::kCases[i];
+    if (!vib::golden::build(c, p, line, sizeof(line))) {
+      Serial.printf("golden: %s BUILD FAILED: %s\n", c.name, line);
+      continue;
+    }
+    vib::golden::run(c, p, s, f);
+    vib::golden::format(c, f, line, sizeof(line));
+    Serial.print("golden: ");
+    Serial.println(line);
   }
+  p.clear();
+}
+#endif
 
-  // -------------------------
-  // Timestamp coherence for meta (derived from t0_us)
-  // -------------------------
-  time_t t0_s = (time_t)(epoch_us0 / 1000000ULL);
-  char iso_us[48];
-  formatISO8601UTC_us(epoch_us0, iso_us, sizeof(iso_us));
+// -------------------------
+// Long capture: stream to flash, deferred upload
+// -------------------------
+// A sampler task, woken by a periodic esp_timer, reads the sensor and pushes
+// samples into a RAM ring. This task packs them into vib::rec blocks and
+// writes them to the raw "rec" partition, which is erased before the capture
+// so that capture-time writes are page programs only. Missed timer ticks and
+// a full ring are counted as lost samples (index gaps in the recording).
+// The recording is uploaded one block per message, resuming across wakes
+// from the cursor kept in /rec.json.
+static constexpr uint8_t REC_PART_SUBTYPE = 0x40;
+static const char* REC_STATE_PATH = "/rec.json";
+static constexpr size_t REC_RING_SAMPLES = 3072;   // ~3 s at 1 kHz
+static const char* REC_PYR_PATH = "/rec_pyr.bin";   // overview pyramid, sent after rec_meta
+static constexpr size_t PYR_REC_BYTES = 65536;      // 100:1 and coarser for ~4.6 min at 1 kHz
+
+struct RecSample {
+  uint32_t idx;
+  uint32_t t_us;     // since the nominal time of sample 0
+  int16_t d[3];      // sensor digits (raw >> 4)
+};
 
-  // -------------------------
-  // On-device validation prints
-  // -------------------------
-  const uint32_t target_period_us = 1000000UL / (uint32_t)cfg.fs_hz;
+struct RecState {
+  String id;
+  uint64_t t0_us = 0;          // epoch of sample 0
+  uint16_t fs_hz = 0;
+  uint8_t range_g = 0;
+  uint32_t n_target = 0;
+  uint32_t n_stored = 0;
+  uint32_t lost_sched = 0;     // timer ticks the sampler could not serve
+  uint32_t lost_ring = 0;      // ring full: flash writer fell behind
+  uint32_t lost_store = 0;     // partition full
+  uint32_t late_us_max = 0;    // worst sample delay vs its nominal time
+  uint32_t ring_hwm = 0;       // max ring fill, bytes
+  uint32_t blocks = 0;
+  uint32_t write_us_max = 0;
+  float write_kBps = 0.0f;     // bytes / time spent in flash writes
+  float sustained_kBps = 0.0f; // bytes / capture duration
+  uint32_t next_block = 0;     // upload cursor
+};
 
-  uint32_t dt_min = 0xFFFFFFFF, dt_max = 0;
-  uint64_t dt_sum_check = 0;
-  uint32_t sat_cnt = 0;
+static StreamBufferHandle_t rec_ring = nullptr;
+static TaskHandle_t rec_task = nullptr;
+static uint32_t rec_n_target = 0;
+static uint32_t rec_period_us = 1000;
+static int64_t rec_t0 = 0;
+static volatile bool rec_done = false;
+static volatile uint32_t rec_lost_sched = 0;
+static volatile uint32_t rec_lost_ring = 0;
+static volatile uint32_t rec_late_us_max = 0;
+
+static void recTick(void*) {
+  xTaskNotifyGive(rec_task);
+}
+
+static void recSamplerTask(void*) {
+  uint32_t idx = 0;
+  while (idx < rec_n_target) {
+    const uint32_t ticks = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+    if (ticks == 0) continue;
+    if (ticks > 1) {
+      // Blocked for whole periods: those samples are gone
+      uint32_t miss = ticks - 1;
+      if (miss > rec_n_target - idx) miss = rec_n_target - idx;
+      rec_lost_sched += miss;
+      idx += miss;
+      if (idx >= rec_n_target) break;
+    }
+
+    const int64_t t = esp_timer_get_time();
+    int16_t raw[3];
+    lisReadRaw(raw);
+
+    RecSample smp;
+    smp.idx = idx;
+    smp.t_us = (uint32_t)(t - rec_t0);
+    for (size_t k = 0; k < 3; k++) smp.d[k] = (int16_t)(raw[k] >> 4);
+
+    // Single producer: free space can only grow until the send
+    if (xStreamBufferSpacesAvailable(rec_ring) >= sizeof(smp)) {
+      xStreamBufferSend(rec_ring, &smp, sizeof(smp), 0);
+    } else {
+      rec_lost_ring++;
+    }
 
-  for (uint16_t i = 0; i < (N - 1); i++) {
-    uint32_t d = dt_us_buf[i];
-    dt_sum_check += d;
-    if (d < dt_min) dt_min = d;
-    if (d > dt_max) dt_max = d;
-    if (d == 65535) sat_cnt++;
+    const int64_t late = t - (rec_t0 + (int64_t)idx * (int64_t)rec_period_us);
+    if (late > (int64_t)rec_late_us_max) rec_late_us_max = (uint32_t)late;
+    idx++;
   }
+  rec_done = true;
+  for (;;) vTaskDelay(portMAX_DELAY);   // deleted by recCapture
+}
 
-  double dt_mean = (N > 1) ? ((double)dt_sum_check / (double)(N - 1)) : 0.0;
-  Serial.printf("dt stats: min=%lu us, max=%lu us, mean=%.2f us, target=%lu us, sat=%lu\n",
-                (unsigned long)dt_min,
-                (unsigned long)dt_max,
-                dt_mean,
-                (unsigned long)target_period_us,
-                (unsigned long)sat_cnt);
+// Creates the ring and starts the sampler (core 0) and its timer for
+// n_target samples at fs_hz. The first tick fires one period from now, at
+// rec_t0: that is sample 0. Returns the timer, nullptr if out of memory.
+static esp_timer_handle_t recSamplerStart(uint32_t n_target, uint16_t fs_hz) {
+  rec_ring = xStreamBufferCreate(REC_RING_SAMPLES * sizeof(RecSample), sizeof(RecSample));
+  if (!rec_ring) return nullptr;
+
+  rec_n_target = n_target;
+  rec_period_us = 1000000UL / (uint32_t)fs_hz;
+  rec_done = false;
+  rec_lost_sched = 0;
+  rec_lost_ring = 0;
+  rec_late_us_max = 0;
+  rec_t0 = esp_timer_get_time() + rec_period_us;
+
+  // Sampler on core 0, above this task; the consumer keeps core 1
+  xTaskCreatePinnedToCore(recSamplerTask, "rec_sampler", 4096, nullptr,
+                          configMAX_PRIORITIES - 2, &rec_task, 0);
+
+  esp_timer_handle_t tick = nullptr;
+  esp_timer_create_args_t targs = {};
+  targs.callback = recTick;
+  targs.name = "rec_tick";
+  esp_timer_create(&targs, &tick);
+  esp_timer_start_periodic(tick, rec_period_us);
+  return tick;
+}
 
-  Serial.printf("duration_est = %.3f ms (expected %.3f ms)\n",
-                (double)dt_sum_check / 1000.0,
-                (double)(N - 1) * (double)target_period_us / 1000.0);
+static void recSamplerStop(esp_timer_handle_t tick) {
+  esp_timer_stop(tick);
+  esp_timer_delete(tick);
+  vTaskDelay(pdMS_TO_TICKS(2));   // let an in-flight tick callback finish
+  vTaskDelete(rec_task);
+  rec_task = nullptr;
+  vStreamBufferDelete(rec_ring);
+  rec_ring = nullptr;
+}
 
-  // Cross-check end epoch vs t0 + sum(dt)
-  uint64_t epoch_us_end_now = epochUsNow();
-  uint64_t epoch_us_end_est = epoch_us0 + dt_sum_check;
-  int64_t err_us = (int64_t)(epoch_us_end_now - epoch_us_end_est);
+static const esp_partition_t* recPartition() {
+  return esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                  (esp_partition_subtype_t)REC_PART_SUBTYPE, "rec");
+}
 
-  Serial.printf("end check: now=%llu, est=%llu, err=%lld us\n",
-                (unsigned long long)epoch_us_end_now,
-                (unsigned long long)epoch_us_end_est,
-                (long long)err_us);
-  // -------------------------
-  // RMS magnitude gate
-  // -------------------------
+static bool recWriteBlock(const esp_partition_t* part, vib::rec::BlockHeader& h,
+                          const int16_t* digits, RecState& st, uint64_t& write_us_sum) {
+  static uint8_t blk[vib::rec::kBlockBytes];
+  h.seq = (uint16_t)st.blocks;
+  if (!vib::rec::pack_block(h, digits, blk)) return false;
 
-  float mag_rms = computeMagRms_mps2(ax_mg_buf, ay_mg_buf, az_mg_buf, N);
-  Serial.printf("mag_rms=%.3f m/s^2 (threshold=%.2f)\n", mag_rms, cfg.mag_rms_threshold);
+  const int64_t t = esp_timer_get_time();
+  if (esp_partition_write(part, (size_t)st.blocks * vib::rec::kBlockBytes, blk, sizeof(blk)) != ESP_OK) {
+    Serial.println("long capture: flash write failed");
+    return false;
+  }
+  const uint32_t us = (uint32_t)(esp_timer_get_time() - t);
+  write_us_sum += us;
+  if (us > st.write_us_max) st.write_us_max = us;
 
-  if (mag_rms < cfg.mag_rms_threshold) {
-    // Do not publish
-    pixelBlink(C_YELLOW(), 3, 400, 400);  // 3 yellow blinks, 400 ms
-    pixelSetSolid(C_OFF());
-    goToSleep(cfg.sleep_s);
-    return;
+  st.blocks++;
+  st.n_stored += h.n;
+  h.n = 0;
+  return true;
+}
+
+static bool recSaveState(const RecState& st) {
+  JsonDocument doc;
+  doc["id"]             = st.id;
+  doc["t0_us"]          = st.t0_us;
+  doc["fs"]             = st.fs_hz;
+  doc["range_g"]        = st.range_g;
+  doc["n"]              = st.n_target;
+  doc["stored"]         = st.n_stored;
+  doc["lost_sched"]     = st.lost_sched;
+  doc["lost_ring"]      = st.lost_ring;
+  doc["lost_store"]     = st.lost_store;
+  doc["late_us_max"]    = st.late_us_max;
+  doc["ring_hwm"]       = st.ring_hwm;
+  doc["blocks"]         = st.blocks;
+  doc["write_us_max"]   = st.write_us_max;
+  doc["write_kBps"]     = st.write_kBps;
+  doc["sustained_kBps"] = st.sustained_kBps;
+  doc["next_block"]     = st.next_block;
+
+  File f = LittleFS.open(REC_STATE_PATH, "w");
+  if (!f) return false;
+  const bool ok = serializeJson(doc, f) > 0;
+  f.close();
+  return ok;
+}
+
+static bool recLoadState(RecState& st) {
+  String json;
+  if (!readFileToString(REC_STATE_PATH, json)) return false;
+  JsonDocument doc;
+  if (deserializeJson(doc, json)) return false;
+
+  st.id             = doc["id"] | String("");
+  st.t0_us          = doc["t0_us"] | (uint64_t)0;
+  st.fs_hz          = doc["fs"] | 0;
+  st.range_g        = doc["range_g"] | 24;
+  st.n_target       = doc["n"] | 0UL;
+  st.n_stored       = doc["stored"] | 0UL;
+  st.lost_sched     = doc["lost_sched"] | 0UL;
+  st.lost_ring      = doc["lost_ring"] | 0UL;
+  st.lost_store     = doc["lost_store"] | 0UL;
+  st.late_us_max    = doc["late_us_max"] | 0UL;
+  st.ring_hwm       = doc["ring_hwm"] | 0UL;
+  st.blocks         = doc["blocks"] | 0UL;
+  st.write_us_max   = doc["write_us_max"] | 0UL;
+  st.write_kBps     = doc["write_kBps"] | 0.0f;
+  st.sustained_kBps = doc["sustained_kBps"] | 0.0f;
+  st.next_block     = doc["next_block"] | 0UL;
+  return !st.id.isEmpty() && st.next_block < st.blocks;
+}
+
+static bool recCapture(RecState& st) {
+  const esp_partition_t* part = recPartition();
+  if (!part) {
+    Serial.println("long capture: no 'rec' partition (see partitions_adafruit_no_ota.csv)");
+    return false;
   }
-  // -------------------------
-  // Publish
-  // -------------------------
-  pixelBlink(C_GREEN(), 5, 350, 350);
-  char id_msg[64];
-  makeIdMsg(id_msg, sizeof(id_msg), epoch_us0);
 
-  // 1) meta (coherent with acquisition t0)
-  bool ok = publishMetaCbor(id_msg, epoch_us0, t0_s, iso_us, ntp_ok, N, cfg.fs_hz);
-  Serial.print("pub meta: "); Serial.println(ok ? "ok" : "fail");
+  const uint32_t spb = (uint32_t)vib::rec::kSamplesPerBlock;
+  const uint32_t part_blocks = part->size / vib::rec::kBlockBytes;
+  const uint32_t spare = part_blocks / 8;   // gaps split blocks early
 
-  // Pack dt (N-1) into bytes (u16le)
-  const uint16_t dt_count = (N > 0) ? (N - 1) : 0;
-  static uint8_t dt_bytes[2 * 2000];
-  for (uint16_t i = 0; i < dt_count; i++) {
-    put_u16_le(&dt_bytes[2 * i], dt_us_buf[i]);
+  uint32_t n_target = (uint32_t)cfg.long_s * (uint32_t)cfg.fs_hz;
+  const uint32_t n_cap = (part_blocks - spare) * spb;
+  if (n_target > n_cap) {
+    Serial.printf("long capture: %lu samples exceed the partition, capped to %lu\n",
+                  (unsigned long)n_target, (unsigned long)n_cap);
+    n_target = n_cap;
   }
 
-  // Pack axes into bytes (i16le)
-  static uint8_t x_bytes[2 * 2000];
-  static uint8_t y_bytes[2 * 2000];
-  static uint8_t z_bytes[2 * 2000];
+  uint32_t max_blocks = (n_target + spb - 1) / spb + spare;
+  if (max_blocks > part_blocks) max_blocks = part_blocks;
+  size_t erase_bytes = ((size_t)max_blocks * vib::rec::kBlockBytes + 4095) & ~(size_t)4095;
+  if (erase_bytes > part->size) erase_bytes = part->size;
+  max_blocks = erase_bytes / vib::rec::kBlockBytes;
 
-  for (uint16_t i = 0; i < N; i++) {
-    put_i16_le(&x_bytes[2 * i], ax_mg_buf[i]);
-    put_i16_le(&y_bytes[2 * i], ay_mg_buf[i]);
-    put_i16_le(&z_bytes[2 * i], az_mg_buf[i]);
+  int64_t t_erase = esp_timer_get_time();
+  if (esp_partition_erase_range(part, 0, erase_bytes) != ESP_OK) {
+    Serial.println("long capture: erase failed");
+    return false;
   }
+  Serial.printf("long capture: erased %u kB in %lu ms\n", (unsigned)(erase_bytes / 1024),
+                (unsigned long)((esp_timer_get_time() - t_erase) / 1000));
 
-  // 2..5) blobs (parts=1 for now)
-  const uint16_t parts = 1;
+  st = RecState();
+  st.fs_hz = cfg.fs_hz;
+  st.range_g = cfg.range_g;
+  st.n_target = n_target;
 
-  ok = publishBlobCbor("dt", id_msg, "dt", dt_bytes, (size_t)dt_count * 2, 0, parts);
-  Serial.print("pub dt: "); Serial.println(ok ? "ok" : "fail");
+  esp_timer_handle_t tick = recSamplerStart(n_target, cfg.fs_hz);
+  if (!tick) {
+    Serial.println("long capture: no memory for ring");
+    return false;
+  }
+  clockUpdate();
+  st.t0_us = clockEpochAt(rec_t0);
+  char id[64];
+  makeIdMsg(id, sizeof(id), st.t0_us);
+  st.id = id;
+
+  Serial.printf("long capture: %lu samples @ %u Hz (%s)\n",
+                (unsigned long)n_target, (unsigned)cfg.fs_hz, st.id.c_str());
+
+  // Overview pyramid, built as samples are stored (optional: heap permitting)
+  vib::pyr::Builder pyr;
+  uint8_t* pyr_buf = cfg.pyr_factor ? (uint8_t*)malloc(PYR_REC_BYTES) : nullptr;
+  const bool pyr_on = pyr_buf && pyr.begin(n_target, cfg.pyr_factor, pyr_buf, PYR_REC_BYTES);
+  const int16_t so_mg = (int16_t)vib::fx::mg_per_digit(cfg.range_g);
+  LittleFS.remove(REC_PYR_PATH);
+
+  static int16_t digits[vib::rec::kSamplesPerBlock * 3];
+  vib::rec::BlockHeader h;
+  uint32_t next_idx = 0;
+  uint64_t write_us_sum = 0;
+  uint32_t last_mqtt_ms = millis();
+  uint32_t last_t_us = 0;
+  bool ok = true;
+
+  while (ok) {
+    const size_t fill = xStreamBufferBytesAvailable(rec_ring);
+    if (fill > st.ring_hwm) st.ring_hwm = fill;
+
+    RecSample batch[32];
+    const size_t got = xStreamBufferReceive(rec_ring, batch, sizeof(batch), pdMS_TO_TICKS(20)) / sizeof(RecSample);
+
+    for (size_t i = 0; i < got && ok; i++) {
+      const RecSample& smp = batch[i];
+      // A block is a gap-free run of samples
+      if (h.n && (smp.idx != next_idx || h.n == spb)) {
+        if (st.blocks < max_blocks) ok = recWriteBlock(part, h, digits, st, write_us_sum);
+        else { st.lost_store += h.n; h.n = 0; }
+      }
+      if (h.n == 0) {
+        h.first_idx = smp.idx;
+        h.t_us = smp.t_us;
+      }
+      memcpy(&digits[(size_t)h.n * 3], smp.d, sizeof(smp.d));
+      if (pyr_on) {
+        const int16_t mg[3] = { (int16_t)(smp.d[0] * so_mg), (int16_t)(smp.d[1] * so_mg), (int16_t)(smp.d[2] * so_mg) };
+        pyr.push(smp.idx, mg);
+      }
+      h.n++;
+      next_idx = smp.idx + 1;
+      last_t_us = smp.t_us;
+    }
 
-  delay(3000);
-  ok = publishBlobCbor("x", id_msg, "a", x_bytes, (size_t)N * 2, 0, parts);
-  Serial.print("pub x: "); Serial.println(ok ? "ok" : "fail");
+    // Keep the broker session alive during minutes-long captures
+    if (millis() - last_mqtt_ms >= 100) {
+      mqtt.loop();
+      last_mqtt_ms = millis();
+    }
 
-  delay(3000);
-  ok = publishBlobCbor("y", id_msg, "a", y_bytes, (size_t)N * 2, 0, parts);
-  Serial.print("pub y: "); Serial.println(ok ? "ok" : "fail");
+    if (rec_done && xStreamBufferBytesAvailable(rec_ring) == 0) break;
+  }
+  if (ok && h.n) {
+    if (st.blocks < max_blocks) ok = recWriteBlock(part, h, digits, st, write_us_sum);
+    else st.lost_store += h.n;
+  }
 
-  delay(3000);
-  ok = publishBlobCbor("z", id_msg, "a", z_bytes, (size_t)N * 2, 0, parts);
-  Serial.print("pub z: "); Serial.println(ok ? "ok" : "fail");
+  recSamplerStop(tick);
 
-  // Final flush window before sleep
-  uint32_t t0 = millis();
-  while (millis() - t0 < 3000) {
-    mqtt.loop();
-    delay(10);
+  if (pyr_on) {
+    const size_t len = pyr.finish();
+    File pf = LittleFS.open(REC_PYR_PATH, "w");
+    if (!pf || pf.write(pyr_buf, len) != len) {
+      Serial.println("long capture: pyramid not saved");
+    } else {
+      Serial.printf("long capture: pyramid %u B\n", (unsigned)len);
+    }
+    if (pf) pf.close();
   }
+  free(pyr_buf);
+
+  st.lost_sched = rec_lost_sched;
+  st.lost_ring = rec_lost_ring;
+  st.late_us_max = rec_late_us_max;
+
+  const double bytes = (double)st.blocks * (double)vib::rec::kBlockBytes;
+  st.write_kBps = write_us_sum ? (float)(bytes * 1000.0 / (double)write_us_sum) / 1.024f : 0.0f;
+  st.sustained_kBps = last_t_us ? (float)(bytes * 1000.0 / (double)last_t_us) / 1.024f : 0.0f;
+  const float need_kBps = (float)cfg.fs_hz * (float)vib::rec::kBlockBytes / (float)spb / 1024.0f;
+
+  Serial.printf("long capture: stored=%lu/%lu lost sched=%lu ring=%lu store=%lu late_max=%lu us\n",
+                (unsigned long)st.n_stored, (unsigned long)st.n_target,
+                (unsigned long)st.lost_sched, (unsigned long)st.lost_ring,
+                (unsigned long)st.lost_store, (unsigned long)st.late_us_max);
+  Serial.printf("long capture: %lu blocks, flash %.1f kB/s (max write %lu us), sustained %.1f kB/s, need %.1f kB/s, ring hwm %lu/%u B\n",
+                (unsigned long)st.blocks, st.write_kBps, (unsigned long)st.write_us_max,
+                st.sustained_kBps, need_kBps, (unsigned long)st.ring_hwm,
+                (unsigned)(REC_RING_SAMPLES * sizeof(RecSample)));
+  return ok && st.blocks > 0;
+}
 
-  // Success pattern: 3 green blinks, then sleep
-  pixelSetSolid(C_OFF());
-  goToSleep(cfg.sleep_s);
+static bool publishRecMetaCbor(const RecState& st) {
+  uint8_t buf[512];
+  CborEncoder root, map;
+
+  cbor_encoder_init(&root, buf, sizeof(buf), 0);
+  CborError err = cbor_encoder_create_map(&root, &map, CborIndefiniteLength);
+  if (err) return false;
+
+  char iso[40];
+  formatISO8601UTC_us(st.t0_us, iso, sizeof(iso));
+
+  err = cbor_encode_text_stringz(&map, "type"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, "rec_meta"); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "id"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, st.id.c_str()); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "dev"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, cfg.client_id.c_str()); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "iso"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, iso); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "t0_us"); if (err) return false;
+  err = cbor_encode_uint(&map, st.t0_us); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "fs"); if (err) return false;
+  err = cbor_encode_uint(&map, st.fs_hz); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "so_mg"); if (err) return false;
+  err = cbor_encode_uint(&map, (uint64_t)vib::fx::mg_per_digit(st.range_g)); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "blk_fmt"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, "vrb1"); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "blk_bytes"); if (err) return false;
+  err = cbor_encode_uint(&map, vib::rec::kBlockBytes); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "blocks"); if (err) return false;
+  err = cbor_encode_uint(&map, st.blocks); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "upload"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, cfg.upload_url.isEmpty() ? "mqtt" : "http"); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "n"); if (err) return false;
+  err = cbor_encode_uint(&map, st.n_target); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "stored"); if (err) return false;
+  err = cbor_encode_uint(&map, st.n_stored); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "lost_sched"); if (err) return false;
+  err = cbor_encode_uint(&map, st.lost_sched); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "lost_ring"); if (err) return false;
+  err = cbor_encode_uint(&map, st.lost_ring); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "lost_store"); if (err) return false;
+  err = cbor_encode_uint(&map, st.lost_store); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "late_us_max"); if (err) return false;
+  err = cbor_encode_uint(&map, st.late_us_max); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "ring_hwm"); if (err) return false;
+  err = cbor_encode_uint(&map, st.ring_hwm); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "write_us_max"); if (err) return false;
+  err = cbor_encode_uint(&map, st.write_us_max); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "write_kBps"); if (err) return false;
+  err = cbor_encode_float(&map, st.write_kBps); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "sustained_kBps"); if (err) return false;
+  err = cbor_encode_float(&map, st.sustained_kBps); if (err) return false;
+
+  err = cbor_encoder_close_container(&root, &map); if (err) return false;
+
+  size_t nbytes = cbor_encoder_get_buffer_size(&root, buf);
+  return mqttPublishCbor(buf, nbytes);
+}
+
+// -------------------------
+// Bulk HTTP upload of long recordings
+// -------------------------
+// With upload.url set, the blocks of a recording go as one chunked HTTP POST
+// instead of one MQTT message each (rec_meta and the pyramid stay on MQTT).
+// On one keep-alive connection:
+//
+//   GET  <path>?id=<rec id>
+//        -> 200, "X-Next-Block: k": the server holds blocks 0..k-1
+//   POST <path>?id=<rec id>&from=k&blocks=<total>
+//        Content-Type: application/vnd.vib.rec, Transfer-Encoding: chunked
+//        body: blocks k.. in order, each as a VRD1 record (vib_rec.h) or,
+//              when that is not smaller, as the stored VRB1 block
+//        -> 200, "X-Next-Block": blocks held after this request
+//
+// The server keeps every complete record, so a drain cut at any byte
+// resumes from what it really holds, without gaps or duplicates (a POST
+// whose from is not what the server holds gets 409). tools/rec_http_sink.cpp
+// is a local test server.
+static constexpr size_t HTTP_CHUNK = 4096;          // body bytes per HTTP chunk
+static constexpr uint32_t HTTP_TIMEOUT_MS = 10000;
+
+struct HttpUrl {
+  bool tls = false;
+  String host;
+  uint16_t port = 80;
+  String path = "/";
+};
+
+static bool parseHttpUrl(const String& url, HttpUrl& u) {
+  String rest;
+  if (url.startsWith("https://"))     { u.tls = true;  u.port = 443; rest = url.substring(8); }
+  else if (url.startsWith("http://")) { u.tls = false; u.port = 80;  rest = url.substring(7); }
+  else return false;
+
+  const int slash = rest.indexOf('/');
+  String hostport = (slash < 0) ? rest : rest.substring(0, slash);
+  u.path = (slash < 0) ? String("/") : rest.substring(slash);
+  const int colon = hostport.indexOf(':');
+  if (colon >= 0) {
+    const long port = hostport.substring(colon + 1).toInt();
+    if (port <= 0 || port > 65535) return false;
+    u.port = (uint16_t)port;
+    hostport = hostport.substring(0, colon);
+  }
+  u.host = hostport;
+  return !u.host.isEmpty();
+}
+
+static bool httpWrite(Client& c, const String& s) {
+  return c.write((const uint8_t*)s.c_str(), s.length()) == s.length();
+}
+
+static bool httpWriteChunk(Client& c, const uint8_t* data, size_t len) {
+  char hdr[12];
+  const int h = snprintf(hdr, sizeof(hdr), "%X\r\n", (unsigned)len);
+  if (c.write((const uint8_t*)hdr, h) != (size_t)h) return false;
+  if (len && c.write(data, len) != len) return false;
+  return c.write((const uint8_t*)"\r\n", 2) == 2;
+}
+
+// Request line + common headers; q is the query string
+static String httpRequestHead(const char* method, const HttpUrl& u, const String& q) {
+  String h = String(method) + " " + u.path + (u.path.indexOf('?') < 0 ? "?" : "&") + q + " HTTP/1.1\r\n";
+  h += "Host: " + u.host + "\r\n";
+  if (!cfg.upload_token.isEmpty()) h += "Authorization: Bearer " + cfg.upload_token + "\r\n";
+  return h;
+}
+
+// Reads one response: returns the status code (0 on timeout or garbage) and
+// X-Next-Block (-1 if absent). A Content-Length body is read and dropped.
+static int httpReadResponse(Client& c, long& next_block) {
+  next_block = -1;
+  c.setTimeout(HTTP_TIMEOUT_MS);
+  String line = c.readStringUntil('\n');
+  if (!line.startsWith("HTTP/1.") || line.length() < 12) return 0;
+  const int status = (int)line.substring(9, 12).toInt();
+  long body = 0;
+  for (;;) {
+    line = c.readStringUntil('\n');
+    line.trim();
+    if (line.isEmpty()) break;
+    if (line.length() > 13 && line.substring(0, 13).equalsIgnoreCase("X-Next-Block:")) {
+      next_block = line.substring(13).toInt();
+    } else if (line.length() > 15 && line.substring(0, 15).equalsIgnoreCase("Content-Length:")) {
+      body = line.substring(15).toInt();
+    }
+  }
+  uint8_t skip[64];
+  while (body > 0) {
+    const size_t n = c.readBytes(skip, body < (long)sizeof(skip) ? (size_t)body : sizeof(skip));
+    if (!n) break;
+    body -= (long)n;
+  }
+  return status;
+}
+
+// Streams blocks from the server's cursor on for up to budget_ms and moves
+// st.next_block to what it acknowledged. False if the server gave no resume
+// point (the caller then falls back to MQTT).
+static bool recUploadHttp(RecState& st, const esp_partition_t* part, uint32_t budget_ms) {
+  HttpUrl u;
+  if (!parseHttpUrl(cfg.upload_url, u)) {
+    Serial.printf("bulk upload: bad upload.url '%s'\n", cfg.upload_url.c_str());
+    return false;
+  }
+
+  static WiFiClientSecure tls;
+  static WiFiClient plain;
+  if (u.tls) tls.setCACert(ca_pem.c_str());
+  Client& c = u.tls ? static_cast<Client&>(tls) : static_cast<Client&>(plain);
+
+  const uint32_t t0 = millis();
+  if (!c.connect(u.host.c_str(), u.port)) {
+    Serial.printf("bulk upload: cannot connect to %s:%u\n", u.host.c_str(), (unsigned)u.port);
+    return false;
+  }
+
+  // Resume point: the server may hold more than the cursor (an answer was
+  // lost) or less (a drain was cut mid-stream)
+  long next = -1;
+  int status = httpWrite(c, httpRequestHead("GET", u, "id=" + st.id) + "Connection: keep-alive\r\n\r\n")
+               ? httpReadResponse(c, next) : 0;
+  if (status != 200 || next < 0 || (uint32_t)next > st.blocks) {
+    Serial.printf("bulk upload: no resume point from the server (status %d)\n", status);
+    c.stop();
+    return false;
+  }
+  st.next_block = (uint32_t)next;
+  const uint32_t from = st.next_block;
+  if (from >= st.blocks) {
+    c.stop();
+    return true;
+  }
+  if (!c.connected() && !c.connect(u.host.c_str(), u.port)) {
+    Serial.println("bulk upload: server closed the connection");
+    return true;
+  }
+
+  static uint8_t blk[vib::rec::kBlockBytes];
+  static uint8_t rec[vib::rec::kDeltaMaxBytes];
+  static uint8_t body[HTTP_CHUNK];
+
+  bool ok = httpWrite(c, httpRequestHead("POST", u, "id=" + st.id + "&from=" + String(from) +
+                                         "&blocks=" + String(st.blocks)) +
+                         "Content-Type: application/vnd.vib.rec\r\n"
+                         "Transfer-Encoding: chunked\r\n"
+                         "Connection: close\r\n\r\n");
+  uint32_t b = from;
+  uint32_t wire = 0;
+  size_t fill = 0;
+  uint32_t last_mqtt_ms = millis();
+  while (ok && b < st.blocks && millis() - t0 < budget_ms) {
+    if (esp_partition_read(part, (size_t)b * sizeof(blk), blk, sizeof(blk)) != ESP_OK) break;
+    size_t len = vib::rec::to_delta(blk, rec, sizeof(rec));
+    const uint8_t* r = rec;
+    if (!len) { r = blk; len = sizeof(blk); }
+    if (fill + len > sizeof(body)) {
+      ok = httpWriteChunk(c, body, fill);
+      wire += fill;
+      fill = 0;
+    }
+    memcpy(body + fill, r, len);
+    fill += len;
+    b++;
+    // Keep the broker session alive during long drains
+    if (millis() - last_mqtt_ms >= 1000) {
+      mqtt.loop();
+      last_mqtt_ms = millis();
+    }
+  }
+  if (ok && fill) { ok = httpWriteChunk(c, body, fill); wire += fill; }
+  if (ok) ok = httpWriteChunk(c, nullptr, 0);
+
+  status = ok ? httpReadResponse(c, next) : 0;
+  c.stop();
+  if ((status == 200 || status == 409) && next >= 0 && (uint32_t)next <= st.blocks) {
+    st.next_block = (uint32_t)next;
+  } else {
+    // The next GET learns how far the server got
+    Serial.printf("bulk upload: %s (status %d)\n", ok ? "no resume point in the answer" : "connection lost", status);
+  }
+
+  const uint32_t ms = millis() - t0;
+  const uint32_t acked = (st.next_block > from) ? st.next_block - from : 0;
+  Serial.printf("bulk upload: %lu blocks acknowledged, %lu B sent for %lu B stored (%.0f%%), %lu ms (%.1f kB/s)\n",
+                (unsigned long)acked, (unsigned long)wire,
+                (unsigned long)((b - from) * sizeof(blk)),
+                (b > from) ? 100.0f * (float)wire / (float)((b - from) * sizeof(blk)) : 0.0f,
+                (unsigned long)ms, ms ? (float)wire / (float)ms / 1.024f : 0.0f);
+  return true;
+}
+
+// Uploads blocks from the cursor on for up to budget_ms. Returns true once
+// the whole recording is sent (its state file is then removed).
+static bool recUpload(RecState& st, uint32_t budget_ms) {
+  const esp_partition_t* part = recPartition();
+  if (!part) return false;
+
+  static uint8_t blk[vib::rec::kBlockBytes];
+
+  if (st.next_block == 0) {
+    if (!publishRecMetaCbor(st)) {
+      Serial.println("long capture: meta publish failed");
+      return false;
+    }
+    // Overview first, so a viewer can draw the recording before the blocks arrive
+    File pf = LittleFS.open(REC_PYR_PATH, "r");
+    if (pf) {
+      const size_t len = pf.size();
+      const uint16_t parts = (uint16_t)((len + sizeof(blk) - 1) / sizeof(blk));
+      for (uint16_t i = 0; i < parts; i++) {
+        const size_t n = pf.read(blk, sizeof(blk));
+        if (!n || !publishBlobCbor("pyr", st.id.c_str(), "pyr", blk, n, i, parts, 0)) {
+          Serial.println("long capture: pyramid publish failed");
+          break;
+        }
+      }
+      pf.close();
+    }
+  }
+
+  const uint32_t t0 = millis();
+  const uint32_t from = st.next_block;
+  uint32_t sent = 0;
+
+  const bool http = !cfg.upload_url.isEmpty() && recUploadHttp(st, part, budget_ms);
+
+  while (!http && st.next_block < st.blocks && millis() - t0 < budget_ms) {
+    if (!mqtt.connected() && !connectMQTT()) break;
+    if (esp_partition_read(part, (size_t)st.next_block * sizeof(blk), blk, sizeof(blk)) != ESP_OK) break;
+    if (!publishBlobCbor("rec", st.id.c_str(), "blk", blk, sizeof(blk),
+                         (uint16_t)st.next_block, (uint16_t)st.blocks, 0)) break;
+    st.next_block++;
+    sent++;
+    // Resume point survives a reset mid-upload
+    if ((sent % 64) == 0) recSaveState(st);
+  }
+
+  const uint32_t ms = millis() - t0;
+  const uint32_t done = (st.next_block > from) ? st.next_block - from : 0;
+  Serial.printf("long capture upload (%s): %lu blocks in %lu ms (%.1f kB/s), %lu/%lu done\n",
+                http ? "http" : "mqtt", (unsigned long)done, (unsigned long)ms,
+                ms ? (float)done * (float)sizeof(blk) / (float)ms / 1.024f : 0.0f,
+                (unsigned long)st.next_block, (unsigned long)st.blocks);
+
+  if (st.next_block >= st.blocks) {
+    LittleFS.remove(REC_STATE_PATH);
+    LittleFS.remove(REC_PYR_PATH);
+    return true;
+  }
+  recSaveState(st);
+  return false;
+}
+
+// -------------------------
+// Trend logging: 0.1-10 Hz in light sleep
+// -------------------------
+// For slow processes (thermal drift, tilt). The radio is off, the sensor
+// runs in its low-power mode and the CPU light-sleeps between samples.
+// Samples live in RTC memory with a 64-bit base epoch and u32 ms offsets
+// (49 days of range, instead of the u16 us dt of bursts), so a batch
+// survives the deep sleep that ends the session; the next boot uploads it
+// and starts the next batch.
+static constexpr uint16_t TREND_PART = 128;          // samples per message
+static constexpr uint32_t TREND_MAGIC = 0x314E5254;  // "TRN1"
+
+struct TrendSample {
+  uint32_t t_ms;     // since base_epoch_us
+  int16_t mg[3];
+};
+
+struct TrendRtc {
+  uint32_t magic;
+  uint64_t base_epoch_us;
+  float hz;
+  uint8_t range_g;
+  uint8_t ntp_ok;
+  uint16_t n;
+  uint32_t awake_ms;         // CPU awake time while logging this batch
+  uint32_t span_ms;          // wall time of this batch
+  TrendSample s[TREND_MAX];
+};
+
+static RTC_DATA_ATTR TrendRtc trend_rtc;
+
+static void lisSetTrendRate(float hz) {
+  if (hz <= 0.5f) lis.setDataRate(LIS331_DATARATE_LOWPOWER_0_5_HZ);
+  else if (hz <= 1.0f) lis.setDataRate(LIS331_DATARATE_LOWPOWER_1_HZ);
+  else if (hz <= 2.0f) lis.setDataRate(LIS331_DATARATE_LOWPOWER_2_HZ);
+  else if (hz <= 5.0f) lis.setDataRate(LIS331_DATARATE_LOWPOWER_5_HZ);
+  else lis.setDataRate(LIS331_DATARATE_LOWPOWER_10_HZ);
+}
+
+static bool publishTrendMetaCbor(const char* id_msg, uint16_t parts) {
+  uint8_t buf[384];
+  CborEncoder root, map;
+
+  cbor_encoder_init(&root, buf, sizeof(buf), 0);
+  CborError err = cbor_encoder_create_map(&root, &map, CborIndefiniteLength);
+  if (err) return false;
+
+  char iso[40];
+  formatISO8601UTC_us(trend_rtc.base_epoch_us, iso, sizeof(iso));
+
+  err = cbor_encode_text_stringz(&map, "type"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, "trend_meta"); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "id"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, id_msg); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "dev"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, cfg.client_id.c_str()); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "ntp"); if (err) return false;
+  err = cbor_encode_uint(&map, trend_rtc.ntp_ok); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "iso"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, iso); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "t0_us"); if (err) return false;
+  err = cbor_encode_uint(&map, trend_rtc.base_epoch_us); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "fs"); if (err) return false;
+  err = cbor_encode_float(&map, trend_rtc.hz); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "range_g"); if (err) return false;
+  err = cbor_encode_uint(&map, trend_rtc.range_g); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "n"); if (err) return false;
+  err = cbor_encode_uint(&map, trend_rtc.n); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "parts"); if (err) return false;
+  err = cbor_encode_uint(&map, parts); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "rec_fmt"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, "u32le_ms,i16le_mg*3"); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "awake_ms"); if (err) return false;
+  err = cbor_encode_uint(&map, trend_rtc.awake_ms); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "span_ms"); if (err) return false;
+  err = cbor_encode_uint(&map, trend_rtc.span_ms); if (err) return false;
+
+  err = cbor_encoder_close_container(&root, &map); if (err) return false;
+
+  size_t nbytes = cbor_encoder_get_buffer_size(&root, buf);
+  return mqttPublishCbor(buf, nbytes);
+}
+
+// Publishes the batch held in RTC memory; true if there was nothing to send
+// or it was sent (the buffer is then emptied).
+static bool trendUpload() {
+  if (trend_rtc.magic != TREND_MAGIC || trend_rtc.n == 0) return true;
+
+  char id_msg[64];
+  makeIdMsg(id_msg, sizeof(id_msg), trend_rtc.base_epoch_us);
+  const uint16_t parts = (uint16_t)((trend_rtc.n + TREND_PART - 1) / TREND_PART);
+  if (!publishTrendMetaCbor(id_msg, parts)) return false;
+
+  static uint8_t buf[TREND_PART * 10];
+  for (uint16_t p = 0; p < parts; p++) {
+    size_t o = 0;
+    for (uint16_t i = p * TREND_PART; i < trend_rtc.n && i < (p + 1) * TREND_PART; i++) {
+      const TrendSample& ts = trend_rtc.s[i];
+      put_u16_le(&buf[o], (uint16_t)ts.t_ms);
+      put_u16_le(&buf[o + 2], (uint16_t)(ts.t_ms >> 16));
+      for (size_t k = 0; k < 3; k++) put_u16_le(&buf[o + 4 + 2 * k], (uint16_t)ts.mg[k]);
+      o += 10;
+    }
+    if (!publishBlobCbor("trend", id_msg, "rec", buf, o, p, parts, 0)) return false;
+  }
+
+  Serial.printf("trend: uploaded %u samples (%s)\n", (unsigned)trend_rtc.n, id_msg);
+  trend_rtc.n = 0;
+  return true;
+}
+
+// Logs until the batch is full. Turns the radio off. Returns false if the
+// batch was already full (upload pending).
+static bool trendLog() {
+  if (trend_rtc.magic != TREND_MAGIC || trend_rtc.n == 0 ||
+      trend_rtc.hz != cfg.trend_hz || trend_rtc.range_g != cfg.range_g) {
+    if (trend_rtc.magic == TREND_MAGIC && trend_rtc.n) {
+      Serial.printf("trend: config changed, dropping %u unsent samples\n", (unsigned)trend_rtc.n);
+    }
+    trend_rtc.magic = TREND_MAGIC;
+    trend_rtc.base_epoch_us = clockEpochNow();
+    trend_rtc.hz = cfg.trend_hz;
+    trend_rtc.range_g = cfg.range_g;
+    trend_rtc.ntp_ok = ntp_synced ? 1 : 0;
+    trend_rtc.n = 0;
+    trend_rtc.awake_ms = 0;
+    trend_rtc.span_ms = 0;
+  }
+  if (trend_rtc.n >= cfg.trend_batch) {
+    Serial.println("trend: batch full and not uploaded yet");
+    return false;
+  }
+
+  radioEnd();
+  mqtt.disconnect();
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+  pixelSetSolid(C_OFF());
+  lisSetTrendRate(cfg.trend_hz);
+
+  Serial.printf("trend: logging %u samples @ %.2f Hz in light sleep\n",
+                (unsigned)(cfg.trend_batch - trend_rtc.n), cfg.trend_hz);
+  Serial.flush();
+
+  const int64_t period_us = (int64_t)(1000000.0f / cfg.trend_hz);
+  const int64_t t_start = esp_timer_get_time();   // keeps counting in light sleep
+  int64_t next = t_start;
+  int64_t awake_us = 0;
+
+  while (trend_rtc.n < cfg.trend_batch) {
+    const int64_t t_wake = esp_timer_get_time();
+
+    int16_t raw[3];
+    lisReadRaw(raw);
+    TrendSample& ts = trend_rtc.s[trend_rtc.n];
+    ts.t_ms = (uint32_t)((clockEpochNow() - trend_rtc.base_epoch_us) / 1000ULL);
+    for (size_t k = 0; k < 3; k++) ts.mg[k] = lisRawToMg(raw[k]);
+    trend_rtc.n++;
+
+    next += period_us;
+    const int64_t now = esp_timer_get_time();
+    awake_us += now - t_wake;
+    if (trend_rtc.n >= cfg.trend_batch) break;
+    if (next > now) {
+      esp_sleep_enable_timer_wakeup((uint64_t)(next - now));
+      esp_light_sleep_start();
+    }
+  }
+
+  const int64_t span_us = esp_timer_get_time() - t_start;
+  trend_rtc.awake_ms += (uint32_t)(awake_us / 1000);
+  trend_rtc.span_ms += (uint32_t)(span_us / 1000);
+  Serial.printf("trend: %u samples, awake %lu ms of %lu ms\n", (unsigned)trend_rtc.n,
+                (unsigned long)trend_rtc.awake_ms, (unsigned long)trend_rtc.span_ms);
+  return true;
+}
+
+// -------------------------
+// Continuous spectrum
+// -------------------------
+// acq.mode "spectrum": for acq.long_s seconds the long-capture sampler feeds
+// a vib::sdft::Sliding3 and, every spectrum.publish_ms of samples, the
+// Hann-windowed power of the last spectrum.nfft samples between f_lo_hz and
+// f_hi_hz goes out as one "spec" message. The engine is the sliding DFT
+// (constant work per sample) or an FFT per message, whichever
+// Sliding3::prefer_sliding() finds cheaper for the band and cadence, unless
+// spectrum.engine forces one. Lost samples are filled with the last value
+// (the window stays contiguous) and counted.
+static constexpr size_t SPEC_MSG_MAX = 1400;   // <= MQTT_MAX_PACKET_SIZE with topic
+
+// Power in centi-dB re 1 mg^2 (0 at or below 1 mg^2), 2 bytes per bin
+static uint16_t specCentiDb(float p) {
+  if (!(p > 1.0f)) return 0;
+  const float cdb = 1000.0f * log10f(p);
+  return cdb >= 65535.0f ? 65535 : (uint16_t)(cdb + 0.5f);
+}
+
+// Each message is its own capture to the backend: id "<run id>-<seq>", with
+// the run id in "mid" (as profiles share theirs)
+static bool publishSpecCbor(const char* run_id, uint32_t seq, uint64_t t_end_us,
+                            const vib::sdft::Sliding3& sd, const float* psd, uint32_t lost) {
+  static uint8_t bins[2 * 513];
+  const size_t nb = sd.k1() - sd.k0() + 1;
+  for (size_t k = 0; k < nb; k++) put_u16_le(&bins[2 * k], specCentiDb(psd[k]));
+
+  static uint8_t buf[SPEC_MSG_MAX];
+  CborEncoder root, map;
+  cbor_encoder_init(&root, buf, sizeof(buf), 0);
+  CborError err = cbor_encoder_create_map(&root, &map, CborIndefiniteLength);
+  if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "type"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, "spec"); if (err) return false;
+
+  char id_msg[80];
+  snprintf(id_msg, sizeof(id_msg), "%s-%lu", run_id, (unsigned long)seq);
+  err = cbor_encode_text_stringz(&map, "id"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, id_msg); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "mid"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, run_id); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "dev"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, cfg.client_id.c_str()); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "seq"); if (err) return false;
+  err = cbor_encode_uint(&map, seq); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "t_us"); if (err) return false;
+  err = cbor_encode_uint(&map, t_end_us); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "fs"); if (err) return false;
+  err = cbor_encode_uint(&map, cfg.fs_hz); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "nfft"); if (err) return false;
+  err = cbor_encode_uint(&map, sd.n()); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "k0"); if (err) return false;
+  err = cbor_encode_uint(&map, sd.k0()); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "range_g"); if (err) return false;
+  err = cbor_encode_uint(&map, cfg.range_g); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "eng"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, sd.sliding() ? "sliding" : "fft"); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "lost"); if (err) return false;
+  err = cbor_encode_uint(&map, lost); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "psd_fmt"); if (err) return false;
+  err = cbor_encode_text_stringz(&map, "u16le_cdb_mg2"); if (err) return false;
+
+  err = cbor_encode_text_stringz(&map, "psd"); if (err) return false;
+  err = cbor_encode_byte_string(&map, bins, 2 * nb); if (err) return false;
+
+  err = cbor_encoder_close_container(&root, &map); if (err) return false;
+
+  // No flush wait: the sampler keeps running, mqtt.loop() is called by the consumer
+  return mqttPublishCbor(buf, cbor_encoder_get_buffer_size(&root, buf), 0);
+}
+
+static bool specRun() {
+  const size_t n = cfg.spec_nfft;
+  const float df = (float)cfg.fs_hz / (float)n;
+  size_t k1 = n / 2;
+  if (cfg.spec_f_hi_hz > 0.0f && cfg.spec_f_hi_hz / df < (float)k1) k1 = (size_t)(cfg.spec_f_hi_hz / df);
+  size_t k0 = (size_t)ceilf(cfg.spec_f_lo_hz / df);
+  if (k0 > k1) k0 = k1;
+  uint32_t hop = (uint32_t)cfg.spec_publish_ms * cfg.fs_hz / 1000UL;
+  if (hop < 1) hop = 1;
+  const bool sliding = cfg.spec_engine == "sliding" ||
+                       (cfg.spec_engine == "auto" && vib::sdft::Sliding3::prefer_sliding(n, k0, k1, hop));
+
+  const size_t mem_bytes = vib::sdft::Sliding3::bytes(n, k0, k1, sliding);
+  void* mem = malloc(mem_bytes);
+  float* psd = (float*)malloc((k1 - k0 + 1) * sizeof(float));
+  vib::sdft::Sliding3 sd;
+  if (!mem || !psd || !sd.begin(n, k0, k1, mem, mem_bytes, sliding)) {
+    Serial.println("spectrum: no memory for the engine");
+    free(mem);
+    free(psd);
+    return false;
+  }
+
+  const uint32_t n_target = (uint32_t)cfg.long_s * (uint32_t)cfg.fs_hz;
+  esp_timer_handle_t tick = recSamplerStart(n_target, cfg.fs_hz);
+  if (!tick) {
+    Serial.println("spectrum: no memory for ring");
+    free(mem);
+    free(psd);
+    return false;
+  }
+  clockUpdate();
+  char id[64];
+  makeIdMsg(id, sizeof(id), clockEpochAt(rec_t0));
+  Serial.printf("spectrum: %s, n=%u, %.1f-%.1f Hz (%u bins), every %lu samples, %s, %u B\n", id,
+                (unsigned)n, (float)k0 * df, (float)k1 * df, (unsigned)(k1 - k0 + 1), (unsigned long)hop,
+                sliding ? "sliding" : "fft", (unsigned)mem_bytes);
+
+  const int16_t so_mg = (int16_t)vib::fx::mg_per_digit(cfg.range_g);
+  int16_t last[3] = { 0, 0, 0 };
+  uint32_t next_idx = 0, since_pub = 0, seq = 0, filled = 0, pub_fail = 0;
+  uint64_t push_us = 0, power_us = 0;
+  uint32_t last_mqtt_ms = millis();
+
+  for (;;) {
+    RecSample batch[32];
+    const size_t got = xStreamBufferReceive(rec_ring, batch, sizeof(batch), pdMS_TO_TICKS(20)) / sizeof(RecSample);
+
+    const int64_t t_push = esp_timer_get_time();
+    for (size_t i = 0; i < got; i++) {
+      const RecSample& smp = batch[i];
+      for (; next_idx < smp.idx; next_idx++, filled++, since_pub++) sd.push(last);
+      for (size_t k = 0; k < 3; k++) last[k] = (int16_t)(smp.d[k] * so_mg);
+      sd.push(last);
+      next_idx = smp.idx + 1;
+      since_pub++;
+
+      if (sd.full() && since_pub >= hop) {
+        since_pub = 0;
+        const int64_t t_pow = esp_timer_get_time();
+        sd.power(psd);
+        power_us += (uint64_t)(esp_timer_get_time() - t_pow);
+        const uint64_t t_end = clockEpochAt(rec_t0 + (int64_t)smp.idx * (int64_t)rec_period_us);
+        if (!publishSpecCbor(id, seq++, t_end, sd, psd, rec_lost_sched + rec_lost_ring)) pub_fail++;
+      }
+    }
+    push_us += (uint64_t)(esp_timer_get_time() - t_push);
+
+    if (millis() - last_mqtt_ms >= 100) {
+      mqtt.loop();
+      last_mqtt_ms = millis();
+    }
+    if (rec_done && xStreamBufferBytesAvailable(rec_ring) == 0) break;
+  }
+  recSamplerStop(tick);
+
+  // push_us includes the reads and publishes
+  Serial.printf("spectrum: %lu messages (%lu failed), %lu samples, lost sched=%lu ring=%lu (filled %lu), "
+                "power %.0f us/msg, consumer %.2f us/sample\n",
+                (unsigned long)seq, (unsigned long)pub_fail, (unsigned long)next_idx,
+                (unsigned long)rec_lost_sched, (unsigned long)rec_lost_ring, (unsigned long)filled,
+                seq ? (double)power_us / (double)seq : 0.0,
+                next_idx ? (double)(push_us - power_us) / (double)next_idx : 0.0);
+  free(mem);
+  free(psd);
+  return seq > 0 && pub_fail < seq;
+}
+
+// -------------------------
+// Burst capture
+// -------------------------
+// One capture of N samples at fs_hz through the pipeline (the mqtt sink
+// publishes it). Returns false if the acquisition failed; gate_pass_out
+// tells whether the capture was published. With auto-range,
+// next_range_g_io is raised to the range this capture asks for.
+static bool runCapture(uint16_t fs_hz, uint16_t N, bool& gate_pass_out, uint8_t& next_range_g_io) {
+
+  static uint16_t dt_us_buf[ACQ_MAX_SAMPLES];   // max N-1
+  static int16_t ax_mg_buf[ACQ_MAX_SAMPLES];
+  static int16_t ay_mg_buf[ACQ_MAX_SAMPLES];
+  static int16_t az_mg_buf[ACQ_MAX_SAMPLES];
+  static int32_t work_buf[ACQ_MAX_SAMPLES];
+  static uint8_t x_bytes[2 * ACQ_MAX_SAMPLES];
+  static uint8_t y_bytes[2 * ACQ_MAX_SAMPLES];
+  static uint8_t z_bytes[2 * ACQ_MAX_SAMPLES];
+
+  lisSetDataRate(fs_hz);
+
+  vib::pipe::Frame frame;
+  frame.axis[0] = ax_mg_buf;
+  frame.axis[1] = ay_mg_buf;
+  frame.axis[2] = az_mg_buf;
+  frame.dt_us = dt_us_buf;
+  frame.n = N;
+  frame.fs_hz = fs_hz;
+  frame.range_g = cfg.range_g;
+  frame.work = work_buf;
+  frame.out[0].data = x_bytes; frame.out[0].cap = sizeof(x_bytes);
+  frame.out[1].data = y_bytes; frame.out[1].cap = sizeof(y_bytes);
+  frame.out[2].data = z_bytes; frame.out[2].cap = sizeof(z_bytes);
+
+  // Acquisition + fused pipeline prefix
+  AcquireFused acq = { &frame, dt_us_buf, 0, 0, 0, 0, vib::Cov3(), false };
+  size_t covered = fused_covered;
+  const bool fused_ok = vib::fused::dispatch(fused_variant, pipeline, covered, acq);
+
+  if (!acq.acq_ok) return false;
+  if (meas_prof == 0) makeIdMsg(meas_id, sizeof(meas_id), frame.t0_epoch_us);
+
+  frame.pca = vib::pca3(acq.cov);
+  if (frame.pca.valid) {
+    Serial.printf("principal dir: (%.3f, %.3f, %.3f), energy %.1f/%.1f/%.1f %%\n",
+                  frame.pca.dir[0], frame.pca.dir[1], frame.pca.dir[2],
+                  100.0f * frame.pca.ratio[0], 100.0f * frame.pca.ratio[1], 100.0f * frame.pca.ratio[2]);
+  }
+
+  const uint64_t epoch_us0 = frame.t0_epoch_us;
+  const uint32_t read_us_max = acq.read_us_max;
+
+  if (cfg.auto_range) {
+    // Several profiles: the widest range any of them asks for
+    const uint8_t next = vib::fx::next_range_g(cfg.range_g, acq.raw_peak_mg, acq.raw_clip);
+    if (next > next_range_g_io) next_range_g_io = next;
+    Serial.printf("auto-range: raw peak=%ld mg, clipped=%lu @ %ug -> next %ug\n",
+                  (long)acq.raw_peak_mg, (unsigned long)acq.raw_clip,
+                  (unsigned)cfg.range_g, (unsigned)next);
+  }
+
+  // -------------------------
+  // Timing quality (shipped in the meta as "tq") + validation prints
+  // -------------------------
+  vib::Timing& tq = frame.timing;
+  const uint32_t target_period_us = tq.period_us;
+  const uint64_t dt_sum_check = tq.dt_sum_us;
+
+  Serial.printf("dt stats: min=%lu us, max=%lu us, mean=%.2f us, sd=%.2f us, target=%lu us, sat=%lu, missed=%lu, lag_max=%lu us\n",
+                (unsigned long)tq.dt_min_us,
+                (unsigned long)tq.dt_max_us,
+                tq.dt_mean_us(),
+                tq.dt_sd_us(),
+                (unsigned long)target_period_us,
+                (unsigned long)tq.sat,
+                (unsigned long)tq.missed,
+                (unsigned long)tq.lag_max_us);
+  Serial.printf("dt jitter: <2 us %lu | <4 %lu | <8 %lu | <16 %lu | <32 %lu | <64 %lu | <128 %lu | more %lu\n",
+                (unsigned long)tq.hist[0], (unsigned long)tq.hist[1], (unsigned long)tq.hist[2],
+                (unsigned long)tq.hist[3], (unsigned long)tq.hist[4], (unsigned long)tq.hist[5],
+                (unsigned long)tq.hist[6], (unsigned long)tq.hist[7]);
+
+  Serial.printf("sensor read: max=%lu us (%s)\n",
+                (unsigned long)read_us_max,
+                cfg.sensor_bus.c_str());
+
+  Serial.printf("duration_est = %.3f ms (expected %.3f ms)\n",
+                (double)dt_sum_check / 1000.0,
+                (double)(N - 1) * (double)target_period_us / 1000.0);
+
+  // Cross-check end epoch vs t0 + sum(dt)
+  uint64_t epoch_us_end_now = clockEpochNow();
+  uint64_t epoch_us_end_est = epoch_us0 + dt_sum_check;
+  int64_t err_us = (int64_t)(epoch_us_end_now - epoch_us_end_est);
+
+  Serial.printf("clock check: t0 +/- %lu us, skew %.2f ppm over %.1f s, wall - model at end = %ld us\n",
+                (unsigned long)frame.t0_err_us, clock_model.skew_ppm(),
+                (double)clock_model.span_us() / 1e6, (long)tq.end_err_us);
+  Serial.printf("end check: now=%llu, est=%llu, err=%lld us\n",
+                (unsigned long long)epoch_us_end_now,
+                (unsigned long long)epoch_us_end_est,
+                (long long)err_us);
+  // -------------------------
+  // Processing pipeline: remaining stages (all of them without a fused variant)
+  // -------------------------
+  const bool pipe_ok = fused_ok && pipeline.run(frame, covered);
+
+  if (frame.feat.valid & vib::pipe::FEAT_RMS) {
+    Serial.printf("mag_rms=%.3f m/s^2 (threshold=%.2f, kernels=%s)\n",
+                  frame.feat.mag_rms_mps2, cfg.mag_rms_threshold, vib::kernel_impl());
+  }
+  if (frame.feat.valid & vib::pipe::FEAT_PEAK) {
+    Serial.printf("peak mg: x=%ld y=%ld z=%ld, clip=%lu (range=%ug, headroom=%d bit)\n",
+                  (long)frame.feat.peak_mg[0], (long)frame.feat.peak_mg[1], (long)frame.feat.peak_mg[2],
+                  (unsigned long)frame.feat.clip,
+                  (unsigned)cfg.range_g, vib::fx::headroom_bits(cfg.range_g));
+  }
+  if (frame.feat.valid & vib::pipe::FEAT_SPEED) {
+    Serial.printf("speed: %.1f rpm (%.2f Hz), confidence=%.2f\n",
+                  frame.feat.speed_hz * 60.0f, frame.feat.speed_hz, frame.feat.speed_conf);
+  }
+  if (frame.feat.valid & vib::pipe::FEAT_KURT) {
+    Serial.printf("kurtogram: band %.1f-%.1f Hz on %c, SK=%.2f\n",
+                  frame.feat.kurt_f_lo_hz, frame.feat.kurt_f_hi_hz, "xyz"[frame.feat.kurt_axis], frame.feat.kurt);
+  }
+
+  gate_pass_out = frame.gate_pass;
+  if (frame.gate_pass && !pipe_ok) {
+    Serial.printf("pipeline stopped at '%s'\n", frame.stopped_by ? frame.stopped_by : "?");
+  }
+  last_capture = frame;
+  return true;
+}
+
+// Final flush window, then sleep
+static void finishAndSleep() {
+  uint32_t t0 = millis();
+  while (millis() - t0 < 3000) {
+    mqtt.loop();
+    delay(10);
+  }
+
+  pixelSetSolid(C_OFF());
+  goToSleep(cfg.sleep_s);
+}
+
+static bool bootHeldForMs(uint32_t hold_ms = 3000) {
+  const int BOOT_PIN = 0;            // en ESP32-S3 Feather suele ser GPIO0
+  pinMode(BOOT_PIN, INPUT_PULLUP);   // BOOT normalmente a GND al presionar
+  uint32_t t0 = millis();
+  while (millis() - t0 < hold_ms) {
+    if (digitalRead(BOOT_PIN) == HIGH) return false; // soltó antes
+    delay(10);
+  }
+  return true; // mantuvo presionado hold_ms
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1500);
+
+  // Start NeoPixel ASAP
+  pixelBegin();
+
+  // During setup + measurement: solid green
+  pixelSetSolid(C_GREEN());
+
+  if (!mountFS()) { failAndRestart(5); }
+
+    // Carga config si existe; si no, cfg tendrá defaults
+  loadConfig(); // si falla, igual puedes entrar al portal
+
+  bool forcePortal = bootHeldForMs(3000);
+
+  if (forcePortal) {
+    pixelBlink(C_YELLOW(), 2, 300, 300);
+    bool restart = startConfigAPPortal(300); // 5 min sin actividad
+    if (restart) {
+      pixelBlink(C_GREEN(), 3, 250, 250);
+      ESP.restart();
+    } else if (!portal_applied && !portal_done) {
+      // No guardó → reinicia o duerme
+      failAndRestart(5);
+    }
+    // Applied live: carry on with a normal wake using the saved config
+    pixelBlink(C_GREEN(), 3, 250, 250);
+    pixelSetSolid(C_GREEN());
+  }
+
+  // Config/FS/CA errors -> treat as generic init error (4 blinks)
+  if (!loadConfig()) { failAndRestart(5); }
+  if (cfg.auto_range && (rtc_range_g == 6 || rtc_range_g == 12 || rtc_range_g == 24)) {
+    cfg.range_g = rtc_range_g;
+    Serial.printf("auto-range: using %ug\n", (unsigned)cfg.range_g);
+  }
+  if (!loadCA())     { failAndRestart(5); }
+  if (!buildPipeline()) { failAndRestart(5); }
+#ifdef VIB_GOLDEN_SELFTEST
+  goldenSelfTest();
+#endif
+
+  // WiFi (1 blink red)
+  if (!connectWiFi()) { failAndRestart(1); }
+
+  ntp_synced = syncTimeNTP();
+  if (!ntp_synced) { failAndRestart(2); }
+  clockAnchor();
+  Serial.printf("epochUsNow=%llu (ntp_ok=%u)\n",
+                (unsigned long long)epochUsNow(),
+                ntp_synced ? 1 : 0);
+
+  // MQTT connect (3 blinks red)
+  if (!connectMQTT()) { failAndRestart(3); }
+  radioBeginSend();
+
+  // Chunks the backend reported missing
+  sfProcessNacks();
+
+  // Captures a dropped connection left unfinished
+  txResume();
+
+  // Sensor init (4 blinks red)
+  if (!initLIS331())  { failAndRestart(4); }
+
+  // Long recordings: finish a pending upload before capturing again
+  RecState rec;
+  if (recLoadState(rec)) {
+    Serial.printf("pending recording %s: block %lu/%lu\n", rec.id.c_str(),
+                  (unsigned long)rec.next_block, (unsigned long)rec.blocks);
+    if (!recUpload(rec, (uint32_t)cfg.upload_s * 1000UL)) {
+      finishAndSleep();
+      return;
+    }
+  }
+
+  if (cfg.acq_mode == "trend") {
+    if (!trendUpload()) {
+      Serial.println("trend: upload failed, batch kept in RTC memory");
+    }
+    // Next boot uploads this batch and starts the next one; if the last
+    // batch is still pending, retry at the normal interval
+    goToSleep(trendLog() ? 1 : cfg.sleep_s);
+    return;
+  }
+
+  if (cfg.acq_mode == "spectrum") {
+    if (!specRun()) { failAndRestart(4); }
+    finishAndSleep();
+    return;
+  }
+
+  if (cfg.acq_mode == "long") {
+    if (!recCapture(rec)) { failAndRestart(4); }
+    recSaveState(rec);
+    recUpload(rec, (uint32_t)cfg.upload_s * 1000UL);
+    finishAndSleep();
+    return;
+  }
+
+  // Burst captures: one per profile, back to back under one connection
+  const uint8_t n_prof = cfg.n_profiles ? cfg.n_profiles : 1;
+  meas_profs = cfg.n_profiles;
+  uint8_t next_range_g = 0;
+  bool any_pass = false;
+
+  for (uint8_t p = 0; p < n_prof; p++) {
+    const uint16_t fs = cfg.n_profiles ? cfg.profiles[p].fs_hz : cfg.fs_hz;
+    const uint16_t n = cfg.n_profiles ? cfg.profiles[p].n_samples : cfg.n_samples;
+    meas_prof = p;
+    if (cfg.n_profiles) {
+      Serial.printf("profile %u/%u '%s': %u samples @ %u Hz\n", (unsigned)(p + 1), (unsigned)n_prof,
+                    cfg.profiles[p].name, (unsigned)n, (unsigned)fs);
+    }
+
+    bool pass = false;
+    if (!runCapture(fs, n, pass, next_range_g)) {
+      Serial.println("Acquisition failed");
+      // Not specified; treat as sensor-ish failure (4)
+      failAndRestart(4);
+    }
+    any_pass = any_pass || pass;
+  }
+
+  if (cfg.auto_range) rtc_range_g = next_range_g;
+
+  if (!any_pass) {
+    // Nothing published
+    pixelBlink(C_YELLOW(), 3, 400, 400);  // 3 yellow blinks, 400 ms
+    pixelSetSolid(C_OFF());
+    goToSleep(cfg.sleep_s);
+    return;
+  }
+
+  // Once per wake, after every profile has been sent: blinking blocks for
+  // 3.5 s, which must not sit between captures
+  pixelBlink(C_GREEN(), 5, 350, 350);
+  finishAndSleep();
 }
 
 void loop() {
@@ -0,0 +1,1127 @@
+// fleet_reassembler.cpp
+// Backend reassembly of device captures, sharded across threads, plus the
+// fleet load generator to benchmark it.
+//
+// Build (from repo root):
+//   g++ -O2 -std=c++17 -pthread -Ilib/vib/src tools/fleet_reassembler.cpp -o fleet_reassembler
+// Run:
+//   ./fleet_reassembler bench [devices=300] [captures=4] [shards=ncpu] [dup%=5] [loss%=2]
+//       in-process: the generator feeds the engine directly, every archived
+//       capture is checked byte for byte
+//   ./fleet_reassembler sub  <host> <port> <topic> [shards=ncpu] [out_dir] [idle_s=10]
+//       subscribes on a local broker (plain MQTT 3.1.1, QoS 0) and reassembles;
+//       captures quiet for idle_s are archived as partial, and it exits once
+//       the topic has been quiet for 3 x idle_s
+//   ./fleet_reassembler load <host> <port> <topic> [devices=300] [captures=4] [dup%=5] [loss%=2] [msg/s=0] [resend_s=0]
+//       publishes the same synthetic fleet to the broker (0 = unthrottled);
+//       the held-back chunks go out resend_s seconds after the rest (set it
+//       above the subscriber's idle_s to see partial captures completed later)
+//
+// Message format (see publishMetaCbor / publishBlobCbor in src/main.cpp): one
+// topic, CBOR maps. Metas ("meta", "rec_meta", "trend_meta") and the
+// self-contained "spec" messages have no "idx"; blob chunks are
+// {type, id, idx, parts, crc, <key>: bytes}, crc being the CRC-32 of the
+// payload (vib_crc.h). The capture id is "<client_id>-<digits>"; a spec
+// message's is "<client_id>-<digits>-<seq>" (its run id is in "mid"), so each
+// one is a capture of its own, complete on arrival. Such ids shard by
+// "<client_id>-<digits>", which keeps every id in exactly one shard.
+//
+// Stages:
+//   ingest   reads messages (socket or generator), peeks "id" and hands the
+//            raw message to the decode shard of its client_id
+//   decode   one thread per shard: full CBOR decode and reassembly. Each
+//            client_id lives in exactly one shard, so shard state needs no lock
+//   archive  writes finished captures (<out_dir>/<id>.cap, a CBOR map of the
+//            meta message and one byte string per blob type) or, in bench
+//            mode, checks them against what was generated
+//
+// Between stages are single-producer/single-consumer lock-free rings, one per
+// shard on each side. Chunks are idempotent: a duplicate (same id, type, idx)
+// is counted and dropped, a chunk differing from the one held is counted as a
+// conflict and dropped. A chunk whose payload fails its crc is counted as
+// corrupt and dropped, so it stays missing (chunks without crc are
+// accepted). A capture is complete when its meta and every part of each blob
+// type are in ("meta" needs dt/x/y/z unless its tier is "features");
+// captures still incomplete after idle_s or at the end are archived as
+// partial with the NACK list for the missing chunks, and re-archived if a
+// resend completes them. A complete capture is forgotten once it has been
+// quiet for the retention window (10 min in `sub`); its id is kept for one
+// more window so late copies still count as duplicates. A partial one is
+// parked after a longer window (1 h): its chunks go to <out_dir>/<id>.part
+// (next to the .cap and .nack.json, which stay) and are loaded back when a
+// late chunk for it arrives, so the resend still completes it.
+//
+// Synthetic blobs are a function of (id, type, length), so `sub` can verify
+// what `load` sent from another process (devices named "fleet-sim-*" only).
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "vib_crc.h"
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+using Clock = std::chrono::steady_clock;
+
+// -------------------------
+// SPSC ring
+// -------------------------
+template <typename T>
+class SpscRing {
+public:
+  explicit SpscRing(size_t cap_pow2) : mask_(cap_pow2 - 1), slots_(cap_pow2) {}
+
+  bool try_push(T& v) {
+    const size_t h = head_.load(std::memory_order_relaxed);
+    if (h - tail_.load(std::memory_order_acquire) > mask_) return false;
+    slots_[h & mask_] = std::move(v);
+    head_.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool try_pop(T& out) {
+    const size_t t = tail_.load(std::memory_order_relaxed);
+    if (t == head_.load(std::memory_order_acquire)) return false;
+    out = std::move(slots_[t & mask_]);
+    tail_.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Spins, then yields, while full (back-pressure on the producer)
+  void push(T& v) {
+    for (unsigned spins = 0; !try_push(v); spins++) {
+      if (spins > 64) std::this_thread::yield();
+    }
+  }
+
+private:
+  const size_t mask_;
+  std::vector<T> slots_;
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+};
+
+// -------------------------
+// Minimal CBOR (what the device emits)
+// -------------------------
+void cbor_head(Bytes& o, uint8_t major, uint64_t v) {
+  const uint8_t m = (uint8_t)(major << 5);
+  if (v < 24) { o.push_back(m | (uint8_t)v); return; }
+  int n = v <= 0xFF ? 1 : v <= 0xFFFF ? 2 : v <= 0xFFFFFFFFULL ? 4 : 8;
+  o.push_back(m | (uint8_t)(n == 1 ? 24 : n == 2 ? 25 : n == 4 ? 26 : 27));
+  for (int i = n - 1; i >= 0; i--) o.push_back((uint8_t)(v >> (8 * i)));
+}
+void cbor_text(Bytes& o, const std::string& s) { cbor_head(o, 3, s.size()); o.insert(o.end(), s.begin(), s.end()); }
+void cbor_bytes(Bytes& o, const uint8_t* p, size_t n) { cbor_head(o, 2, n); o.insert(o.end(), p, p + n); }
+
+// Reads one item; texts/bytes are returned as views, containers are skipped
+class CborReader {
+public:
+  CborReader(const uint8_t* p, size_t n) : p_(p), end_(p + n) {}
+
+  enum Kind { UINT, NINT, BYTES, TEXT, OTHER, BREAK, BAD };
+  struct Item {
+    Kind kind = BAD;
+    uint64_t u = 0;
+    const uint8_t* data = nullptr;
+    size_t len = 0;
+  };
+
+  bool map_begin(int64_t& entries) {   // -1: indefinite
+    if (p_ >= end_ || (*p_ >> 5) != 5) return false;
+    if ((*p_ & 31) == 31) { p_++; entries = -1; return true; }
+    uint64_t v;
+    if (!head(v)) return false;
+    entries = (int64_t)v;
+    return true;
+  }
+
+  Item next() {
+    Item it;
+    if (p_ >= end_) return it;
+    if (*p_ == 0xFF) { p_++; it.kind = BREAK; return it; }
+    const uint8_t major = *p_ >> 5;
+    if ((*p_ & 31) == 31) {           // indefinite container or string
+      p_++;
+      if (!skip_until_break()) return it;
+      it.kind = OTHER;
+      return it;
+    }
+    uint64_t v;
+    if (!head(v)) return it;
+    switch (major) {
+      case 0: it.kind = UINT; it.u = v; return it;
+      case 1: it.kind = NINT; it.u = v; return it;
+      case 2: case 3:
+        if (v > (uint64_t)(end_ - p_)) return it;
+        it.kind = major == 2 ? BYTES : TEXT;
+        it.data = p_;
+        it.len = (size_t)v;
+        p_ += v;
+        return it;
+      case 4: case 5:
+        for (uint64_t i = 0; i < (major == 5 ? 2 * v : v); i++) {
+          if (next().kind == BAD) return it;
+        }
+        it.kind = OTHER;
+        return it;
+      case 6:
+        return next();                 // tag: the tagged item
+      default:
+        it.kind = OTHER;               // simple / float, already consumed
+        return it;
+    }
+  }
+
+private:
+  bool head(uint64_t& v) {
+    const uint8_t ai = *p_++ & 31;
+    if (ai < 24) { v = ai; return true; }
+    const int n = ai == 24 ? 1 : ai == 25 ? 2 : ai == 26 ? 4 : ai == 27 ? 8 : 0;
+    if (!n || end_ - p_ < n) return false;
+    v = 0;
+    for (int i = 0; i < n; i++) v = (v << 8) | *p_++;
+    return true;
+  }
+  bool skip_until_break() {
+    for (;;) {
+      if (p_ >= end_) return false;
+      const Item it = next();
+      if (it.kind == BREAK) return true;
+      if (it.kind == BAD) return false;
+    }
+  }
+
+  const uint8_t* p_;
+  const uint8_t* end_;
+};
+
+bool is_key(const CborReader::Item& it, const char* k) {
+  return it.kind == CborReader::TEXT && it.len == std::strlen(k) && std::memcmp(it.data, k, it.len) == 0;
+}
+
+// Decoded message: a meta (idx < 0) or one blob chunk
+struct Msg {
+  std::string type, id, dev, tier;
+  int32_t idx = -1;
+  uint32_t parts = 0;
+  int64_t crc = -1;                    // -1: none sent
+  const uint8_t* payload = nullptr;
+  size_t payload_len = 0;
+};
+
+bool decode(const Bytes& raw, Msg& m) {
+  CborReader r(raw.data(), raw.size());
+  int64_t entries;
+  if (!r.map_begin(entries)) return false;
+  for (int64_t i = 0; entries < 0 || i < entries; i++) {
+    const CborReader::Item k = r.next();
+    if (k.kind == CborReader::BREAK && entries < 0) break;
+    if (k.kind != CborReader::TEXT) return false;
+    const CborReader::Item v = r.next();
+    if (v.kind == CborReader::BAD) return false;
+    const bool text = v.kind == CborReader::TEXT;
+    if (is_key(k, "type") && text) m.type.assign((const char*)v.data, v.len);
+    else if (is_key(k, "id") && text) m.id.assign((const char*)v.data, v.len);
+    else if (is_key(k, "dev") && text) m.dev.assign((const char*)v.data, v.len);
+    else if (is_key(k, "tier") && text) m.tier.assign((const char*)v.data, v.len);
+    else if (is_key(k, "idx") && v.kind == CborReader::UINT) m.idx = (int32_t)v.u;
+    else if (is_key(k, "parts") && v.kind == CborReader::UINT) m.parts = (uint32_t)v.u;
+    else if (is_key(k, "crc") && v.kind == CborReader::UINT) m.crc = (int64_t)(uint32_t)v.u;
+    else if (v.kind == CborReader::BYTES) { m.payload = v.data; m.payload_len = v.len; }
+  }
+  if (m.type.empty() || m.id.empty()) return false;
+  if (m.idx >= 0 && (m.parts == 0 || (uint32_t)m.idx >= m.parts || !m.payload)) return false;
+  return true;
+}
+
+// Ingest only needs the id: scans the top-level keys for it
+bool peek_id(const Bytes& raw, std::string& id) {
+  CborReader r(raw.data(), raw.size());
+  int64_t entries;
+  if (!r.map_begin(entries)) return false;
+  for (int64_t i = 0; entries < 0 || i < entries; i++) {
+    const CborReader::Item k = r.next();
+    if (k.kind != CborReader::TEXT) return false;
+    const CborReader::Item v = r.next();
+    if (is_key(k, "id") && v.kind == CborReader::TEXT) {
+      id.assign((const char*)v.data, v.len);
+      return true;
+    }
+    if (v.kind == CborReader::BAD) return false;
+  }
+  return false;
+}
+
+// "<client_id>-<digits>" -> client_id
+std::string client_of(const std::string& id) {
+  const size_t dash = id.rfind('-');
+  if (dash == std::string::npos || dash == 0) return id;
+  for (size_t i = dash + 1; i < id.size(); i++) {
+    if (id[i] < '0' || id[i] > '9') return id;
+  }
+  return id.substr(0, dash);
+}
+
+uint64_t fnv1a(const void* p, size_t n, uint64_t h = 1469598103934665603ULL) {
+  const uint8_t* b = (const uint8_t*)p;
+  for (size_t i = 0; i < n; i++) { h ^= b[i]; h *= 1099511628211ULL; }
+  return h;
+}
+
+// Synthetic devices are named kSimPrefix + number; only they are verified
+const char* const kSimPrefix = "fleet-sim-";
+
+// Synthetic blob content: a function of (id, type, len)
+Bytes synth_blob(const std::string& id, const std::string& type, size_t len) {
+  uint64_t s = fnv1a(type.data(), type.size(), fnv1a(id.data(), id.size()));
+  Bytes b(len);
+  for (size_t i = 0; i < len; i++) {
+    s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+    b[i] = (uint8_t)s;
+  }
+  return b;
+}
+
+// -------------------------
+// Engine
+// -------------------------
+struct Archived {
+  std::string id, dev;
+  bool complete = false;
+  Bytes meta;                          // the meta message as received
+  std::map<std::string, Bytes> blobs;  // reassembled, by type
+  std::vector<std::string> missing;    // NACK entries ({"id","type"[,"idx"]} JSON)
+  double latency_ms = 0.0;             // first message -> archived
+};
+
+struct Stats {
+  std::atomic<uint64_t> msgs{0}, bytes{0}, bad{0}, dups{0}, conflicts{0}, corrupt{0};
+  std::atomic<uint64_t> complete{0}, partial{0}, reopened{0}, evicted{0}, parked{0}, unparked{0};
+  std::atomic<uint64_t> verified{0}, verify_fail{0};
+  std::atomic<uint64_t> latency_us_sum{0}, latency_us_max{0};
+};
+
+struct Group {
+  uint32_t parts = 0;
+  uint32_t have = 0;
+  std::vector<Bytes> chunks;
+  std::vector<bool> got;
+};
+
+struct Capture {
+  std::string dev;
+  Bytes meta;
+  std::string meta_type, tier;
+  std::map<std::string, Group> groups;
+  Clock::time_point first, last;
+  int archived = 0;                    // 0 no, 1 partial, 2 complete
+};
+
+class Engine {
+public:
+  Engine(size_t shards, size_t archivers, const std::string& out_dir, bool verify)
+      : out_dir_(out_dir), verify_(verify) {
+    for (size_t i = 0; i < shards; i++) {
+      in_.emplace_back(new SpscRing<Bytes>(4096));
+      out_.emplace_back(new SpscRing<std::unique_ptr<Archived>>(1024));
+      state_.emplace_back(new ShardState());
+    }
+    archivers_ = std::max<size_t>(1, std::min(archivers, shards));
+  }
+
+  void start() {
+    for (size_t s = 0; s < in_.size(); s++) threads_.emplace_back([this, s] { decodeLoop(s); });
+    for (size_t a = 0; a < archivers_; a++) threads_.emplace_back([this, a] { archiveLoop(a); });
+  }
+
+  // Called by the single ingest thread
+  void ingest(Bytes& raw) {
+    stats.msgs++;
+    stats.bytes += raw.size();
+    std::string id;
+    if (!peek_id(raw, id)) { stats.bad++; return; }
+    const std::string client = client_of(id);
+    const size_t s = (size_t)(fnv1a(client.data(), client.size()) % in_.size());
+    in_[s]->push(raw);
+  }
+
+  // Archives what is incomplete and quiet for idle (zero: everything),
+  // forgets complete captures quiet for retain and parks partial ones quiet
+  // for park (on disk with an out_dir, dropped without)
+  void sweep(std::chrono::milliseconds idle,
+             std::chrono::milliseconds retain = std::chrono::minutes(10),
+             std::chrono::milliseconds park = std::chrono::hours(1)) {
+    sweep_ms_.store(idle.count(), std::memory_order_release);
+    retain_ms_.store(retain.count(), std::memory_order_release);
+    park_ms_.store(park.count(), std::memory_order_release);
+    sweep_gen_.fetch_add(1, std::memory_order_acq_rel);
+  }
+
+  // Waits until every ring is drained and the last sweep was applied
+  void drain() {
+    for (;;) {
+      // A shard applies a sweep only once its ring is empty
+      bool idle = true;
+      for (auto& st : state_) idle = idle && st->sweep_seen.load() == sweep_gen_.load();
+      if (idle && in_flight_.load() == 0) return;
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+  }
+
+  void stop() {
+    stop_.store(true);
+    for (auto& t : threads_) t.join();
+    threads_.clear();
+  }
+
+  // bench mode: what the generator sent, by "<id>/<type>"
+  std::unordered_map<std::string, uint64_t> expected;
+
+  Stats stats;
+
+private:
+  struct ShardState {
+    std::unordered_map<std::string, Capture> caps;
+    std::unordered_map<std::string, Clock::time_point> gone;   // evicted id -> when
+    std::atomic<uint64_t> sweep_seen{0};
+  };
+
+  void decodeLoop(size_t s) {
+    ShardState& st = *state_[s];
+    Bytes raw;
+    for (;;) {
+      if (in_[s]->try_pop(raw)) {
+        handle(s, st, raw);
+        continue;
+      }
+      const uint64_t gen = sweep_gen_.load(std::memory_order_acquire);
+      if (st.sweep_seen.load() != gen) {
+        sweepShard(s, st, std::chrono::milliseconds(sweep_ms_.load()),
+                   std::chrono::milliseconds(retain_ms_.load()),
+                   std::chrono::milliseconds(park_ms_.load()));
+        st.sweep_seen.store(gen);
+        continue;
+      }
+      if (stop_.load()) return;
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+
+  void handle(size_t s, ShardState& st, const Bytes& raw) {
+    Msg m;
+    if (!decode(raw, m)) { stats.bad++; return; }
+    // Evicted captures were complete: anything more for them is a copy
+    if (!st.gone.empty() && st.gone.count(m.id)) { stats.dups++; return; }
+    if (!out_dir_.empty() && !st.caps.count(m.id)) unpark(s, st, m.id);
+    Capture& c = st.caps[m.id];
+    const auto now = Clock::now();
+    if (c.first == Clock::time_point()) c.first = now;
+    c.last = now;
+
+    if (m.idx < 0) {
+      if (!c.meta.empty()) {
+        if (c.meta == raw) stats.dups++; else stats.conflicts++;
+        return;
+      }
+      c.meta = raw;
+      c.meta_type = m.type;
+      c.tier = m.tier;
+      if (!m.dev.empty()) c.dev = m.dev;
+    } else {
+      if (m.crc >= 0 && vib::crc::crc32(m.payload, m.payload_len) != (uint32_t)m.crc) { stats.corrupt++; return; }
+      Group& g = c.groups[m.type];
+      if (!g.parts) {
+        g.parts = m.parts;
+        g.chunks.resize(m.parts);
+        g.got.assign(m.parts, false);
+      }
+      if (m.parts != g.parts) { stats.conflicts++; return; }
+      if (g.got[m.idx]) {
+        // Complete captures drop their chunks: count a resend as a duplicate
+        const Bytes& held = g.chunks[m.idx];
+        if (held.empty() || (held.size() == m.payload_len && std::memcmp(held.data(), m.payload, held.size()) == 0)) {
+          stats.dups++;
+        } else {
+          stats.conflicts++;
+        }
+        return;
+      }
+      g.chunks[m.idx].assign(m.payload, m.payload + m.payload_len);
+      g.got[m.idx] = true;
+      g.have++;
+    }
+    if (c.dev.empty()) c.dev = client_of(m.id);
+    if (c.archived != 2 && isComplete(c)) {
+      if (c.archived == 1) stats.reopened++;
+      emit(s, m.id, c, true);
+    }
+  }
+
+  static bool isComplete(const Capture& c) {
+    if (c.meta.empty()) return false;
+    for (const auto& kv : c.groups) {
+      if (kv.second.have != kv.second.parts) return false;
+    }
+    if (c.meta_type == "meta" && c.tier != "features") {
+      static const char* const req[4] = { "dt", "x", "y", "z" };
+      for (const char* t : req) {
+        if (!c.groups.count(t)) return false;
+      }
+    }
+    return true;
+  }
+
+  void sweepShard(size_t s, ShardState& st, std::chrono::milliseconds idle,
+                  std::chrono::milliseconds retain, std::chrono::milliseconds park) {
+    const auto now = Clock::now();
+    for (auto it = st.caps.begin(); it != st.caps.end();) {
+      Capture& c = it->second;
+      if (c.archived == 0 && now - c.last >= idle) emit(s, it->first, c, false);
+      if (c.archived == 2 && now - c.last >= retain) {
+        st.gone[it->first] = now;
+        it = st.caps.erase(it);
+        stats.evicted++;
+        continue;
+      }
+      if (c.archived == 1 && now - c.last >= park) {
+        if (!out_dir_.empty()) writePart(it->first, c);
+        it = st.caps.erase(it);
+        stats.parked++;
+        continue;
+      }
+      ++it;
+    }
+    for (auto it = st.gone.begin(); it != st.gone.end();) {
+      if (now - it->second >= retain) it = st.gone.erase(it);
+      else ++it;
+    }
+  }
+
+  // <id>.part: the meta and every chunk held, as u32le length + message.
+  // Chunks are re-encoded without crc (checked when they arrived).
+  void writePart(const std::string& id, const Capture& c) {
+    Bytes o;
+    auto put = [&o](const Bytes& m) {
+      for (int i = 0; i < 4; i++) o.push_back((uint8_t)(m.size() >> (8 * i)));
+      o.insert(o.end(), m.begin(), m.end());
+    };
+    if (!c.meta.empty()) put(c.meta);
+    for (const auto& kv : c.groups) {
+      const Group& g = kv.second;
+      for (uint32_t i = 0; i < g.parts; i++) {
+        if (!g.got[i]) continue;
+        Bytes m;
+        cbor_head(m, 5, 5);
+        cbor_text(m, "type"); cbor_text(m, kv.first);
+        cbor_text(m, "id"); cbor_text(m, id);
+        cbor_text(m, "idx"); cbor_head(m, 0, i);
+        cbor_text(m, "parts"); cbor_head(m, 0, g.parts);
+        cbor_text(m, "data"); cbor_bytes(m, g.chunks[i].data(), g.chunks[i].size());
+        put(m);
+      }
+    }
+    const std::string path = out_dir_ + "/" + id + ".part";
+    const std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) { std::perror(tmp.c_str()); return; }
+    const bool ok = std::fwrite(o.data(), 1, o.size(), f) == o.size();
+    std::fclose(f);
+    if (ok) std::rename(tmp.c_str(), path.c_str());
+  }
+
+  // Loads a parked capture back before its late chunk is handled
+  void unpark(size_t s, ShardState& st, const std::string& id) {
+    const std::string path = out_dir_ + "/" + id + ".part";
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return;
+    Bytes all;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) all.insert(all.end(), buf, buf + n);
+    std::fclose(f);
+    Capture& c = st.caps[id];   // present from here on: handle() does not come back here
+    c.archived = 1;
+    for (size_t p = 0; p + 4 <= all.size();) {
+      const size_t len = (size_t)all[p] | (size_t)all[p + 1] << 8 | (size_t)all[p + 2] << 16 | (size_t)all[p + 3] << 24;
+      p += 4;
+      if (len > all.size() - p) break;
+      const Bytes m(all.begin() + (long)p, all.begin() + (long)(p + len));
+      handle(s, st, m);
+      p += len;
+    }
+    std::remove(path.c_str());
+    stats.unparked++;
+  }
+
+  void emit(size_t s, const std::string& id, Capture& c, bool complete) {
+    std::unique_ptr<Archived> a(new Archived());
+    a->id = id;
+    a->dev = c.dev;
+    a->complete = complete;
+    a->meta = c.meta;
+    if (c.meta.empty()) a->missing.push_back("{\"id\":\"" + id + "\",\"type\":\"meta\"}");
+    for (auto& kv : c.groups) {
+      Group& g = kv.second;
+      Bytes& out = a->blobs[kv.first];
+      for (uint32_t i = 0; i < g.parts; i++) {
+        if (g.got[i]) {
+          out.insert(out.end(), g.chunks[i].begin(), g.chunks[i].end());
+        } else {
+          a->missing.push_back("{\"id\":\"" + id + "\",\"type\":\"" + kv.first + "\",\"idx\":" + std::to_string(i) + "}");
+        }
+      }
+      // A complete capture only keeps which parts it had
+      if (complete) for (auto& ch : g.chunks) Bytes().swap(ch);
+    }
+    a->latency_ms = std::chrono::duration<double, std::milli>(Clock::now() - c.first).count();
+    c.archived = complete ? 2 : 1;
+    if (complete) Bytes().swap(c.meta);
+    in_flight_++;
+    out_[s]->push(a);
+  }
+
+  void archiveLoop(size_t a) {
+    std::unique_ptr<Archived> item;
+    for (;;) {
+      bool any = false;
+      for (size_t s = a; s < out_.size(); s += archivers_) {
+        while (out_[s]->try_pop(item)) {
+          any = true;
+          archive(*item);
+          in_flight_--;
+        }
+      }
+      if (any) continue;
+      if (stop_.load() && in_flight_.load() == 0) return;
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+
+  void archive(const Archived& a) {
+    (a.complete ? stats.complete : stats.partial)++;
+    const uint64_t lat = (uint64_t)(a.latency_ms * 1000.0);
+    stats.latency_us_sum += lat;
+    uint64_t prev = stats.latency_us_max.load();
+    while (lat > prev && !stats.latency_us_max.compare_exchange_weak(prev, lat)) {}
+
+    if (verify_ && a.complete && a.id.compare(0, std::strlen(kSimPrefix), kSimPrefix) == 0) {
+      bool ok = true;
+      for (const auto& kv : a.blobs) {
+        const auto it = expected.find(a.id + "/" + kv.first);
+        const uint64_t h = fnv1a(kv.second.data(), kv.second.size());
+        if (it != expected.end() ? it->second != h : synth_blob(a.id, kv.first, kv.second.size()) != kv.second) ok = false;
+      }
+      (ok ? stats.verified : stats.verify_fail)++;
+    }
+    if (!a.complete && !a.missing.empty() && out_dir_.empty()) {
+      std::printf("partial %s: {\"missing\":[%s%s]}\n", a.id.c_str(), a.missing[0].c_str(),
+                  a.missing.size() > 1 ? ",..." : "");
+    }
+    if (out_dir_.empty()) return;
+
+    Bytes o;
+    o.push_back(0xBF);
+    cbor_text(o, "id"); cbor_text(o, a.id);
+    cbor_text(o, "dev"); cbor_text(o, a.dev);
+    cbor_text(o, "complete"); o.push_back(a.complete ? 0xF5 : 0xF4);
+    cbor_text(o, "meta"); cbor_bytes(o, a.meta.data(), a.meta.size());
+    for (const auto& kv : a.blobs) { cbor_text(o, kv.first); cbor_bytes(o, kv.second.data(), kv.second.size()); }
+    o.push_back(0xFF);
+    // Written aside and renamed: a re-archived capture replaces the partial one
+    const std::string path = out_dir_ + "/" + a.id + ".cap";
+    const std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) { std::perror(tmp.c_str()); return; }
+    const bool ok = std::fwrite(o.data(), 1, o.size(), f) == o.size();
+    std::fclose(f);
+    if (ok) std::rename(tmp.c_str(), path.c_str());
+    if (!a.complete) {
+      const std::string nack = out_dir_ + "/" + a.id + ".nack.json";
+      FILE* n = std::fopen(nack.c_str(), "w");
+      if (n) {
+        std::fprintf(n, "{\"missing\":[");
+        for (size_t i = 0; i < a.missing.size(); i++) std::fprintf(n, "%s%s", i ? "," : "", a.missing[i].c_str());
+        std::fprintf(n, "]}\n");
+        std::fclose(n);
+      }
+    } else {
+      std::remove((out_dir_ + "/" + a.id + ".nack.json").c_str());
+    }
+  }
+
+  std::vector<std::unique_ptr<SpscRing<Bytes>>> in_;
+  std::vector<std::unique_ptr<SpscRing<std::unique_ptr<Archived>>>> out_;
+  std::vector<std::unique_ptr<ShardState>> state_;
+  std::vector<std::thread> threads_;
+  size_t archivers_ = 1;
+  std::string out_dir_;
+  bool verify_;
+  std::atomic<bool> stop_{false};
+  std::atomic<uint64_t> sweep_gen_{0};
+  std::atomic<int64_t> sweep_ms_{0};
+  std::atomic<int64_t> retain_ms_{0};
+  std::atomic<int64_t> park_ms_{0};
+  std::atomic<int64_t> in_flight_{0};
+};
+
+// -------------------------
+// Fleet load generator
+// -------------------------
+// Each device drains a backlog of captures shaped like a burst capture at
+// 1 kHz x 3 s with the link tier "lossless": a meta, a u16 dt blob and three
+// axis blobs, in 1 KB chunks. The fleet's messages are interleaved at random
+// (devices draining at once), dup% of them are sent twice at a random later
+// point and loss% are held back and sent at the end (NACK resends). Half of
+// the held-back chunks are first sent damaged (one payload byte flipped).
+struct Fleet {
+  size_t devices = 300, captures = 4;
+  double dup = 0.05, loss = 0.02;
+};
+
+Bytes meta_msg(const std::string& id, const std::string& dev, uint64_t t0_us) {
+  Bytes o;
+  o.push_back(0xBF);
+  cbor_text(o, "type"); cbor_text(o, "meta");
+  cbor_text(o, "id"); cbor_text(o, id);
+  cbor_text(o, "dev"); cbor_text(o, dev);
+  cbor_text(o, "t0_us"); cbor_head(o, 0, t0_us);
+  cbor_text(o, "n"); cbor_head(o, 0, 3000);
+  cbor_text(o, "fs"); cbor_head(o, 0, 1000);
+  cbor_text(o, "a_fmt"); cbor_text(o, "delta");
+  cbor_text(o, "tier"); cbor_text(o, "lossless");
+  cbor_text(o, "tq"); o.push_back(0xBF);
+  cbor_text(o, "h"); cbor_head(o, 4, 2); cbor_head(o, 0, 2990); cbor_head(o, 0, 9);
+  cbor_text(o, "sd"); o.push_back(0xFA); o.push_back(0x40); o.push_back(0x20); o.push_back(0); o.push_back(0);
+  o.push_back(0xFF);
+  cbor_text(o, "skew_ppb"); cbor_head(o, 1, 1234);
+  o.push_back(0xFF);
+  return o;
+}
+
+Bytes chunk_msg(const std::string& type, const std::string& id, const char* key,
+                const uint8_t* p, size_t n, uint32_t idx, uint32_t parts) {
+  Bytes o;
+  cbor_head(o, 5, 6);
+  cbor_text(o, "type"); cbor_text(o, type);
+  cbor_text(o, "id"); cbor_text(o, id);
+  cbor_text(o, "idx"); cbor_head(o, 0, idx);
+  cbor_text(o, "parts"); cbor_head(o, 0, parts);
+  cbor_text(o, "crc"); cbor_head(o, 0, vib::crc::crc32(p, n));
+  cbor_text(o, key); cbor_bytes(o, p, n);
+  return o;
+}
+
+// Messages in send order; expected (optional) gets the blob hashes, held_at
+// (optional) the index of the first held-back chunk
+std::vector<Bytes> make_fleet(const Fleet& fl, std::unordered_map<std::string, uint64_t>* expected,
+                              size_t* held_at = nullptr) {
+  std::mt19937_64 rng(2024);
+  std::uniform_int_distribution<size_t> axis_len(3600, 5200);   // delta-coded axis, bytes
+  std::vector<std::vector<Bytes>> per_dev(fl.devices);
+  for (size_t d = 0; d < fl.devices; d++) {
+    char dev[48];
+    std::snprintf(dev, sizeof(dev), "%s%04zu", kSimPrefix, d);
+    for (size_t c = 0; c < fl.captures; c++) {
+      const uint64_t t0 = 1760000000000000ULL + (uint64_t)c * 600000000ULL + d * 7919ULL;
+      const std::string id = std::string(dev) + "-" + std::to_string((uint32_t)t0);
+      per_dev[d].push_back(meta_msg(id, dev, t0));
+      static const char* const types[4] = { "dt", "x", "y", "z" };
+      for (const char* t : types) {
+        const size_t len = t[0] == 'd' ? 2 * 2999 : axis_len(rng);
+        const Bytes blob = synth_blob(id, t, len);
+        if (expected) (*expected)[id + "/" + t] = fnv1a(blob.data(), blob.size());
+        const uint32_t parts = (uint32_t)((len + 1023) / 1024);
+        for (uint32_t i = 0; i < parts; i++) {
+          const size_t off = (size_t)i * 1024;
+          per_dev[d].push_back(chunk_msg(t, id, t[0] == 'd' ? "dt" : "a", blob.data() + off,
+                                         std::min<size_t>(1024, len - off), i, parts));
+        }
+      }
+    }
+  }
+  // Interleave the devices: each keeps its own order, the mix is random
+  std::vector<Bytes> out, held;
+  std::vector<size_t> pos(fl.devices, 0);
+  std::vector<size_t> live(fl.devices);
+  for (size_t d = 0; d < fl.devices; d++) live[d] = d;
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  std::vector<std::pair<size_t, Bytes>> dups;
+  while (!live.empty()) {
+    const size_t k = std::uniform_int_distribution<size_t>(0, live.size() - 1)(rng);
+    const size_t d = live[k];
+    Bytes& m = per_dev[d][pos[d]++];
+    if (pos[d] == per_dev[d].size()) { live[k] = live.back(); live.pop_back(); }
+    const double r = u(rng);
+    if (r < fl.loss) {
+      // Chunks end with their payload; metas are indefinite maps (0xBF)
+      if (r < fl.loss / 2 && m[0] != 0xBF) {
+        out.push_back(m);
+        out.back().back() ^= 0x5A;
+      }
+      held.push_back(std::move(m));
+      continue;
+    }
+    if (r < fl.loss + fl.dup) dups.emplace_back(out.size() + 1 + (size_t)(u(rng) * 2000), m);
+    out.push_back(std::move(m));
+  }
+  // Duplicates land later in the stream; held-back chunks come last
+  std::sort(dups.begin(), dups.end(), [](const std::pair<size_t, Bytes>& a, const std::pair<size_t, Bytes>& b) { return a.first < b.first; });
+  std::vector<Bytes> mixed;
+  mixed.reserve(out.size() + dups.size() + held.size());
+  size_t j = 0;
+  for (size_t i = 0; i < out.size(); i++) {
+    while (j < dups.size() && dups[j].first <= i) mixed.push_back(std::move(dups[j++].second));
+    mixed.push_back(std::move(out[i]));
+  }
+  while (j < dups.size()) mixed.push_back(std::move(dups[j++].second));
+  if (held_at) *held_at = mixed.size();
+  std::shuffle(held.begin(), held.end(), rng);
+  for (auto& m : held) mixed.push_back(std::move(m));
+  return mixed;
+}
+
+// -------------------------
+// Minimal MQTT 3.1.1 (QoS 0 publish / subscribe)
+// -------------------------
+class Mqtt {
+public:
+  ~Mqtt() { if (fd_ >= 0) close(fd_); }
+
+  bool connect(const char* host, const char* port, const std::string& client_id) {
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &res) != 0) return false;
+    for (addrinfo* a = res; a && fd_ < 0; a = a->ai_next) {
+      fd_ = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+      if (fd_ >= 0 && ::connect(fd_, a->ai_addr, a->ai_addrlen) != 0) { close(fd_); fd_ = -1; }
+    }
+    freeaddrinfo(res);
+    if (fd_ < 0) return false;
+    const int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    Bytes v;
+    str(v, "MQTT");
+    v.push_back(4);          // 3.1.1
+    v.push_back(0x02);       // clean session
+    v.push_back(0); v.push_back(60);
+    str(v, client_id);
+    if (!packet(0x10, v)) return false;
+    uint8_t type;
+    Bytes body;
+    return read(type, body) && type == 0x20 && body.size() == 2 && body[1] == 0;
+  }
+
+  bool subscribe(const std::string& topic) {
+    Bytes v = { 0, 1 };
+    str(v, topic);
+    v.push_back(0);
+    if (!packet(0x82, v)) return false;
+    uint8_t type;
+    Bytes body;
+    return read(type, body) && type == 0x90;
+  }
+
+  bool publish(const std::string& topic, const Bytes& payload) {
+    Bytes v;
+    str(v, topic);
+    v.insert(v.end(), payload.begin(), payload.end());
+    return packet(0x30, v);
+  }
+
+  bool ping() { return packet(0xC0, Bytes()); }
+
+  // Next packet; false on error, timeout (type 0) is not an error
+  bool read(uint8_t& type, Bytes& body, int timeout_ms = -1) {
+    if (timeout_ms >= 0) {
+      timeval tv{ timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+      setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+    uint8_t h;
+    const ssize_t r = ::recv(fd_, &h, 1, 0);
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { type = 0; return true; }
+    if (r != 1) return false;
+    size_t len = 0;
+    for (int shift = 0; shift < 28; shift += 7) {
+      uint8_t b;
+      if (!readAll(&b, 1)) return false;
+      len |= (size_t)(b & 0x7F) << shift;
+      if (!(b & 0x80)) break;
+    }
+    body.resize(len);
+    type = h & 0xF0;
+    return readAll(body.data(), len);
+  }
+
+private:
+  static void str(Bytes& v, const std::string& s) {
+    v.push_back((uint8_t)(s.size() >> 8));
+    v.push_back((uint8_t)s.size());
+    v.insert(v.end(), s.begin(), s.end());
+  }
+  bool packet(uint8_t h, const Bytes& v) {
+    Bytes p = { h };
+    size_t len = v.size();
+    do {
+      uint8_t b = len & 0x7F;
+      len >>= 7;
+      if (len) b |= 0x80;
+      p.push_back(b);
+    } while (len);
+    p.insert(p.end(), v.begin(), v.end());
+    size_t off = 0;
+    while (off < p.size()) {
+      const ssize_t w = ::send(fd_, p.data() + off, p.size() - off, MSG_NOSIGNAL);
+      if (w <= 0) return false;
+      off += (size_t)w;
+    }
+    return true;
+  }
+  bool readAll(uint8_t* dst, size_t n) {
+    while (n) {
+      const ssize_t r = ::recv(fd_, dst, n, 0);
+      if (r <= 0) {
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+        return false;
+      }
+      dst += r;
+      n -= (size_t)r;
+    }
+    return true;
+  }
+
+  int fd_ = -1;
+};
+
+// -------------------------
+// Modes
+// -------------------------
+void report(const Engine& e, double secs) {
+  const Stats& s = e.stats;
+  const uint64_t archived = s.complete.load() + s.partial.load();
+  std::printf("%llu msgs (%.1f MB) in %.2f s: %.0f msg/s, %.1f MB/s\n",
+              (unsigned long long)s.msgs.load(), (double)s.bytes.load() / 1e6, secs,
+              (double)s.msgs.load() / secs, (double)s.bytes.load() / 1e6 / secs);
+  std::printf("captures: %llu complete, %llu partial, %llu reopened, %llu evicted, %llu parked, %llu unparked | dups %llu, conflicts %llu, corrupt %llu, bad %llu\n",
+              (unsigned long long)s.complete.load(), (unsigned long long)s.partial.load(),
+              (unsigned long long)s.reopened.load(), (unsigned long long)s.evicted.load(),
+              (unsigned long long)s.parked.load(), (unsigned long long)s.unparked.load(),
+              (unsigned long long)s.dups.load(),
+              (unsigned long long)s.conflicts.load(), (unsigned long long)s.corrupt.load(),
+              (unsigned long long)s.bad.load());
+  if (archived) {
+    std::printf("first message -> archived: mean %.1f ms, max %.1f ms\n",
+                (double)s.latency_us_sum.load() / 1000.0 / (double)archived,
+                (double)s.latency_us_max.load() / 1000.0);
+  }
+  if (s.verified.load() || s.verify_fail.load()) {
+    std::printf("verified %llu captures, %llu %s\n", (unsigned long long)s.verified.load(),
+                (unsigned long long)s.verify_fail.load(), s.verify_fail.load() ? "MISMATCH" : "mismatches");
+  }
+}
+
+size_t ncpu() {
+  const unsigned n = std::thread::hardware_concurrency();
+  return n ? n : 4;
+}
+
+// One capture whose last chunk comes after it was archived partial and
+// parked: the chunk must complete it from <id>.part, and the .nack.json must
+// stay on disk until then
+bool benchLateCompletion() {
+  char dir[] = "/tmp/fleet_reassembler.XXXXXX";
+  if (!mkdtemp(dir)) { std::perror("mkdtemp"); return false; }
+  Fleet fl;
+  fl.devices = 1;
+  fl.captures = 1;
+  fl.dup = 0.0;
+  fl.loss = 0.0;
+  std::unordered_map<std::string, uint64_t> expected;
+  std::vector<Bytes> msgs = make_fleet(fl, &expected);
+  Bytes late = msgs.back();
+  msgs.pop_back();
+  std::string id;
+  peek_id(late, id);
+  const std::string base = std::string(dir) + "/" + id;
+  auto exists = [](const std::string& p) { struct stat sb; return stat(p.c_str(), &sb) == 0; };
+
+  Engine e(1, 1, dir, true);
+  e.expected = expected;
+  e.start();
+  for (auto& m : msgs) e.ingest(m);
+  e.sweep(std::chrono::milliseconds(0), std::chrono::milliseconds(0), std::chrono::milliseconds(0));
+  e.drain();
+  const bool parked = e.stats.partial.load() == 1 && e.stats.parked.load() == 1 &&
+                      exists(base + ".part") && exists(base + ".nack.json");
+  e.ingest(late);
+  e.sweep(std::chrono::milliseconds(0), std::chrono::milliseconds(0), std::chrono::milliseconds(0));
+  e.drain();
+  e.stop();
+  const bool merged = e.stats.unparked.load() == 1 && e.stats.complete.load() == 1 &&
+                      e.stats.reopened.load() == 1 && e.stats.verified.load() == 1 &&
+                      exists(base + ".cap") && !exists(base + ".nack.json") && !exists(base + ".part");
+  for (const char* ext : { ".cap", ".nack.json", ".part" }) std::remove((base + ext).c_str());
+  rmdir(dir);
+  std::printf("\nlate chunk after the partial was parked: %s\n",
+              parked && merged ? "completed from .part" : "MISMATCH");
+  return parked && merged;
+}
+
+int bench(int argc, char** argv) {
+  Fleet fl;
+  if (argc > 2) fl.devices = (size_t)std::atol(argv[2]);
+  if (argc > 3) fl.captures = (size_t)std::atol(argv[3]);
+  const size_t shard_max = argc > 4 ? (size_t)std::atol(argv[4]) : ncpu();
+  if (argc > 5) fl.dup = std::atof(argv[5]) / 100.0;
+  if (argc > 6) fl.loss = std::atof(argv[6]) / 100.0;
+
+  std::unordered_map<std::string, uint64_t> expected;
+  const std::vector<Bytes> msgs = make_fleet(fl, &expected);
+  size_t bytes = 0;
+  for (const auto& m : msgs) bytes += m.size();
+  std::printf("fleet: %zu devices x %zu captures, %zu msgs (%.1f MB), dup %.0f%%, held back %.0f%%\n",
+              fl.devices, fl.captures, msgs.size(), (double)bytes / 1e6, fl.dup * 100.0, fl.loss * 100.0);
+
+  int rc = 0;
+  for (size_t shards = 1; shards <= shard_max; shards *= 2) {
+    Engine e(shards, std::max<size_t>(1, shards / 4), "", true);
+    e.expected = expected;
+    e.start();
+    std::vector<Bytes> copy = msgs;
+    const auto t0 = Clock::now();
+    for (auto& m : copy) e.ingest(m);
+    e.sweep(std::chrono::milliseconds(0), std::chrono::milliseconds(0));
+    e.drain();
+    const double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+    e.stop();
+    std::printf("\n%zu shard(s):\n", shards);
+    report(e, secs);
+    const bool ok = e.stats.complete.load() == fl.devices * fl.captures && e.stats.partial.load() == 0 &&
+                    e.stats.verify_fail.load() == 0 && e.stats.verified.load() == e.stats.complete.load() &&
+                    e.stats.bad.load() == 0 && e.stats.conflicts.load() == 0;
+    if (!ok) { std::printf("MISMATCH: expected %zu complete captures\n", fl.devices * fl.captures); rc = 1; }
+    if (shards < shard_max && shards * 2 > shard_max) shards = shard_max / 2;   // end on shard_max
+  }
+  if (!benchLateCompletion()) rc = 1;
+  return rc;
+}
+
+int sub(int argc, char** argv) {
+  if (argc < 5) return 2;
+  const size_t shards = argc > 5 ? (size_t)std::atol(argv[5]) : ncpu();
+  const std::string out_dir = argc > 6 ? argv[6] : "";
+  const int idle_s = argc > 7 ? std::atoi(argv[7]) : 10;
+  if (!out_dir.empty()) mkdir(out_dir.c_str(), 0755);
+
+  Mqtt q;
+  if (!q.connect(argv[2], argv[3], "fleet-reassembler-" + std::to_string(getpid())) || !q.subscribe(argv[4])) {
+    std::fprintf(stderr, "fleet_reassembler: cannot subscribe to %s on %s:%s\n", argv[4], argv[2], argv[3]);
+    return 1;
+  }
+  std::printf("subscribed to %s, %zu shards, idle %d s\n", argv[4], shards, idle_s);
+  std::fflush(stdout);
+
+  Engine e(shards, std::max<size_t>(1, shards / 4), out_dir, true);
+  e.start();
+  Clock::time_point first, last = Clock::now(), ping = Clock::now(), swept = Clock::now();
+  bool started = false;
+  for (;;) {
+    uint8_t type;
+    Bytes body;
+    if (!q.read(type, body, 500)) { std::fprintf(stderr, "fleet_reassembler: connection lost\n"); break; }
+    const auto now = Clock::now();
+    if (type == 0x30 && body.size() >= 2) {
+      const size_t tl = ((size_t)body[0] << 8) | body[1];
+      if (body.size() < 2 + tl) continue;
+      Bytes payload(body.begin() + 2 + (long)tl, body.end());
+      if (!started) { first = now; started = true; }
+      last = now;
+      e.ingest(payload);
+    }
+    if (now - ping > std::chrono::seconds(30)) { q.ping(); ping = now; }
+    if (now - swept > std::chrono::seconds(1)) { e.sweep(std::chrono::seconds(idle_s)); swept = now; }
+    if (started && now - last > std::chrono::seconds(3 * idle_s)) break;
+  }
+  // Partials go to disk so a later run can still complete them
+  e.sweep(std::chrono::milliseconds(0), std::chrono::minutes(10), std::chrono::milliseconds(0));
+  e.drain();
+  e.stop();
+  if (started) report(e, std::max(1e-3, std::chrono::duration<double>(last - first).count()));
+  return e.stats.verify_fail.load() ? 1 : 0;
+}
+
+int load(int argc, char** argv) {
+  if (argc < 5) return 2;
+  Fleet fl;
+  if (argc > 5) fl.devices = (size_t)std::atol(argv[5]);
+  if (argc > 6) fl.captures = (size_t)std::atol(argv[6]);
+  if (argc > 7) fl.dup = std::atof(argv[7]) / 100.0;
+  if (argc > 8) fl.loss = std::atof(argv[8]) / 100.0;
+  const double rate = argc > 9 ? std::atof(argv[9]) : 0.0;
+  const double resend_s = argc > 10 ? std::atof(argv[10]) : 0.0;
+
+  size_t held_at = 0;
+  const std::vector<Bytes> msgs = make_fleet(fl, nullptr, &held_at);
+  Mqtt q;
+  if (!q.connect(argv[2], argv[3], "fleet-load-" + std::to_string(getpid()))) {
+    std::fprintf(stderr, "fleet_reassembler: cannot connect to %s:%s\n", argv[2], argv[3]);
+    return 1;
+  }
+  const auto t0 = Clock::now();
+  size_t bytes = 0;
+  for (size_t i = 0; i < msgs.size(); i++) {
+    if (i == held_at && resend_s > 0 && i < msgs.size()) {
+      std::printf("holding %zu chunks back for %.1f s\n", msgs.size() - i, resend_s);
+      std::fflush(stdout);
+      std::this_thread::sleep_for(std::chrono::duration<double>(resend_s));
+      q.ping();
+    }
+    if (rate > 0) std::this_thread::sleep_until(t0 + std::chrono::microseconds((int64_t)((double)i * 1e6 / rate)));
+    if (!q.publish(argv[4], msgs[i])) { std::fprintf(stderr, "fleet_reassembler: publish failed at %zu\n", i); return 1; }
+    bytes += msgs[i].size();
+  }
+  const double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+  std::printf("published %zu msgs (%.1f MB) for %zu devices x %zu captures in %.2f s (%.0f msg/s)\n",
+              msgs.size(), (double)bytes / 1e6, fl.devices, fl.captures, secs, (double)msgs.size() / secs);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const std::string mode = argc > 1 ? argv[1] : "bench";
+  int rc = 2;
+  if (mode == "bench") rc = bench(argc, argv);
+  else if (mode == "sub") rc = sub(argc, argv);
+  else if (mode == "load") rc = load(argc, argv);
+  if (rc == 2) {
+    std::fprintf(stderr,
+                 "usage: %s bench [devices] [captures] [shards] [dup%%] [loss%%]\n"
+                 "       %s sub <host> <port> <topic> [shards] [out_dir] [idle_s]\n"
+                 "       %s load <host> <port> <topic> [devices] [captures] [dup%%] [loss%%] [msg/s] [resend_s]\n",
+                 argv[0], argv[0], argv[0]);
+  }
+  return rc;
+}
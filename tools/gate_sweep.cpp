@@ -0,0 +1,589 @@
+// gate_sweep.cpp
+// Gate tuning against recorded captures: runs the firmware pipeline (the
+// same vib_pipeline.h stages the device runs) over an archive for a sweep of
+// one parameter and reports pass rate, bytes sent and radio charge per value.
+//
+// Build (from repo root):
+//   g++ -O2 -std=c++17 -pthread -Ilib/vib/src tools/gate_sweep.cpp -o gate_sweep
+// Run:
+//   ./gate_sweep run <dir> <stages> <sweep> [threads=ncpu] [kBps=40]
+//       <dir>     captures archived by `fleet_reassembler sub` (<id>.cap);
+//                 partial and features-only captures are skipped
+//       <stages>  stage list as in vib_golden.h, with {} where the swept
+//                 value goes, or "default" for the firmware's default
+//                 pipeline: "rms; peak; gate feature=mag_rms min={}; encode codec=raw16; mqtt"
+//       <sweep>   "lo:hi:step" or "v1,v2,..."
+//       kBps      link throughput for captures whose meta has no link_kBps
+//   ./gate_sweep synth <dir> [devices=50] [captures=20]
+//       writes a synthetic archive (quiet, machine and bearing captures at
+//       random gains, from the vib_golden.h generator) to try the tool on
+//
+// The archived axes are what the device sent, i.e. after its filters: a
+// stage list should not repeat filters the recording pipeline ("pipe" in
+// the meta) already applied. The archive only holds captures that passed
+// the device's gate at the time, so thresholds below that one are only
+// meaningful on captures recorded with the gate open.
+//
+// Results are per capture and reduced in archive order, so they do not
+// depend on the thread count; "decisions" is a hash of every pass/fail
+// decision of a row, to compare runs (or builds) at a glance.
+//
+// Bytes and charge cover what the gate decides: meta, dt and axis blobs of
+// passing captures (the overview pyramid is not counted), the link time
+// predicted as linkPredictMs() in src/main.cpp plus the 3 s flush before
+// sleep, at the default radio rung currents (RADIO_LADDER). Connect and
+// capture cost the same for every threshold and are left out.
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vib_codec.h"
+#include "vib_golden.h"
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+// Firmware figures (src/main.cpp)
+constexpr size_t kChunk = 1024;          // SF_CHUNK
+constexpr double kFlushMsPerMsg = 200.0; // linkPredictMs()
+constexpr double kFinishMs = 3000.0;     // finishAndSleep()
+constexpr double kMaIdle = 45.0;         // RADIO_LADDER[RADIO_DEFAULT_RUNG]
+constexpr double kMaTx = 300.0;
+
+const char* kDefaultStages = "rms; peak; gate feature=mag_rms min={}; encode codec=raw16; mqtt";
+
+// -------------------------
+// Minimal CBOR
+// -------------------------
+void cbor_head(Bytes& o, uint8_t major, uint64_t v) {
+  const uint8_t m = (uint8_t)(major << 5);
+  if (v < 24) { o.push_back(m | (uint8_t)v); return; }
+  int n = v <= 0xFF ? 1 : v <= 0xFFFF ? 2 : v <= 0xFFFFFFFFULL ? 4 : 8;
+  o.push_back(m | (uint8_t)(n == 1 ? 24 : n == 2 ? 25 : n == 4 ? 26 : 27));
+  for (int i = n - 1; i >= 0; i--) o.push_back((uint8_t)(v >> (8 * i)));
+}
+void cbor_text(Bytes& o, const std::string& s) { cbor_head(o, 3, s.size()); o.insert(o.end(), s.begin(), s.end()); }
+void cbor_bytes(Bytes& o, const uint8_t* p, size_t n) { cbor_head(o, 2, n); o.insert(o.end(), p, p + n); }
+void cbor_float(Bytes& o, float f) {
+  uint32_t b;
+  std::memcpy(&b, &f, 4);
+  o.push_back(0xFA);
+  for (int i = 3; i >= 0; i--) o.push_back((uint8_t)(b >> (8 * i)));
+}
+
+// Reads one item; texts/bytes are views, floats and simple values (u: 20
+// false, 21 true) are decoded, containers are skipped
+class CborReader {
+public:
+  CborReader(const uint8_t* p, size_t n) : p_(p), end_(p + n) {}
+
+  enum Kind { UINT, NINT, BYTES, TEXT, FLOAT, SIMPLE, OTHER, BREAK, BAD };
+  struct Item {
+    Kind kind = BAD;
+    uint64_t u = 0;
+    double f = 0.0;
+    const uint8_t* data = nullptr;
+    size_t len = 0;
+  };
+
+  bool map_begin(int64_t& entries) {   // -1: indefinite
+    if (p_ >= end_ || (*p_ >> 5) != 5) return false;
+    if ((*p_ & 31) == 31) { p_++; entries = -1; return true; }
+    uint64_t v;
+    if (!head(v)) return false;
+    entries = (int64_t)v;
+    return true;
+  }
+
+  Item next() {
+    Item it;
+    if (p_ >= end_) return it;
+    if (*p_ == 0xFF) { p_++; it.kind = BREAK; return it; }
+    const uint8_t major = *p_ >> 5;
+    const uint8_t ai = *p_ & 31;
+    if (ai == 31) {                    // indefinite container or string
+      p_++;
+      if (!skip_until_break()) return it;
+      it.kind = OTHER;
+      return it;
+    }
+    uint64_t v;
+    if (!head(v)) return it;
+    switch (major) {
+      case 0: it.kind = UINT; it.u = v; return it;
+      case 1: it.kind = NINT; it.u = v; return it;
+      case 2: case 3:
+        if (v > (uint64_t)(end_ - p_)) return it;
+        it.kind = major == 2 ? BYTES : TEXT;
+        it.data = p_;
+        it.len = (size_t)v;
+        p_ += v;
+        return it;
+      case 4: case 5:
+        for (uint64_t i = 0; i < (major == 5 ? 2 * v : v); i++) {
+          if (next().kind == BAD) return it;
+        }
+        it.kind = OTHER;
+        return it;
+      case 6:
+        return next();                 // tag: the tagged item
+      default:
+        it.kind = ai < 24 ? SIMPLE : ai >= 25 && ai <= 27 ? FLOAT : OTHER;
+        it.u = v;
+        if (ai == 25) it.f = half_to_double((uint16_t)v);
+        if (ai == 26) { uint32_t b = (uint32_t)v; float f; std::memcpy(&f, &b, 4); it.f = f; }
+        if (ai == 27) std::memcpy(&it.f, &v, 8);
+        return it;
+    }
+  }
+
+private:
+  static double half_to_double(uint16_t h) {
+    const int e = (h >> 10) & 31, m = h & 1023;
+    const double v = e == 0 ? std::ldexp(m, -24) : e == 31 ? (m ? NAN : INFINITY) : std::ldexp(m + 1024, e - 25);
+    return (h & 0x8000) ? -v : v;
+  }
+  bool head(uint64_t& v) {
+    const uint8_t ai = *p_++ & 31;
+    if (ai < 24) { v = ai; return true; }
+    const int n = ai == 24 ? 1 : ai == 25 ? 2 : ai == 26 ? 4 : ai == 27 ? 8 : 0;
+    if (!n || end_ - p_ < n) return false;
+    v = 0;
+    for (int i = 0; i < n; i++) v = (v << 8) | *p_++;
+    return true;
+  }
+  bool skip_until_break() {
+    for (;;) {
+      if (p_ >= end_) return false;
+      const Item it = next();
+      if (it.kind == BREAK) return true;
+      if (it.kind == BAD) return false;
+    }
+  }
+
+  const uint8_t* p_;
+  const uint8_t* end_;
+};
+
+bool is_key(const CborReader::Item& it, const char* k) {
+  return it.kind == CborReader::TEXT && it.len == std::strlen(k) && std::memcmp(it.data, k, it.len) == 0;
+}
+
+std::string as_text(const CborReader::Item& it) {
+  return it.kind == CborReader::TEXT ? std::string((const char*)it.data, it.len) : std::string();
+}
+
+// Calls fn(key, value) for every entry of the map at p
+template <typename Fn>
+bool for_each_entry(const uint8_t* p, size_t n, Fn fn) {
+  CborReader r(p, n);
+  int64_t entries;
+  if (!r.map_begin(entries)) return false;
+  for (int64_t i = 0; entries < 0 || i < entries; i++) {
+    const CborReader::Item k = r.next();
+    if (k.kind == CborReader::BREAK && entries < 0) break;
+    if (k.kind != CborReader::TEXT) return false;
+    const CborReader::Item v = r.next();
+    if (v.kind == CborReader::BAD) return false;
+    fn(k, v);
+  }
+  return true;
+}
+
+// -------------------------
+// Archive
+// -------------------------
+struct Capture {
+  std::string id, dev;
+  uint32_t n = 0;
+  uint16_t fs_hz = 0;
+  uint8_t range_g = 24;
+  double kBps = 0.0;              // from the meta, 0 = unknown
+  size_t meta_len = 0;
+  std::vector<uint16_t> dt_us;
+  std::vector<int16_t> axis[vib::pipe::kAxes];
+};
+
+bool codec_from_format(const std::string& fmt, vib::codec::Codec& c) {
+  for (uint8_t i = 0; i <= vib::codec::DELTA; i++) {
+    if (fmt == vib::codec::format((vib::codec::Codec)i)) { c = (vib::codec::Codec)i; return true; }
+  }
+  return false;
+}
+
+// false: partial, features-only or malformed (why says which)
+bool parse_capture(const Bytes& raw, Capture& c, const char*& why) {
+  bool complete = false;
+  const uint8_t* meta = nullptr;
+  size_t meta_len = 0;
+  const uint8_t* blob[4] = { nullptr, nullptr, nullptr, nullptr };   // dt, x, y, z
+  size_t blob_len[4] = { 0, 0, 0, 0 };
+  static const char* kBlobs[4] = { "dt", "x", "y", "z" };
+  why = "malformed";
+  if (!for_each_entry(raw.data(), raw.size(), [&](const CborReader::Item& k, const CborReader::Item& v) {
+        if (is_key(k, "id")) c.id = as_text(v);
+        else if (is_key(k, "dev")) c.dev = as_text(v);
+        else if (is_key(k, "complete")) complete = v.kind == CborReader::SIMPLE && v.u == 21;
+        else if (is_key(k, "meta") && v.kind == CborReader::BYTES) { meta = v.data; meta_len = v.len; }
+        for (int b = 0; b < 4; b++) {
+          if (is_key(k, kBlobs[b]) && v.kind == CborReader::BYTES) { blob[b] = v.data; blob_len[b] = v.len; }
+        }
+      })) {
+    return false;
+  }
+  if (!complete) { why = "partial"; return false; }
+  if (!meta) return false;
+
+  std::string a_fmt;
+  int32_t so = 0;
+  if (!for_each_entry(meta, meta_len, [&](const CborReader::Item& k, const CborReader::Item& v) {
+        const bool u = v.kind == CborReader::UINT;
+        if (is_key(k, "n") && u) c.n = (uint32_t)v.u;
+        else if (is_key(k, "fs") && u) c.fs_hz = (uint16_t)v.u;
+        else if (is_key(k, "range_g") && u) c.range_g = (uint8_t)v.u;
+        else if (is_key(k, "so_mg") && u) so = (int32_t)v.u;
+        else if (is_key(k, "a_fmt")) a_fmt = as_text(v);
+        else if (is_key(k, "link_kBps")) c.kBps = v.kind == CborReader::FLOAT ? v.f : u ? (double)v.u : 0.0;
+      })) {
+    return false;
+  }
+  c.meta_len = meta_len;
+  if (!blob[1] || !blob[2] || !blob[3]) { why = "features only"; return false; }
+  vib::codec::Codec codec;
+  if (!c.n || !c.fs_hz || !codec_from_format(a_fmt, codec)) return false;
+  if (!so) so = vib::fx::mg_per_digit(c.range_g);
+  for (size_t k = 0; k < vib::pipe::kAxes; k++) {
+    c.axis[k].resize(c.n);
+    if (vib::codec::decode(codec, blob[k + 1], blob_len[k + 1], so, c.axis[k].data(), c.n) != (long)c.n) return false;
+  }
+  c.dt_us.assign(c.n > 1 ? c.n - 1 : 0, (uint16_t)(1000000u / c.fs_hz));
+  if (blob[0] && blob_len[0] == 2 * c.dt_us.size()) {
+    for (size_t i = 0; i < c.dt_us.size(); i++) c.dt_us[i] = (uint16_t)(blob[0][2 * i] | (blob[0][2 * i + 1] << 8));
+  }
+  return true;
+}
+
+bool read_file(const std::string& path, Bytes& out) {
+  FILE* f = std::fopen(path.c_str(), "rb");
+  if (!f) return false;
+  out.clear();
+  uint8_t buf[65536];
+  size_t r;
+  while ((r = std::fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + r);
+  std::fclose(f);
+  return true;
+}
+
+// Every complete capture of dir, sorted by id
+std::vector<Capture> load_archive(const std::string& dir) {
+  std::vector<std::string> names;
+  if (DIR* d = opendir(dir.c_str())) {
+    while (dirent* e = readdir(d)) {
+      const std::string n = e->d_name;
+      if (n.size() > 4 && n.compare(n.size() - 4, 4, ".cap") == 0) names.push_back(n);
+    }
+    closedir(d);
+  } else {
+    std::perror(dir.c_str());
+  }
+  std::sort(names.begin(), names.end());
+
+  std::vector<Capture> caps;
+  size_t partial = 0, features = 0, bad = 0;
+  Bytes raw;
+  for (const auto& n : names) {
+    Capture c;
+    const char* why = "unreadable";
+    if (read_file(dir + "/" + n, raw) && parse_capture(raw, c, why)) {
+      caps.push_back(std::move(c));
+      continue;
+    }
+    if (!std::strcmp(why, "partial")) partial++;
+    else if (!std::strcmp(why, "features only")) features++;
+    else { bad++; std::fprintf(stderr, "%s: %s\n", n.c_str(), why); }
+  }
+  std::printf("%s: %zu captures (skipped %zu partial, %zu features-only, %zu bad)\n", dir.c_str(), caps.size(),
+              partial, features, bad);
+  return caps;
+}
+
+// -------------------------
+// Sweep
+// -------------------------
+// The device's MQTT sink; publishing is accounted for by the caller
+class SinkStage : public vib::pipe::Stage {
+public:
+  vib::pipe::Kind kind() const override { return vib::pipe::SINK; }
+  const char* type() const override { return "mqtt"; }
+  bool run(vib::pipe::Frame&) override { return true; }
+};
+
+vib::pipe::Stage* makeSinkStage(const vib::pipe::StageSpec& spec) {
+  if (!std::strcmp(spec.type, "mqtt")) return new SinkStage();
+  return nullptr;
+}
+
+std::string substitute(const std::string& tmpl, double v) {
+  char num[32];
+  std::snprintf(num, sizeof(num), "%g", v);
+  std::string s = tmpl;
+  for (size_t p = s.find("{}"); p != std::string::npos; p = s.find("{}", p)) s.replace(p, 2, num);
+  return s;
+}
+
+bool build(const std::string& stages, vib::pipe::Pipeline& p, char* err, size_t err_len) {
+  vib::pipe::StageSpec specs[vib::pipe::kMaxStages];
+  size_t n = 0;
+  if (!vib::golden::parse_stages(stages.c_str(), specs, vib::pipe::kMaxStages, n)) {
+    std::snprintf(err, err_len, "bad stage list");
+    return false;
+  }
+  return p.build(specs, n, makeSinkStage, err, err_len);
+}
+
+bool parse_sweep(const char* s, std::vector<double>& out) {
+  out.clear();
+  double lo, hi, step;
+  if (std::strchr(s, ':')) {
+    if (std::sscanf(s, "%lf:%lf:%lf", &lo, &hi, &step) != 3 || step <= 0.0 || hi < lo) return false;
+    // Counted in double first: a tiny step must not allocate (or overflow size_t)
+    const double steps = std::floor((hi - lo) / step + 1e-9);
+    if (!(steps < 10000.0)) return false;
+    const size_t n = (size_t)steps + 1;
+    for (size_t i = 0; i < n; i++) out.push_back(lo + step * (double)i);
+    return true;
+  }
+  for (const char* p = s; *p;) {
+    char* end = nullptr;
+    out.push_back(std::strtod(p, &end));
+    if (end == p) return false;
+    p = *end == ',' ? end + 1 : end;
+    if (*end && *end != ',') return false;
+  }
+  return !out.empty();
+}
+
+struct Outcome {
+  uint8_t pass = 0;
+  uint32_t bytes = 0;
+  float mC = 0.0f;
+};
+
+// linkPredictMs() plus the flush before sleep, at the default rung
+float charge_mC(size_t bytes, double kBps) {
+  const double air_s = (double)bytes / (kBps * 1024.0);
+  const double msgs = std::ceil((double)bytes / (double)kChunk);
+  const double awake_s = air_s + (msgs * kFlushMsPerMsg + kFinishMs) / 1000.0;
+  return (float)(awake_s * kMaIdle + air_s * (kMaTx - kMaIdle));
+}
+
+void run_capture(const Capture& c, vib::pipe::Pipeline& p, vib::golden::Scratch& s, double kBps, Outcome& o) {
+  s.reserve(c.n);
+  vib::pipe::Frame f;
+  for (size_t k = 0; k < vib::pipe::kAxes; k++) {
+    std::memcpy(s.axis[k], c.axis[k].data(), 2 * (size_t)c.n);   // filters work in place
+    f.axis[k] = s.axis[k];
+    f.out[k].data = s.out[k];
+    f.out[k].cap = 2 * (size_t)c.n;
+  }
+  f.dt_us = c.dt_us.data();
+  f.n = c.n;
+  f.fs_hz = c.fs_hz;
+  f.range_g = c.range_g;
+  f.work = s.work;
+  const bool ok = p.run(f);
+  o = Outcome();
+  if (!f.gate_pass || !ok) return;
+  o.pass = 1;
+  o.bytes = (uint32_t)(c.meta_len + 2 * c.dt_us.size() + f.out[0].len + f.out[1].len + f.out[2].len);
+  o.mC = charge_mC(o.bytes, c.kBps > 0.0 ? c.kBps : kBps);
+}
+
+int sweep(const std::string& dir, std::string stages, const char* sweep_arg, unsigned threads, double kBps) {
+  if (stages == "default") stages = kDefaultStages;
+  std::vector<double> values;
+  if (!parse_sweep(sweep_arg, values)) {
+    std::fprintf(stderr, "bad sweep '%s' (lo:hi:step or v1,v2,...)\n", sweep_arg);
+    return 2;
+  }
+  if (stages.find("{}") == std::string::npos) std::fprintf(stderr, "note: no {} in the stage list, every row is the same\n");
+  char err[64];
+  {
+    vib::pipe::Pipeline p;
+    const std::string first = substitute(stages, values[0]);
+    if (!build(first, p, err, sizeof(err))) {
+      std::fprintf(stderr, "'%s': %s\n", first.c_str(), err);
+      return 2;
+    }
+    char desc[96];
+    p.describe(desc, sizeof(desc));
+    std::printf("pipeline %s\n", desc);
+  }
+
+  const std::vector<Capture> caps = load_archive(dir);
+  if (caps.empty()) return 1;
+  std::set<std::string> devs;
+  uint64_t samples = 0;
+  for (const auto& c : caps) { devs.insert(c.dev); samples += c.n; }
+
+  std::printf("%10s %8s %7s %8s %10s %10s %9s  %s\n", "value", "pass", "pass%", "devices", "MB", "mC", "mC/cap",
+              "decisions");
+  const auto t0 = std::chrono::steady_clock::now();
+  std::vector<Outcome> out(caps.size());
+  for (double v : values) {
+    const std::string text = substitute(stages, v);
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++) {
+      pool.emplace_back([&] {
+        vib::pipe::Pipeline p;
+        char e[64];
+        if (!build(text, p, e, sizeof(e))) { failed = true; return; }
+        vib::golden::Scratch s;
+        for (size_t i; (i = next.fetch_add(1)) < caps.size();) run_capture(caps[i], p, s, kBps, out[i]);
+      });
+    }
+    for (auto& th : pool) th.join();
+    if (failed) {
+      std::fprintf(stderr, "'%s' does not build\n", text.c_str());
+      return 2;
+    }
+
+    // Reduced in archive order: the same for any thread count
+    size_t pass = 0;
+    uint64_t bytes = 0;
+    double mC = 0.0;
+    uint64_t h = 1469598103934665603ULL;
+    std::set<std::string> pass_devs;
+    for (size_t i = 0; i < caps.size(); i++) {
+      h = vib::golden::fnv64(&out[i].pass, 1, h);
+      if (!out[i].pass) continue;
+      pass++;
+      bytes += out[i].bytes;
+      mC += out[i].mC;
+      pass_devs.insert(caps[i].dev);
+    }
+    std::printf("%10g %8zu %6.1f%% %4zu/%-3zu %10.3f %10.1f %9.2f  %016llx\n", v, pass,
+                100.0 * (double)pass / (double)caps.size(), pass_devs.size(), devs.size(), (double)bytes / 1e6, mC,
+                mC / (double)caps.size(), (unsigned long long)h);
+  }
+  const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  std::printf("%zu values x %zu captures on %u thread(s) in %.2f s (%.0f captures/s, %.1f M samples/s, kernels %s)\n",
+              values.size(), caps.size(), threads, secs, (double)(values.size() * caps.size()) / secs,
+              (double)(values.size() * samples) / secs / 1e6, vib::kernel_impl());
+  return 0;
+}
+
+// -------------------------
+// Synthetic archive
+// -------------------------
+int synth(const std::string& dir, unsigned devices, unsigned captures) {
+  mkdir(dir.c_str(), 0755);
+  static const vib::golden::Signal kSignals[3] = { vib::golden::QUIET, vib::golden::MACHINE, vib::golden::BEARING };
+  static const uint8_t kRanges[3] = { 6, 12, 24 };
+  uint32_t rng = 0xC0FFEE11u;
+  vib::golden::Scratch s;
+  size_t written = 0;
+  for (unsigned d = 0; d < devices; d++) {
+    char dev[32];
+    std::snprintf(dev, sizeof(dev), "sweep-sim-%03u", d);
+    const uint8_t range_g = kRanges[d % 3];
+    const int32_t so = vib::fx::mg_per_digit(range_g);
+    const uint32_t base_gain = 32 + vib::golden::xorshift32(rng) % 1024;  // per device, /256
+    for (unsigned k = 0; k < captures; k++) {
+      const vib::golden::Case cs = { "synth", "", range_g, 1000, 2000, kSignals[vib::golden::xorshift32(rng) % 3] };
+      s.reserve(cs.n);
+      vib::golden::make_signal(cs, s.axis);
+      // Per capture: gain around the device's and noise of its own
+      const int32_t gain = (int32_t)(base_gain * (128 + vib::golden::xorshift32(rng) % 256) / 256);
+      uint32_t noise = vib::golden::xorshift32(rng) | 1u;
+      static const int32_t kGravity[3] = { 0, 0, 1000 };
+      for (size_t a = 0; a < vib::pipe::kAxes; a++) {
+        for (uint32_t i = 0; i < cs.n; i++) {
+          int32_t mg = kGravity[a] + ((s.axis[a][i] - kGravity[a]) * gain) / 256 + vib::golden::noise_mg(noise, 20);
+          int32_t dg = mg >= 0 ? (mg + so / 2) / so : -((-mg + so / 2) / so);
+          dg = std::max<int32_t>(-2048, std::min<int32_t>(2047, dg));
+          s.axis[a][i] = vib::fx::raw_to_mg((int16_t)(dg * 16), so);
+        }
+      }
+
+      char id[64];
+      std::snprintf(id, sizeof(id), "%s-%llu", dev, 1700000000000ULL + (unsigned long long)k * 300000ULL);
+      Bytes meta;
+      meta.push_back(0xBF);
+      cbor_text(meta, "type"); cbor_text(meta, "meta");
+      cbor_text(meta, "id"); cbor_text(meta, id);
+      cbor_text(meta, "dev"); cbor_text(meta, dev);
+      cbor_text(meta, "n"); cbor_head(meta, 0, cs.n);
+      cbor_text(meta, "fs"); cbor_head(meta, 0, cs.fs_hz);
+      cbor_text(meta, "a_fmt"); cbor_text(meta, vib::codec::format(vib::codec::RAW16));
+      cbor_text(meta, "so_mg"); cbor_head(meta, 0, (uint64_t)so);
+      cbor_text(meta, "range_g"); cbor_head(meta, 0, range_g);
+      cbor_text(meta, "pipe"); cbor_text(meta, "rms>peak>encode(raw16)>mqtt");
+      cbor_text(meta, "link_kBps"); cbor_float(meta, (float)(8 + (d * 7) % 40));
+      meta.push_back(0xFF);
+
+      Bytes o;
+      o.push_back(0xBF);
+      cbor_text(o, "id"); cbor_text(o, id);
+      cbor_text(o, "dev"); cbor_text(o, dev);
+      cbor_text(o, "complete"); o.push_back(0xF5);
+      cbor_text(o, "meta"); cbor_bytes(o, meta.data(), meta.size());
+      Bytes dt(2 * (cs.n - 1));
+      for (size_t i = 0; i + 1 < cs.n; i++) { dt[2 * i] = 1000 & 0xFF; dt[2 * i + 1] = 1000 >> 8; }
+      cbor_text(o, "dt"); cbor_bytes(o, dt.data(), dt.size());
+      static const char* kAxisNames[3] = { "x", "y", "z" };
+      for (size_t a = 0; a < vib::pipe::kAxes; a++) {
+        const size_t len = vib::codec::encode_raw16(s.axis[a], cs.n, s.out[a], 2 * (size_t)cs.n);
+        cbor_text(o, kAxisNames[a]); cbor_bytes(o, s.out[a], len);
+      }
+      o.push_back(0xFF);
+
+      const std::string path = dir + "/" + id + ".cap";
+      FILE* f = std::fopen(path.c_str(), "wb");
+      if (!f || std::fwrite(o.data(), 1, o.size(), f) != o.size()) {
+        std::perror(path.c_str());
+        if (f) std::fclose(f);
+        return 1;
+      }
+      std::fclose(f);
+      written++;
+    }
+  }
+  std::printf("%zu captures of %u devices in %s\n", written, devices, dir.c_str());
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const std::string mode = argc > 1 ? argv[1] : "";
+  if (mode == "run" && argc >= 5) {
+    unsigned th = std::thread::hardware_concurrency();
+    if (argc > 5) th = (unsigned)std::atoi(argv[5]);
+    if (!th) th = 1;
+    const double kBps = argc > 6 ? std::atof(argv[6]) : 40.0;
+    return sweep(argv[2], argv[3], argv[4], th, kBps > 0.0 ? kBps : 40.0);
+  }
+  if (mode == "synth" && argc >= 3) {
+    return synth(argv[2], argc > 3 ? (unsigned)std::atoi(argv[3]) : 50, argc > 4 ? (unsigned)std::atoi(argv[4]) : 20);
+  }
+  std::fprintf(stderr, "usage: %s run <dir> <stages|default> <lo:hi:step|v1,v2,...> [threads] [kBps]\n"
+                       "       %s synth <dir> [devices] [captures]\n", argv[0], argv[0]);
+  return 2;
+}
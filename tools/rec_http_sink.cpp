@@ -0,0 +1,317 @@
+// rec_http_sink.cpp
+// Local HTTP server for the bulk upload of long recordings (upload.url).
+//
+// Build (from repo root):
+//   g++ -O2 -std=c++17 -Ilib/vib/src tools/rec_http_sink.cpp -o rec_http_sink
+// Run:
+//   ./rec_http_sink [port=8080] [dir=.]
+// and set upload.url to http://<this host>:8080/rec (any path is accepted).
+//
+// Each recording is kept as <dir>/<id>.vrb: its blocks in order, re-packed as
+// stored on the device (VRB1, vib::rec::kBlockBytes each), so the file size
+// tells how many blocks are held. Incoming records (VRD1 or VRB1) are decoded
+// with vib_rec.h and only complete, valid records are appended, so a
+// connection cut at any byte leaves a file the device can resume from.
+//
+// Protocol (see "Bulk HTTP upload" in src/main.cpp):
+//   GET  ?id=<id>                      -> X-Next-Block: blocks held
+//   POST ?id=<id>&from=<k>&blocks=<n>  chunked or Content-Length body of
+//                                         records; 409 if k != blocks held
+//
+// One connection at a time, plain HTTP only (put a TLS proxy in front to
+// test https). Each POST prints what arrived and how much smaller than the
+// stored blocks it was on the wire.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "vib_rec.h"
+
+namespace {
+
+// Buffered reads from a socket
+class Conn {
+public:
+  explicit Conn(int fd) : fd_(fd) {}
+
+  // One line without the CRLF; false on EOF/timeout or an over-long line
+  bool line(std::string& out) {
+    out.clear();
+    for (;;) {
+      int ch = get();
+      if (ch < 0) return false;
+      if (ch == '\n') break;
+      if (out.size() > 8192) return false;
+      out.push_back((char)ch);
+    }
+    if (!out.empty() && out.back() == '\r') out.pop_back();
+    return true;
+  }
+
+  // Up to n bytes (at least 1 unless EOF/timeout)
+  size_t read(uint8_t* dst, size_t n) {
+    if (pos_ == len_ && !fill()) return 0;
+    const size_t k = std::min(n, len_ - pos_);
+    std::memcpy(dst, buf_ + pos_, k);
+    pos_ += k;
+    return k;
+  }
+
+  bool send(const std::string& s) {
+    size_t off = 0;
+    while (off < s.size()) {
+      const ssize_t w = ::send(fd_, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+      if (w <= 0) return false;
+      off += (size_t)w;
+    }
+    return true;
+  }
+
+private:
+  int get() {
+    if (pos_ == len_ && !fill()) return -1;
+    return buf_[pos_++];
+  }
+  bool fill() {
+    const ssize_t r = ::recv(fd_, buf_, sizeof(buf_), 0);
+    if (r <= 0) return false;
+    pos_ = 0;
+    len_ = (size_t)r;
+    return true;
+  }
+
+  int fd_;
+  uint8_t buf_[16384];
+  size_t pos_ = 0, len_ = 0;
+};
+
+// Request body: chunked or Content-Length, read as a plain byte stream
+class Body {
+public:
+  Body(Conn& c, bool chunked, long length) : c_(c), chunked_(chunked), left_(chunked ? 0 : length) {}
+
+  size_t read(uint8_t* dst, size_t n) {
+    if (done_) return 0;
+    if (chunked_ && left_ == 0) {
+      std::string l;
+      if (started_ && (!c_.line(l) || !l.empty())) { done_ = true; return 0; }   // CRLF after data
+      started_ = true;
+      if (!c_.line(l)) { done_ = true; return 0; }
+      left_ = std::strtol(l.c_str(), nullptr, 16);
+      if (left_ <= 0) {
+        while (c_.line(l) && !l.empty()) {}   // trailers
+        done_ = true;
+        complete_ = true;
+        return 0;
+      }
+    }
+    if (left_ <= 0) { done_ = true; complete_ = !chunked_; return 0; }
+    const size_t got = c_.read(dst, std::min(n, (size_t)left_));
+    if (!got) { done_ = true; return 0; }
+    left_ -= (long)got;
+    return got;
+  }
+
+  bool complete() const { return complete_; }
+
+private:
+  Conn& c_;
+  bool chunked_;
+  long left_;
+  bool started_ = false;
+  bool done_ = false;
+  bool complete_ = false;
+};
+
+std::string queryParam(const std::string& target, const char* key) {
+  const size_t q = target.find('?');
+  if (q == std::string::npos) return "";
+  const std::string k = std::string(key) + "=";
+  size_t p = q + 1;
+  while (p < target.size()) {
+    size_t e = target.find('&', p);
+    if (e == std::string::npos) e = target.size();
+    if (target.compare(p, k.size(), k) == 0) return target.substr(p + k.size(), e - p - k.size());
+    p = e + 1;
+  }
+  return "";
+}
+
+bool validId(const std::string& id) {
+  if (id.empty() || id.size() > 96 || id[0] == '.') return false;
+  for (char ch : id) {
+    if (!isalnum((unsigned char)ch) && ch != '-' && ch != '_' && ch != '.') return false;
+  }
+  return true;
+}
+
+long blocksHeld(const std::string& path) {
+  struct stat sb;
+  if (stat(path.c_str(), &sb) != 0) return 0;
+  return (long)(sb.st_size / (off_t)vib::rec::kBlockBytes);
+}
+
+bool respond(Conn& c, int status, const char* reason, long next_block, const std::string& json, bool close) {
+  std::string h = "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n";
+  if (next_block >= 0) h += "X-Next-Block: " + std::to_string(next_block) + "\r\n";
+  h += "Content-Type: application/json\r\nContent-Length: " + std::to_string(json.size()) + "\r\n";
+  h += close ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n";
+  return c.send(h + json);
+}
+
+// Decodes records from the body and appends them to the file. Returns the
+// number of blocks appended.
+long receive(Body& body, const std::string& path, size_t& wire, bool& bad) {
+  FILE* f = std::fopen(path.c_str(), "ab");
+  if (!f) return -1;
+  std::vector<uint8_t> buf;
+  uint8_t tmp[8192];
+  int16_t digits[vib::rec::kSamplesPerBlock * 3];
+  uint8_t blk[vib::rec::kBlockBytes];
+  long appended = 0;
+  bad = false;
+  for (;;) {
+    const size_t n = body.read(tmp, sizeof(tmp));
+    if (!n) break;
+    wire += n;
+    buf.insert(buf.end(), tmp, tmp + n);
+    size_t off = 0;
+    for (;;) {
+      const size_t avail = buf.size() - off;
+      // A record is complete once its header and stream lengths are in
+      size_t need = vib::rec::kBlockBytes;
+      if (avail >= 4 && std::memcmp(&buf[off], vib::rec::kDeltaMagic, 4) == 0) {
+        if (avail < vib::rec::kDeltaHeaderBytes) break;
+        const uint8_t* p = &buf[off] + vib::rec::kHeaderBytes;
+        need = vib::rec::kDeltaHeaderBytes + vib::rec::get_u16(p) + vib::rec::get_u16(p + 2) + vib::rec::get_u16(p + 4);
+      }
+      if (avail < need) break;
+      vib::rec::BlockHeader h;
+      size_t used = 0;
+      if (!vib::rec::from_record(&buf[off], avail, used, h, digits) || !vib::rec::pack_block(h, digits, blk)) {
+        bad = true;
+        break;
+      }
+      if (std::fwrite(blk, 1, sizeof(blk), f) != sizeof(blk)) { bad = true; break; }
+      appended++;
+      off += used;
+    }
+    buf.erase(buf.begin(), buf.begin() + (long)off);
+    if (bad) break;
+  }
+  std::fclose(f);
+  return appended;
+}
+
+void serve(int fd, const std::string& dir) {
+  Conn c(fd);
+  std::string line;
+  for (;;) {
+    if (!c.line(line) || line.empty()) return;
+    const size_t sp1 = line.find(' '), sp2 = line.rfind(' ');
+    if (sp1 == std::string::npos || sp2 <= sp1) return;
+    const std::string method = line.substr(0, sp1);
+    const std::string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+
+    bool chunked = false, close = false;
+    long length = 0;
+    while (c.line(line) && !line.empty()) {
+      std::string k = line.substr(0, line.find(':'));
+      for (auto& ch : k) ch = (char)tolower((unsigned char)ch);
+      const std::string v = line.substr(line.find(':') + 1);
+      if (k == "transfer-encoding" && v.find("chunked") != std::string::npos) chunked = true;
+      if (k == "content-length") length = std::atol(v.c_str());
+      if (k == "connection" && v.find("close") != std::string::npos) close = true;
+    }
+
+    const std::string id = queryParam(target, "id");
+    if (!validId(id)) {
+      respond(c, 400, "Bad Request", -1, "{\"error\":\"bad id\"}", true);
+      return;
+    }
+    const std::string path = dir + "/" + id + ".vrb";
+    const long held = blocksHeld(path);
+
+    if (method == "GET") {
+      if (!respond(c, 200, "OK", held, "{\"next_block\":" + std::to_string(held) + "}", close) || close) return;
+      continue;
+    }
+    if (method != "POST") {
+      respond(c, 405, "Method Not Allowed", -1, "{}", true);
+      return;
+    }
+
+    const long from = std::atol(queryParam(target, "from").c_str());
+    const long total = std::atol(queryParam(target, "blocks").c_str());
+    if (from != held) {
+      // The body is not wanted: answer and drop the connection
+      respond(c, 409, "Conflict", held, "{\"next_block\":" + std::to_string(held) + "}", true);
+      std::printf("%s: POST from %ld, holding %ld -> 409\n", id.c_str(), from, held);
+      return;
+    }
+
+    const auto t0 = std::chrono::steady_clock::now();
+    Body body(c, chunked, length);
+    size_t wire = 0;
+    bool bad = false;
+    const long got = receive(body, path, wire, bad);
+    const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    const long now_held = blocksHeld(path);
+    std::printf("%s: +%ld blocks (%ld/%ld), %zu B on the wire for %ld B stored (%.0f%%), %.2f s%s%s\n",
+                id.c_str(), got, now_held, total, wire, got * (long)vib::rec::kBlockBytes,
+                got ? 100.0 * (double)wire / (double)(got * (long)vib::rec::kBlockBytes) : 0.0, s,
+                bad ? ", malformed record" : "", body.complete() ? "" : ", cut short");
+    std::fflush(stdout);
+    if (got < 0) {
+      respond(c, 500, "Internal Server Error", held, "{\"error\":\"cannot write\"}", true);
+      return;
+    }
+    if (!body.complete()) return;   // nobody to answer
+    respond(c, bad ? 400 : 200, bad ? "Bad Request" : "OK", now_held,
+            "{\"next_block\":" + std::to_string(now_held) + ",\"blocks\":" + std::to_string(total) + "}", true);
+    return;
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const int port = (argc > 1) ? std::atoi(argv[1]) : 8080;
+  const std::string dir = (argc > 2) ? argv[2] : ".";
+
+  const int ls = socket(AF_INET, SOCK_STREAM, 0);
+  const int one = 1;
+  setsockopt(ls, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons((uint16_t)port);
+  if (bind(ls, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(ls, 4) != 0) {
+    std::perror("rec_http_sink");
+    return 1;
+  }
+  std::printf("rec_http_sink: listening on :%d, storing in %s\n", port, dir.c_str());
+  std::fflush(stdout);
+
+  for (;;) {
+    const int fd = accept(ls, nullptr, nullptr);
+    if (fd < 0) continue;
+    timeval tv{30, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    serve(fd, dir);
+    close(fd);
+  }
+}
@@ -0,0 +1,772 @@
+// vib_bench.cpp
+// Host benchmark + equivalence check for lib/vib kernels.
+//
+// Build (from repo root):
+//   g++ -O2 -std=c++17 -Ilib/vib/src tools/vib_bench.cpp -o vib_bench            (SSE2)
+//   g++ -O2 -std=c++17 -mavx2 -Ilib/vib/src tools/vib_bench.cpp -o vib_bench      (AVX)
+//
+// Every dispatched kernel (vib::*) is compared against the scalar reference
+// (vib::ref::*) on random data sized like a capture, then both are timed.
+// Exit code is non-zero if any kernel is outside its equivalence contract.
+//
+// A second section runs the capture signal path (HPF cascade -> 3-axis RMS ->
+// gate) in float and in fixed point (vib_fixed.h) for each range_g and
+// reports accuracy and speed of the fixed path against the float one.
+//
+// A third section runs each fused variant (vib_fused.h) against the generic
+// Pipeline built from the same specs; outputs must be bit-identical. The
+// fused loop is timed as pure compute here; on the device it runs in the
+// idle time between samples, so what matters there is the post-capture part.
+//
+// A fourth section runs the "speed" stage (vib_spectrum.h) on synthetic
+// machine signals (fundamental + harmonics + noise) and checks the estimate
+// is within one FFT bin of the true running speed.
+//
+// A fifth section runs the "kurtogram" stage on noise plus periodic decaying
+// impulses ringing a resonance (a bearing-fault model) and checks that the
+// selected band contains the resonance.
+//
+// A sixth section feeds Cov3/pca3 (vib_cov.h) samples drawn along known
+// rotated axes and checks the principal direction and energy ratios.
+//
+// A seventh section transcodes long-recording blocks (vib_rec.h) to the
+// bulk-upload form (VRD1, or the block itself when that is not smaller) and
+// parses them back; the digits must round-trip exactly.
+//
+// An eighth section feeds vib::Timing (vib_timing.h) a soft-scheduled
+// sample clock with known jitter and skipped slots and checks the counts.
+//
+// A ninth drives vib::clk (vib_clock.h) with a simulated wall clock that
+// runs 40 ppm fast, reads with random delays and steps once, and checks that
+// the mapped epochs stay within the model's own error bound.
+//
+// A tenth runs vib::sdft (vib_sdft.h), sliding and FFT-per-read, over
+// full-scale random data and a tone, and compares its spectrum with an FFT
+// of the same window (mean removed, periodic Hann) at several points,
+// including after a million samples (the integer state must not drift). It
+// also times the per-sample update against an FFT per hop.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "vib_kernels.h"
+#include "vib_fixed.h"
+#include "vib_pipeline.h"
+#include "vib_fused.h"
+#include "vib_cov.h"
+#include "vib_rec.h"
+#include "vib_timing.h"
+#include "vib_clock.h"
+#include "vib_sdft.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Defeat dead-code elimination of benchmarked results
+volatile double g_sink = 0.0;
+
+template <class F>
+double nsPerCall(F&& f, int reps) {
+  f(); // warm-up
+  const auto t0 = Clock::now();
+  for (int r = 0; r < reps; r++) f();
+  const auto t1 = Clock::now();
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)reps;
+}
+
+struct Report {
+  int failures = 0;
+
+  void row(const char* name, size_t n, double ns_ref, double ns_vec, double err, bool ok) {
+    std::printf("%-20s n=%-6zu ref=%9.1f ns  vec=%9.1f ns  x%5.2f  err=%.3g  %s\n",
+                name, n, ns_ref, ns_vec, ns_ref / (ns_vec > 0.0 ? ns_vec : 1.0), err,
+                ok ? "ok" : "MISMATCH");
+    if (!ok) failures++;
+  }
+};
+
+// Reductions differ by summation order only: bound by n * eps * sum|terms|
+bool closeReduction(double a, double b, double abs_sum, size_t n) {
+  const double tol = (double)n * 1.2e-7 * abs_sum + 1e-30;
+  return std::fabs(a - b) <= tol;
+}
+
+// Synthetic capture in mg, quantized like the LIS331HH at range_g:
+// 1 g on z + 37 Hz / 0.6 FS on x,y + noise.
+void makeCapture(uint8_t range_g, size_t n, float fs, std::mt19937& rng,
+                 std::vector<int16_t> ax[3]) {
+  const int32_t so = vib::fx::mg_per_digit(range_g);
+  const double fs_mg = (double)vib::fx::max_abs_mg(range_g);
+  std::normal_distribution<double> noise(0.0, 2.0 * so);
+  for (int k = 0; k < 3; k++) ax[k].resize(n);
+  for (size_t i = 0; i < n; i++) {
+    const double t = (double)i / fs;
+    const double s = 0.6 * fs_mg * std::sin(2.0 * M_PI * 37.0 * t);
+    const double v[3] = { s, 0.5 * s, 1000.0 };
+    for (int k = 0; k < 3; k++) {
+      long d = std::lround((v[k] + noise(rng)) / so);
+      if (d > 2047) d = 2047;
+      if (d < -2048) d = -2048;
+      ax[k][i] = (int16_t)(d * so);
+    }
+  }
+}
+
+void benchSignalPath(size_t n, int reps, Report& rep) {
+  const float fs = 1000.0f;
+  const float thr_mps2 = 10.78f;
+  const vib::Biquad sec[2] = { vib::biquad_highpass(2.0f, fs), vib::biquad_highpass(2.0f, fs) };
+  vib::fx::BiquadQ30 secq[2] = { vib::fx::toQ30(sec[0]), vib::fx::toQ30(sec[1]) };
+
+  std::printf("\nsignal path: HPF 2 Hz x2 -> |a| RMS -> gate (float vs fixed)\n");
+
+  std::mt19937 rng(777);
+  for (uint8_t range_g : { (uint8_t)6, (uint8_t)12, (uint8_t)24 }) {
+    std::vector<int16_t> ax[3];
+    makeCapture(range_g, n, fs, rng, ax);
+
+    std::vector<float> f(n);
+    std::vector<int16_t> q(n);
+    std::vector<int32_t> work(n);
+
+    double rms_f = 0.0, rms_q = 0.0, max_err_mg = 0.0;
+    bool pass_f = false, pass_q = false;
+    uint32_t sat = 0;
+
+    auto runFloat = [&]() {
+      double sum = 0.0;
+      for (int k = 0; k < 3; k++) {
+        float st[4] = {0};
+        vib::i16_to_f32(ax[k].data(), f.data(), n, 1.0f);
+        vib::biquad_cascade_f32(f.data(), f.data(), n, sec, st, 2);
+        sum += vib::sum_sq_f32(f.data(), n);
+      }
+      rms_f = std::sqrt(sum / (double)n);
+      pass_f = rms_f * (9.80665 / 1000.0) >= thr_mps2;
+    };
+
+    auto runFixed = [&]() {
+      int64_t sum = 0;
+      sat = 0;
+      for (int k = 0; k < 3; k++) {
+        vib::fx::BiquadStateQ st[2];
+        sat += vib::fx::biquad_cascade_q15(ax[k].data(), q.data(), n, secq, st, 2, work.data());
+        sum += vib::sum_sq_i16(q.data(), n);
+      }
+      rms_q = (double)vib::fx::mag_rms_counts(sum, (uint32_t)n);
+      pass_q = vib::fx::gate_pass(sum, vib::fx::gate_sum_sq_threshold(thr_mps2, 1.0f, (uint32_t)n));
+    };
+
+    // Output error on x (float path is the reference)
+    {
+      float st[4] = {0};
+      vib::fx::BiquadStateQ stq[2];
+      vib::i16_to_f32(ax[0].data(), f.data(), n, 1.0f);
+      vib::biquad_cascade_f32(f.data(), f.data(), n, sec, st, 2);
+      vib::fx::biquad_cascade_q15(ax[0].data(), q.data(), n, secq, stq, 2, work.data());
+      for (size_t i = 0; i < n; i++) {
+        const double e = std::fabs((double)f[i] - (double)q[i]);
+        if (e > max_err_mg) max_err_mg = e;
+      }
+    }
+
+    const double tf = nsPerCall([&] { runFloat(); g_sink += rms_f; }, reps);
+    const double tq = nsPerCall([&] { runFixed(); g_sink += rms_q; }, reps);
+
+    const double rel = std::fabs(rms_q - rms_f) / (rms_f > 0.0 ? rms_f : 1.0);
+    std::printf("range=%2ug headroom=%d bit  rms float=%.2f mg fixed=%.0f mg (rel %.2e)  "
+                "max|dy|=%.2f mg  sat=%u  gate %d/%d  float=%.1f us fixed=%.1f us  x%.2f\n",
+                (unsigned)range_g, vib::fx::headroom_bits(range_g), rms_f, rms_q, rel,
+                max_err_mg, (unsigned)sat, pass_f ? 1 : 0, pass_q ? 1 : 0,
+                tf / 1000.0, tq / 1000.0, tf / (tq > 0.0 ? tq : 1.0));
+
+    // 1 mg floor of isqrt + int16 rounding of the filtered output
+    const bool ok = (rel < 1e-3) && (max_err_mg <= 2.0) && (pass_f == pass_q);
+    if (!ok) {
+      std::printf("  fixed path outside tolerance\n");
+      rep.failures++;
+    }
+  }
+}
+
+// Captures one frame through a fused chain, as acquireN does on the device
+struct FusedCapture {
+  const std::vector<int16_t>* src;
+  vib::pipe::Frame* f;
+
+  template <class C>
+  bool operator()(vib::fused::Fused<C>& fz) {
+    fz.begin(*f);
+    for (uint32_t i = 0; i < f->n; i++) {
+      const int16_t xyz[3] = { src[0][i], src[1][i], src[2][i] };
+      fz.push(i, xyz);
+    }
+    return fz.finish();
+  }
+};
+
+struct FrameBufs {
+  std::vector<int16_t> ax[3];
+  std::vector<uint8_t> out[3];
+  std::vector<int32_t> work;
+  vib::pipe::Frame f;
+
+  FrameBufs(size_t n, uint8_t range_g) : work(n) {
+    for (int k = 0; k < 3; k++) {
+      ax[k].resize(n);
+      out[k].resize(2 * n);
+      f.axis[k] = ax[k].data();
+      f.out[k].data = out[k].data();
+      f.out[k].cap = out[k].size();
+    }
+    f.work = work.data();
+    f.n = (uint32_t)n;
+    f.fs_hz = 1000;
+    f.range_g = range_g;
+  }
+};
+
+bool sameFrame(const FrameBufs& a, const FrameBufs& b) {
+  const vib::pipe::Frame& x = a.f;
+  const vib::pipe::Frame& y = b.f;
+  bool ok = x.feat.valid == y.feat.valid && x.feat.sum_sq_mg2 == y.feat.sum_sq_mg2 &&
+            x.feat.clip == y.feat.clip && x.gate_pass == y.gate_pass &&
+            x.filt_sat == y.filt_sat && x.codec == y.codec && x.codec_clamps == y.codec_clamps;
+  for (int k = 0; k < 3 && ok; k++) {
+    ok = x.feat.peak_mg[k] == y.feat.peak_mg[k] && a.ax[k] == b.ax[k] &&
+         x.out[k].len == y.out[k].len &&
+         std::memcmp(x.out[k].data, y.out[k].data, x.out[k].len) == 0;
+  }
+  return ok;
+}
+
+void benchFused(size_t n, int reps, Report& rep) {
+  std::printf("\nfused variants vs generic pipeline (n=%zu, 12 g)\n", n);
+
+  std::mt19937 rng(4242);
+  std::vector<int16_t> src[3];
+  makeCapture(12, n, 1000.0f, rng, src);
+
+  const char* codecs[] = { "raw16", "raw12", "delta" };
+  for (int peak = 0; peak < 2; peak++) {
+    for (const char* c : codecs) {
+      for (int closed = 0; closed < 2; closed++) {
+        vib::pipe::StageSpec specs[6];
+        size_t m = 0;
+        specs[m].setType("hpf"); specs[m].addNum("fc_hz", 2.0f); specs[m++].addNum("order", 4.0f);
+        specs[m++].setType("rms");
+        if (peak) specs[m++].setType("peak");
+        specs[m].setType("gate"); specs[m++].addNum("min", closed ? 1e4f : 1.0f);
+        specs[m].setType("encode"); specs[m++].addStr("codec", c);
+
+        vib::pipe::Pipeline p;
+        char err[64];
+        if (!p.build(specs, m, nullptr, err, sizeof(err))) {
+          std::printf("  build failed: %s\n", err);
+          rep.failures++;
+          continue;
+        }
+        size_t covered = 0;
+        const vib::fused::Variant v = vib::fused::match(p, covered);
+        if (v == vib::fused::NONE) continue;
+
+        FrameBufs g(n, 12), fz(n, 12);
+        auto runGeneric = [&]() {
+          for (int k = 0; k < 3; k++) g.ax[k] = src[k];
+          p.run(g.f);
+        };
+        auto runFused = [&]() {
+          FusedCapture cap = { src, &fz.f };
+          size_t cov = covered;
+          if (vib::fused::dispatch(v, p, cov, cap)) p.run(fz.f, cov);
+        };
+        runGeneric();
+        runFused();
+        const bool ok = sameFrame(g, fz);
+
+        const double tg = nsPerCall([&] { runGeneric(); g_sink += g.f.feat.sum_sq_mg2; }, reps);
+        const double tf = nsPerCall([&] { runFused(); g_sink += fz.f.feat.sum_sq_mg2; }, reps);
+        // What is left after the capture on the device: the stages past the
+        // fused prefix (gate, and the encoder when the gate passes)
+        const double tp = nsPerCall([&] { p.run(fz.f, covered); g_sink += fz.f.out[0].len; }, reps);
+        char desc[96];
+        p.describe(desc, sizeof(desc));
+        std::printf("%-24s %-6s generic=%7.1f us  fused=%7.1f us, after capture %6.1f us  %s\n",
+                    desc, closed ? "closed" : "open", tg / 1000.0, tf / 1000.0, tp / 1000.0,
+                    ok ? "identical" : "MISMATCH");
+        if (!ok) rep.failures++;
+      }
+    }
+  }
+}
+
+void benchSpeed(size_t n, int reps, Report& rep) {
+  const float fs = 1000.0f;
+  std::printf("\nspeed estimation (n=%zu, fs=%.0f Hz, 300..6000 rpm, 4 harmonics)\n", n, fs);
+
+  vib::pipe::StageSpec sp;
+  sp.setType("speed");
+  vib::pipe::Pipeline p;
+  char err[64];
+  if (!p.build(&sp, 1, nullptr, err, sizeof(err))) {
+    std::printf("  build failed: %s\n", err);
+    rep.failures++;
+    return;
+  }
+
+  std::mt19937 rng(777);
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  // true speed (Hz), harmonic amplitudes (mg), noise (mg rms)
+  const struct { float hz; float amp[4]; float noise; } cases[] = {
+    { 24.7f, { 200, 80, 40, 20 }, 30 },
+    { 49.3f, { 150, 150, 60, 30 }, 50 },
+    { 12.1f, { 40, 120, 90, 60 }, 40 },     // weak fundamental
+    { 81.0f, { 100, 30, 0, 0 }, 80 },
+    { 0.0f,  { 0, 0, 0, 0 }, 100 },         // noise only: low confidence expected
+  };
+  FrameBufs fb(n, 12);
+  fb.f.fs_hz = (uint16_t)fs;
+  const size_t nfft = vib::spec::floor_pow2(n) > 2048 ? 2048 : vib::spec::floor_pow2(n);
+  const float df = fs / (float)nfft;
+  for (const auto& c : cases) {
+    for (size_t i = 0; i < n; i++) {
+      const float t = (float)i / fs;
+      for (int k = 0; k < 3; k++) {
+        float v = 0.0f;
+        for (int h = 0; h < 4; h++) {
+          v += c.amp[h] * std::sin(2.0f * (float)M_PI * c.hz * (float)(h + 1) * t + 0.7f * (float)(k + h));
+        }
+        fb.ax[k][i] = (int16_t)std::lround(v * (k == 2 ? 0.5f : 1.0f) + c.noise * noise(rng));
+      }
+    }
+    p.run(fb.f);
+    const float est = fb.f.feat.speed_hz;
+    const bool ok = c.hz == 0.0f ? fb.f.feat.speed_conf < 0.5f : std::fabs(est - c.hz) <= df;
+    const double t = nsPerCall([&] { p.run(fb.f); g_sink += fb.f.feat.speed_hz; }, reps);
+    std::printf("true=%6.1f rpm  est=%7.1f rpm  conf=%.2f  %7.1f us  %s\n",
+                c.hz * 60.0f, est * 60.0f, fb.f.feat.speed_conf, t / 1000.0, ok ? "ok" : "MISMATCH");
+    if (!ok) rep.failures++;
+  }
+}
+
+void benchKurtogram(size_t n, int reps, Report& rep) {
+  const float fs = 1000.0f;
+  std::printf("\nkurtogram (n=%zu, fs=%.0f Hz, nw 16..256)\n", n, fs);
+
+  vib::pipe::StageSpec sp;
+  sp.setType("kurtogram");
+  sp.addNum("fmin_hz", 20.0f);
+  vib::pipe::Pipeline p;
+  char err[64];
+  if (!p.build(&sp, 1, nullptr, err, sizeof(err))) {
+    std::printf("  build failed: %s\n", err);
+    rep.failures++;
+    return;
+  }
+
+  std::mt19937 rng(99);
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  // resonance (Hz), impulse rate (Hz), impulse amplitude (mg), noise (mg rms)
+  const struct { float f_res; float rate; float amp; float noise; } cases[] = {
+    { 300.0f, 7.3f, 400.0f, 40.0f },
+    { 120.0f, 11.0f, 300.0f, 40.0f },
+    { 410.0f, 5.1f, 250.0f, 60.0f },
+    { 0.0f, 0.0f, 0.0f, 60.0f },            // noise only: SK near 0 expected
+  };
+  FrameBufs fb(n, 12);
+  fb.f.fs_hz = (uint16_t)fs;
+  for (const auto& c : cases) {
+    for (size_t i = 0; i < n; i++) {
+      const float t = (float)i / fs;
+      float v = 0.0f;
+      if (c.rate > 0.0f) {
+        const float tau = std::fmod(t, 1.0f / c.rate);     // time since the last impact
+        v = c.amp * std::exp(-tau * 150.0f) * std::sin(2.0f * (float)M_PI * c.f_res * tau);
+      }
+      for (int k = 0; k < 3; k++) {
+        fb.ax[k][i] = (int16_t)std::lround(v * (k == 1 ? 1.0f : 0.3f) + c.noise * noise(rng));
+      }
+    }
+    p.run(fb.f);
+    const vib::pipe::Features& ft = fb.f.feat;
+    const bool ok = c.f_res == 0.0f ? ft.kurt < 1.5f
+                                    : (ft.kurt_f_lo_hz <= c.f_res && c.f_res <= ft.kurt_f_hi_hz);
+    const double t = nsPerCall([&] { p.run(fb.f); g_sink += fb.f.feat.kurt; }, reps);
+    std::printf("resonance=%5.0f Hz  band=%6.1f-%6.1f Hz axis=%c SK=%6.2f  %7.1f us  %s\n",
+                c.f_res, ft.kurt_f_lo_hz, ft.kurt_f_hi_hz, "xyz"[ft.kurt_axis], ft.kurt,
+                t / 1000.0, ok ? "ok" : "MISMATCH");
+    if (!ok) rep.failures++;
+  }
+}
+
+void benchPca(size_t n, int reps, Report& rep) {
+  std::printf("\nprincipal direction (n=%zu)\n", n);
+  std::mt19937 rng(31337);
+  std::normal_distribution<double> g(0.0, 1.0);
+  std::vector<int16_t> x(n), y(n), z(n);
+  const double sd[3] = { 800.0, 250.0, 60.0 };   // mg along the principal axes
+  for (int c = 0; c < 3; c++) {
+    // random orthonormal basis (Gram-Schmidt)
+    double e[3][3];
+    for (int i = 0; i < 3; i++) for (int k = 0; k < 3; k++) e[i][k] = g(rng);
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < i; j++) {
+        const double d = e[i][0] * e[j][0] + e[i][1] * e[j][1] + e[i][2] * e[j][2];
+        for (int k = 0; k < 3; k++) e[i][k] -= d * e[j][k];
+      }
+      const double l = std::sqrt(e[i][0] * e[i][0] + e[i][1] * e[i][1] + e[i][2] * e[i][2]);
+      for (int k = 0; k < 3; k++) e[i][k] /= l;
+    }
+    for (size_t i = 0; i < n; i++) {
+      double v[3] = { 0.0, 0.0, 1000.0 };   // gravity offset must not matter
+      for (int a = 0; a < 3; a++) {
+        const double u = sd[a] * g(rng);
+        for (int k = 0; k < 3; k++) v[k] += u * e[a][k];
+      }
+      x[i] = (int16_t)std::lround(v[0]); y[i] = (int16_t)std::lround(v[1]); z[i] = (int16_t)std::lround(v[2]);
+    }
+    vib::Pca3 r;
+    const double t = nsPerCall([&] {
+      vib::Cov3 acc;
+      for (size_t i = 0; i < n; i++) acc.add(x[i], y[i], z[i]);
+      r = vib::pca3(acc);
+      g_sink += r.dir[0];
+    }, reps);
+    const double cosang = std::fabs(r.dir[0] * e[0][0] + r.dir[1] * e[0][1] + r.dir[2] * e[0][2]);
+    const double tot = sd[0] * sd[0] + sd[1] * sd[1] + sd[2] * sd[2];
+    const double r0 = sd[0] * sd[0] / tot;
+    const bool ok = r.valid && cosang > 0.995 && std::fabs(r.ratio[0] - r0) < 0.05 &&
+                    r.ratio[0] >= r.ratio[1] && r.ratio[1] >= r.ratio[2];
+    std::printf("dir=(%6.3f %6.3f %6.3f) angle=%5.2f deg  ratio=%.3f/%.3f/%.3f (true %.3f)  %6.1f ns/sample  %s\n",
+                r.dir[0], r.dir[1], r.dir[2], std::acos(std::fmin(1.0, cosang)) * 180.0 / M_PI,
+                r.ratio[0], r.ratio[1], r.ratio[2], r0, t / (double)n, ok ? "ok" : "MISMATCH");
+    if (!ok) rep.failures++;
+  }
+}
+
+void benchRecDelta(int reps, Report& rep) {
+  std::printf("\nrecording blocks raw12 -> VRD1\n");
+  const size_t spb = vib::rec::kSamplesPerBlock;
+  std::mt19937 rng(4242);
+  std::normal_distribution<double> g(0.0, 1.0);
+  // 6 g range (3 mg/digit): 1 g on z, 120 Hz + 37 Hz on x/y at 1 kHz, noise;
+  // amplitude in digits per row, last row a full-scale square wave
+  const double amp[4] = { 5.0, 60.0, 400.0, 0.0 };
+  for (int c = 0; c < 4; c++) {
+    std::vector<int16_t> d(spb * 3), back(spb * 3);
+    for (size_t i = 0; i < spb; i++) {
+      const double t = (double)i / 1000.0;
+      for (int k = 0; k < 3; k++) {
+        double v = (k == 2 ? 333.0 : 0.0) + amp[c] * (std::sin(2 * M_PI * 120.0 * t + k) + 0.5 * std::sin(2 * M_PI * 37.0 * t)) + 1.5 * g(rng);
+        if (c == 3) v = ((i / 3) & 1) ? 2047.0 : -2048.0;
+        d[i * 3 + k] = (int16_t)std::max(-2048.0, std::min(2047.0, std::round(v)));
+      }
+    }
+    // Odd sample count on one row: the raw12 payload ends in half a pair
+    vib::rec::BlockHeader h;
+    h.first_idx = 1000u * (uint32_t)c;
+    h.t_us = 77u;
+    h.n = (uint16_t)(c == 1 ? spb - 1 : spb);
+    h.seq = (uint16_t)c;
+    uint8_t blk[vib::rec::kBlockBytes], rec[vib::rec::kDeltaMaxBytes];
+    vib::rec::pack_block(h, d.data(), blk);
+
+    size_t len = 0;
+    const double t = nsPerCall([&] { len = vib::rec::to_delta(blk, rec, sizeof(rec)); g_sink += (double)len; }, reps);
+    const bool delta = len > 0;
+    if (!delta) { std::memcpy(rec, blk, sizeof(blk)); len = sizeof(blk); }
+    vib::rec::BlockHeader h2;
+    size_t used = 0;
+    const bool parsed = vib::rec::from_record(rec, len, used, h2, back.data());
+    const bool ok = parsed && used == len && h2.n == h.n && h2.first_idx == h.first_idx &&
+                    h2.t_us == h.t_us && h2.seq == h.seq &&
+                    std::memcmp(d.data(), back.data(), (size_t)h.n * 3 * sizeof(int16_t)) == 0;
+    const size_t raw = vib::rec::kHeaderBytes + vib::codec::max_bytes(vib::codec::RAW12, (size_t)h.n * 3);
+    std::printf("amp=%5.0f digits  n=%u  raw12 %4zu B -> %s %4zu B (%5.1f%%)  %7.1f ns/block  %s\n",
+                c == 3 ? 2048.0 : amp[c], (unsigned)h.n, raw, delta ? "VRD1" : "VRB1", len,
+                100.0 * (double)len / (double)raw, t, ok ? "ok" : "MISMATCH");
+    if (!ok) rep.failures++;
+  }
+}
+
+void benchTiming(size_t n, int reps, Report& rep) {
+  std::printf("\ntiming quality (n=%zu)\n", n);
+  const uint32_t period = 1000;
+  std::mt19937 rng(99);
+  std::normal_distribution<double> g(0.0, 6.0);   // read jitter, us
+  std::vector<uint32_t> dt(n), lag(n);
+  // Reads land late by |jitter|; every 250th slot is skipped (a 2-period gap)
+  int64_t last = 0;
+  size_t skipped = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint64_t slot = i + skipped;
+    if (i && i % 250 == 0) { slot++; skipped++; }
+    const int64_t t = (int64_t)slot * period + (int64_t)std::lround(std::fabs(g(rng)));
+    dt[i] = (uint32_t)(t - last);
+    lag[i] = (uint32_t)(t - (int64_t)slot * period);
+    last = t;
+  }
+  vib::Timing tq;
+  const double t = nsPerCall([&] {
+    tq.begin(period);
+    for (size_t i = 1; i < n; i++) tq.add(dt[i], lag[i]);
+    g_sink += (double)tq.dt_sum_us;
+  }, reps);
+  uint64_t hsum = 0;
+  for (size_t k = 0; k < vib::Timing::kBins; k++) hsum += tq.hist[k];
+  const size_t want_missed = (n - 1) / 250;
+  const bool ok = hsum == n - 1 && tq.missed == want_missed && tq.sat == 0 &&
+                  tq.hist[7] == want_missed && tq.dt_sd_us() > 5.0 && tq.lag_max_us < 40;
+  std::printf("hist=");
+  for (size_t k = 0; k < vib::Timing::kBins; k++) std::printf("%u%s", (unsigned)tq.hist[k], k + 1 < vib::Timing::kBins ? "/" : "");
+  std::printf("  missed=%u (want %zu)  sd=%.1f us  lag_max=%u us  %.1f ns/sample  %s\n",
+              (unsigned)tq.missed, want_missed, tq.dt_sd_us(), (unsigned)tq.lag_max_us,
+              t / (double)n, ok ? "ok" : "MISMATCH");
+  if (!ok) rep.failures++;
+}
+
+void benchClock(Report& rep) {
+  std::printf("\nclock correlation\n");
+  std::mt19937 rng(7);
+  std::exponential_distribution<double> delay(1.0 / 3.0);   // read delays, us
+  const double skew = 40e-6;
+  int64_t t = 5000000;           // true monotonic time
+  int64_t step = 0;              // wall clock step applied so far
+  const int64_t offset = 1700000000000000LL;
+  auto wall_at = [&](int64_t m) { return offset + step + m + (int64_t)std::llround((double)m * skew); };
+  // Each clock read costs 1 us plus a random delay (an interrupt now and then)
+  auto mono = [&]() { t += 1 + (int64_t)delay(rng); return t; };
+  auto wall = [&]() { t += 1 + (int64_t)delay(rng); return wall_at(t); };
+
+  vib::clk::Model m;
+  bool ok = m.update(vib::clk::sample(mono, wall, 8));
+  uint32_t worst_err = 0;
+  int64_t worst_miss = 0;
+  bool step_seen = false;
+  for (int i = 1; i <= 60; i++) {
+    t += 1000000;                                  // a pair each second
+    if (i == 40) step += 25000;                    // NTP steps the wall clock
+    const bool no_step = m.update(vib::clk::sample(mono, wall, 8));
+    if (!no_step) step_seen = (i == 40);
+    else if (i == 40) ok = false;
+    // A capture time half a second later, mapped through the model
+    const int64_t q = t + 500000;
+    const int64_t miss = m.epoch_at(q) - wall_at(q);
+    const uint32_t bound = m.err_at(q);
+    if (std::llabs(miss) > (int64_t)bound + 1) ok = false;
+    if (std::llabs(miss) > worst_miss) worst_miss = std::llabs(miss);
+    if (bound > worst_err) worst_err = bound;
+  }
+  ok = ok && step_seen && m.steps() == 1 && std::fabs(m.skew_ppm() - 40.0) < 2.0;
+  std::printf("skew %.2f ppm (true 40), steps %u, worst miss %lld us within bound (max %u us)  %s\n",
+              m.skew_ppm(), (unsigned)m.steps(), (long long)worst_miss, (unsigned)worst_err,
+              ok ? "ok" : "MISMATCH");
+  if (!ok) rep.failures++;
+}
+
+// Reference for vib::sdft: FFT of the last n samples, mean removed, periodic Hann
+void sdftReference(const std::vector<int16_t> (&x)[3], size_t end, size_t n, std::vector<float>& cbuf,
+                   std::vector<float>& psd) {
+  psd.assign(n / 2 + 1, 0.0f);
+  cbuf.resize(2 * n);
+  for (size_t a = 0; a < 3; a++) {
+    double mean = 0.0;
+    for (size_t i = 0; i < n; i++) mean += x[a][end - n + i];
+    mean /= (double)n;
+    for (size_t i = 0; i < n; i++) {
+      const double w = 0.5 - 0.5 * std::cos(2.0 * M_PI * (double)i / (double)n);
+      cbuf[2 * i] = (float)(((double)x[a][end - n + i] - mean) * w);
+      cbuf[2 * i + 1] = 0.0f;
+    }
+    vib::spec::fft_c32(cbuf.data(), n);
+    for (size_t k = 0; k <= n / 2; k++) psd[k] += cbuf[2 * k] * cbuf[2 * k] + cbuf[2 * k + 1] * cbuf[2 * k + 1];
+  }
+}
+
+void benchSdft(int reps, Report& rep) {
+  std::printf("\nsliding DFT\n");
+  const size_t n = 512;
+  const size_t total = 1000000 + 3 * n;
+  std::mt19937 rng(31);
+  std::uniform_int_distribution<int> full(-32767, 32767);
+  std::normal_distribution<double> g(0.0, 40.0);
+  std::vector<int16_t> x[3];
+  for (auto& v : x) v.resize(total);
+  // Full-scale noise (worst case for the int32 products), then a 137.3 Hz
+  // tone at 1 kHz over noise and gravity for the last part
+  for (size_t i = 0; i < total; i++) {
+    const bool tone = i >= total - 2 * n;
+    for (size_t a = 0; a < 3; a++) {
+      const double s = 2000.0 * std::sin(2.0 * M_PI * 137.3 * (double)i / 1000.0 + (double)a);
+      const double v = tone ? s / (double)(a + 1) + g(rng) + (a == 2 ? 1000.0 : 0.0) : (double)full(rng);
+      x[a][i] = (int16_t)std::max(-32767.0, std::min(32767.0, std::round(v)));
+    }
+  }
+
+  struct Band { size_t k0, k1; };
+  const Band bands[2] = { { 0, n / 2 }, { 40, 90 } };
+  const size_t checks[4] = { n, 3 * n, total - n, total };
+  bool ok = true;
+  double worst = 0.0;
+  std::vector<float> cbuf, ref;
+  for (int mode = 0; mode < 4; mode++) {
+    const Band& b = bands[mode & 1];
+    const bool sliding = mode < 2;
+    std::vector<uint8_t> mem(vib::sdft::Sliding3::bytes(n, b.k0, b.k1, sliding));
+    vib::sdft::Sliding3 s;
+    if (!s.begin(n, b.k0, b.k1, mem.data(), mem.size(), sliding)) { ok = false; break; }
+    std::vector<float> psd(b.k1 - b.k0 + 1);
+    size_t c = 0;
+    for (size_t i = 0; i < total; i++) {
+      const int16_t v[3] = { x[0][i], x[1][i], x[2][i] };
+      s.push(v);
+      if (c < 4 && i + 1 == checks[c]) {
+        c++;
+        s.power(psd.data());
+        sdftReference(x, i + 1, n, cbuf, ref);
+        double peak = 0.0, err = 0.0;
+        for (size_t k = b.k0; k <= b.k1; k++) peak = std::max(peak, (double)ref[k]);
+        for (size_t k = b.k0; k <= b.k1; k++) err = std::max(err, std::fabs((double)psd[k - b.k0] - ref[k]));
+        worst = std::max(worst, err / peak);
+        if (!(err <= 1e-3 * peak)) ok = false;
+      }
+    }
+  }
+
+  // Cost per sample: sliding update (all bins) vs a 3-axis FFT every hop
+  std::vector<uint8_t> mem(vib::sdft::Sliding3::bytes(n, 0, n / 2));
+  vib::sdft::Sliding3 s;
+  s.begin(n, 0, n / 2, mem.data(), mem.size());
+  const size_t run = 4096;
+  const double t_sdft = nsPerCall([&] {
+    for (size_t i = 0; i < run; i++) {
+      const int16_t v[3] = { x[0][i], x[1][i], x[2][i] };
+      s.push(v);
+    }
+    g_sink += (double)s.count();
+  }, reps) / (double)run;
+  std::vector<uint8_t> fmem(vib::sdft::Sliding3::bytes(n, 0, n / 2, false));
+  vib::sdft::Sliding3 f;
+  f.begin(n, 0, n / 2, fmem.data(), fmem.size(), false);
+  for (size_t i = 0; i < n; i++) {
+    const int16_t v[3] = { x[0][i], x[1][i], x[2][i] };
+    f.push(v);
+  }
+  std::vector<float> psd(n / 2 + 1);
+  const double t_fft = nsPerCall([&] { f.power(psd.data()); g_sink += psd[1]; }, reps * 4);
+  size_t cross = 1;
+  while (vib::sdft::Sliding3::prefer_sliding(n, 0, n / 2, cross + 1)) cross++;
+  std::printf("n=%zu: max err %.2g of peak  sliding %.1f ns/sample (%zu bins)  fft %.0f ns/read = %.1f ns/sample at hop n/4, %.1f at hop n/32 (model: sliding up to hop %zu)  %s\n",
+              n, worst, t_sdft, n / 2 + 1, t_fft, t_fft / (double)(n / 4), t_fft / (double)(n / 32), cross,
+              ok ? "ok" : "MISMATCH");
+  if (!ok) rep.failures++;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const size_t n = (argc > 1) ? (size_t)std::strtoul(argv[1], nullptr, 10) : 2048;
+  const int reps = (argc > 2) ? std::atoi(argv[2]) : 2000;
+
+  std::printf("vib kernels: impl=%s n=%zu reps=%d\n", vib::kernel_impl(), n, reps);
+
+  std::mt19937 rng(12345);
+  std::uniform_int_distribution<int> di16(-32768, 32767);
+  std::normal_distribution<float> dnorm(0.0f, 1.0f);
+
+  std::vector<int16_t> xi(n);
+  for (auto& v : xi) v = (int16_t)di16(rng);
+  // Worst case for the SSE madd path: two adjacent -32768
+  if (n >= 2) { xi[0] = -32768; xi[1] = -32768; }
+
+  std::vector<float> a(n), b(n), o_ref(n), o_vec(n), w(n);
+  for (auto& v : a) v = dnorm(rng);
+  for (auto& v : b) v = dnorm(rng);
+  vib::window_hann(w.data(), n);
+
+  Report rep;
+
+  // i16_to_f32 (bit-exact)
+  {
+    const float scale = 9.80665f / 1000.0f;
+    vib::ref::i16_to_f32(xi.data(), o_ref.data(), n, scale);
+    vib::i16_to_f32(xi.data(), o_vec.data(), n, scale);
+    const bool ok = std::memcmp(o_ref.data(), o_vec.data(), n * sizeof(float)) == 0;
+    double tr = nsPerCall([&] { vib::ref::i16_to_f32(xi.data(), o_ref.data(), n, scale); g_sink += o_ref[0]; }, reps);
+    double tv = nsPerCall([&] { vib::i16_to_f32(xi.data(), o_vec.data(), n, scale); g_sink += o_vec[0]; }, reps);
+    rep.row("i16_to_f32", n, tr, tv, 0.0, ok);
+  }
+
+  // sum_sq_i16 (exact)
+  {
+    const int64_t r = vib::ref::sum_sq_i16(xi.data(), n);
+    const int64_t v = vib::sum_sq_i16(xi.data(), n);
+    double tr = nsPerCall([&] { g_sink += (double)vib::ref::sum_sq_i16(xi.data(), n); }, reps);
+    double tv = nsPerCall([&] { g_sink += (double)vib::sum_sq_i16(xi.data(), n); }, reps);
+    rep.row("sum_sq_i16", n, tr, tv, (double)(r - v), r == v);
+  }
+
+  // sum_sq_f32 / dot_f32 (reordered reduction)
+  {
+    double abs_sum = 0.0;
+    for (size_t i = 0; i < n; i++) abs_sum += (double)a[i] * a[i];
+    const float r = vib::ref::sum_sq_f32(a.data(), n);
+    const float v = vib::sum_sq_f32(a.data(), n);
+    double tr = nsPerCall([&] { g_sink += vib::ref::sum_sq_f32(a.data(), n); }, reps);
+    double tv = nsPerCall([&] { g_sink += vib::sum_sq_f32(a.data(), n); }, reps);
+    rep.row("sum_sq_f32", n, tr, tv, std::fabs((double)r - v), closeReduction(r, v, abs_sum, n));
+  }
+  {
+    double abs_sum = 0.0;
+    for (size_t i = 0; i < n; i++) abs_sum += std::fabs((double)a[i] * b[i]);
+    const float r = vib::ref::dot_f32(a.data(), b.data(), n);
+    const float v = vib::dot_f32(a.data(), b.data(), n);
+    double tr = nsPerCall([&] { g_sink += vib::ref::dot_f32(a.data(), b.data(), n); }, reps);
+    double tv = nsPerCall([&] { g_sink += vib::dot_f32(a.data(), b.data(), n); }, reps);
+    rep.row("dot_f32", n, tr, tv, std::fabs((double)r - v), closeReduction(r, v, abs_sum, n));
+  }
+
+  // mul_f32 / windowing (bit-exact)
+  {
+    vib::ref::mul_f32(a.data(), w.data(), o_ref.data(), n);
+    vib::mul_f32(a.data(), w.data(), o_vec.data(), n);
+    const bool ok = std::memcmp(o_ref.data(), o_vec.data(), n * sizeof(float)) == 0;
+    double tr = nsPerCall([&] { vib::ref::mul_f32(a.data(), w.data(), o_ref.data(), n); g_sink += o_ref[1]; }, reps);
+    double tv = nsPerCall([&] { vib::mul_f32(a.data(), w.data(), o_vec.data(), n); g_sink += o_vec[1]; }, reps);
+    rep.row("mul_f32 (window)", n, tr, tv, 0.0, ok);
+  }
+
+  // biquad cascade: HPF 5 Hz + LPF 400 Hz @ 1 kHz (bit-exact, same DF-II form)
+  {
+    const vib::Biquad sec[2] = { vib::biquad_highpass(5.0f, 1000.0f), vib::biquad_lowpass(400.0f, 1000.0f) };
+    float st_ref[4] = {0}, st_vec[4] = {0};
+    vib::ref::biquad_cascade_f32(a.data(), o_ref.data(), n, sec, st_ref, 2);
+    vib::biquad_cascade_f32(a.data(), o_vec.data(), n, sec, st_vec, 2);
+    const bool ok = std::memcmp(o_ref.data(), o_vec.data(), n * sizeof(float)) == 0;
+    double tr = nsPerCall([&] { vib::ref::biquad_cascade_f32(a.data(), o_ref.data(), n, sec, st_ref, 2); g_sink += o_ref[2]; }, reps);
+    double tv = nsPerCall([&] { vib::biquad_cascade_f32(a.data(), o_vec.data(), n, sec, st_vec, 2); g_sink += o_vec[2]; }, reps);
+    rep.row("biquad_cascade x2", n, tr, tv, 0.0, ok);
+  }
+
+  benchSignalPath(n, reps / 10 > 0 ? reps / 10 : 1, rep);
+  benchFused(n, reps / 10 > 0 ? reps / 10 : 1, rep);
+  benchSpeed(n, reps / 100 > 0 ? reps / 100 : 1, rep);
+  benchKurtogram(n, reps / 100 > 0 ? reps / 100 : 1, rep);
+  benchPca(n, reps / 10 > 0 ? reps / 10 : 1, rep);
+  benchRecDelta(reps, rep);
+  benchTiming(n, reps / 10 > 0 ? reps / 10 : 1, rep);
+  benchClock(rep);
+  benchSdft(reps / 100 > 0 ? reps / 100 : 1, rep);
+
+  if (rep.failures) {
+    std::printf("%d kernel(s) outside equivalence contract\n", rep.failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,168 @@
+// vib_golden.cpp
+// Golden vectors and host throughput of the shared feature path (vib_golden.h).
+//
+// Build (from repo root):
+//   g++ -O2 -std=c++17 -pthread -Ilib/vib/src tools/vib_golden.cpp -o vib_golden
+// Run:
+//   ./vib_golden print                       golden lines for every case
+//   ./vib_golden check [file=tools/golden/features.txt]
+//       recomputes every case and compares it with the file: fields before
+//       "|" exactly, float spectrum fields within a tolerance. The file may
+//       also be a device serial log of a VIB_GOLDEN_SELFTEST build (lines
+//       "golden: ..."), which checks the device against this host.
+//   ./vib_golden bench [threads=ncpu] [seconds=2]
+//       recomputes captures of every case on all threads (one pipeline per
+//       case and thread) and reports captures/s and samples/s
+//
+// Exit code is non-zero on any mismatch. Regenerate the file with
+// `./vib_golden print > tools/golden/features.txt` only when a change to the
+// feature path is intended, and say so in the commit.
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vib_golden.h"
+
+namespace {
+
+std::string caseLine(const vib::golden::Case& c) {
+  vib::pipe::Pipeline p;
+  char err[64];
+  if (!vib::golden::build(c, p, err, sizeof(err))) return std::string(c.name) + " BUILD FAILED: " + err;
+  vib::golden::Scratch s;
+  vib::pipe::Frame f;
+  vib::golden::run(c, p, s, f);
+  char line[512];
+  vib::golden::format(c, f, line, sizeof(line));
+  return line;
+}
+
+// "a~1.5 b~2" -> {a: 1.5, b: 2}
+std::map<std::string, double> approxFields(const std::string& s) {
+  std::map<std::string, double> out;
+  size_t p = 0;
+  while (p < s.size()) {
+    const size_t t = s.find('~', p);
+    if (t == std::string::npos) break;
+    size_t k = s.rfind(' ', t);
+    k = (k == std::string::npos || k < p) ? p : k + 1;
+    out[s.substr(k, t - k)] = std::atof(s.c_str() + t + 1);
+    p = s.find(' ', t);
+    if (p == std::string::npos) break;
+  }
+  return out;
+}
+
+bool sameLine(const std::string& want, const std::string& got, std::string& why) {
+  const size_t bw = want.find(" | "), bg = got.find(" | ");
+  if (bw == std::string::npos || bg == std::string::npos) { why = "malformed line"; return false; }
+  if (want.compare(0, bw, got, 0, bg) != 0) { why = "integer path differs"; return false; }
+  const auto a = approxFields(want.substr(bw + 3)), b = approxFields(got.substr(bg + 3));
+  for (const auto& kv : a) {
+    const auto it = b.find(kv.first);
+    if (it == b.end()) { why = kv.first + " missing"; return false; }
+    const double tol = 1e-3 * std::fabs(kv.second) + 1e-3;
+    if (std::fabs(it->second - kv.second) > tol) {
+      char m[96];
+      std::snprintf(m, sizeof(m), "%s %.4f vs %.4f", kv.first.c_str(), it->second, kv.second);
+      why = m;
+      return false;
+    }
+  }
+  return true;
+}
+
+int check(const char* path) {
+  FILE* fp = std::fopen(path, "r");
+  if (!fp) { std::perror(path); return 2; }
+  std::map<std::string, std::string> want;
+  char buf[1024];
+  while (std::fgets(buf, sizeof(buf), fp)) {
+    std::string l(buf);
+    while (!l.empty() && (l.back() == '\n' || l.back() == '\r')) l.pop_back();
+    const size_t g = l.find("golden: ");
+    if (g != std::string::npos) l = l.substr(g + 8);
+    const std::string name = l.substr(0, l.find(' '));
+    for (size_t i = 0; i < vib::golden::kNumCases; i++) {
+      if (name == vib::golden::kCases[i].name) want[name] = l;
+    }
+  }
+  std::fclose(fp);
+
+  int failures = 0;
+  for (size_t i = 0; i < vib::golden::kNumCases; i++) {
+    const vib::golden::Case& c = vib::golden::kCases[i];
+    const auto it = want.find(c.name);
+    if (it == want.end()) { std::printf("%-22s not in %s\n", c.name, path); failures++; continue; }
+    std::string why;
+    const bool ok = sameLine(it->second, caseLine(c), why);
+    std::printf("%-22s %s%s%s\n", c.name, ok ? "ok" : "MISMATCH", ok ? "" : ": ", why.c_str());
+    if (!ok) failures++;
+  }
+  std::printf("%zu cases, %d failed (kernels: %s)\n", vib::golden::kNumCases, failures, vib::kernel_impl());
+  return failures ? 1 : 0;
+}
+
+int bench(unsigned threads, double seconds) {
+  std::atomic<uint64_t> captures{0}, samples{0};
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; t++) {
+    pool.emplace_back([&] {
+      std::vector<std::unique_ptr<vib::pipe::Pipeline>> pipes;
+      for (size_t i = 0; i < vib::golden::kNumCases; i++) {
+        pipes.emplace_back(new vib::pipe::Pipeline());
+        char err[64];
+        vib::golden::build(vib::golden::kCases[i], *pipes.back(), err, sizeof(err));
+      }
+      vib::golden::Scratch s;
+      vib::pipe::Frame f;
+      uint64_t caps = 0, n = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        for (size_t i = 0; i < vib::golden::kNumCases; i++) {
+          vib::golden::run(vib::golden::kCases[i], *pipes[i], s, f);
+          caps++;
+          n += vib::golden::kCases[i].n;
+        }
+      }
+      captures += caps;
+      samples += n;
+    });
+  }
+  const auto t0 = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop = true;
+  for (auto& th : pool) th.join();
+  const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  std::printf("%u thread(s), %.1f s, kernels %s: %.0f captures/s, %.2f M samples/s (3 axes, signal synthesis included)\n",
+              threads, secs, vib::kernel_impl(), (double)captures.load() / secs, (double)samples.load() / secs / 1e6);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const std::string mode = argc > 1 ? argv[1] : "check";
+  if (mode == "print") {
+    for (size_t i = 0; i < vib::golden::kNumCases; i++) std::printf("%s\n", caseLine(vib::golden::kCases[i]).c_str());
+    return 0;
+  }
+  if (mode == "check") return check(argc > 2 ? argv[2] : "tools/golden/features.txt");
+  if (mode == "bench") {
+    unsigned th = std::thread::hardware_concurrency();
+    if (argc > 2) th = (unsigned)std::atoi(argv[2]);
+    if (!th) th = 1;
+    return bench(th, argc > 3 ? std::atof(argv[3]) : 2.0);
+  }
+  std::fprintf(stderr, "usage: %s print | check [file] | bench [threads] [seconds]\n", argv[0]);
+  return 2;
+}